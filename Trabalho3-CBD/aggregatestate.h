@@ -0,0 +1,119 @@
+#ifndef AGGREGATESTATE_H
+#define AGGREGATESTATE_H
+
+#include <stdlib.h>
+
+#include "util.h"
+#include "typedkey.h"
+
+enum AggregateFunction { COUNT_AGGREGATE, SUM_AGGREGATE, MIN_AGGREGATE, MAX_AGGREGATE, AVG_AGGREGATE };
+
+/**
+ * Values of the group by columns of a row.
+ */
+struct GroupKey {
+    vector<TypedKey> values;
+
+    bool operator==(const GroupKey & other) const;
+};
+
+struct GroupKeyHash {
+    size_t operator()(const GroupKey & key) const;
+};
+
+/**
+ * Running value of one aggregate over the rows of a group so far.
+ */
+struct AggregateState {
+    long long count;
+    long long integer_sum;
+    double real_sum;
+    // MIN or MAX so far
+    TypedKey extreme;
+
+    AggregateState() : count(0), integer_sum(0), real_sum(0) {}
+};
+
+/**
+ * Adds a row to the state: value is the aggregated column, NULL for COUNT(*).
+ */
+void updateAggregateState(AggregateState & state, AggregateFunction function, const TypedKey * value);
+
+/**
+ * COUNT is an INTEGER_KEY, AVG a REAL_KEY, SUM of the kind of its column
+ * (REAL_KEY for strings), MIN and MAX of the kind of their column.
+ * @param column_kind kind of the aggregated column, INTEGER_KEY for COUNT(*)
+ */
+TypedKey getAggregateResult(AggregateState & state, AggregateFunction function, KeyKind column_kind);
+
+/**
+ * @return COUNT, SUM, MIN, MAX or AVG
+ */
+string getAggregateFunctionName(AggregateFunction function);
+
+bool GroupKey::operator==(const GroupKey & other) const {
+    return values == other.values;
+}
+
+size_t GroupKeyHash::operator()(const GroupKey & key) const {
+    TypedKeyHash hash;
+    size_t value = 0;
+    for (size_t i = 0; i < key.values.size(); i++) {
+        value = value * 31 + hash(key.values[i]);
+    }
+    return value;
+}
+
+void updateAggregateState(AggregateState & state, AggregateFunction function, const TypedKey * value) {
+    state.count++;
+    if (value == NULL) return;
+
+    switch (function) {
+        case SUM_AGGREGATE :
+        case AVG_AGGREGATE :
+            if (value->kind == INTEGER_KEY) {
+                state.integer_sum += value->integer_value;
+            } else {
+                state.real_sum += value->kind == REAL_KEY ? value->real_value : atof(value->string_value.c_str());
+            }
+            break;
+        case MIN_AGGREGATE :
+            if (state.count == 1 || *value < state.extreme) state.extreme = *value;
+            break;
+        case MAX_AGGREGATE :
+            if (state.count == 1 || state.extreme < *value) state.extreme = *value;
+            break;
+        default :
+            break;
+    }
+}
+
+TypedKey getAggregateResult(AggregateState & state, AggregateFunction function, KeyKind column_kind) {
+    TypedKey value;
+    switch (function) {
+        case COUNT_AGGREGATE :
+            value.kind = INTEGER_KEY;
+            value.integer_value = state.count;
+            break;
+        case SUM_AGGREGATE :
+            value.kind = column_kind == INTEGER_KEY ? INTEGER_KEY : REAL_KEY;
+            value.integer_value = state.integer_sum;
+            value.real_value = state.real_sum;
+            break;
+        case AVG_AGGREGATE :
+            value.kind = REAL_KEY;
+            value.real_value = (column_kind == INTEGER_KEY ? (double) state.integer_sum : state.real_sum) / state.count;
+            break;
+        default :
+            value = state.extreme;
+            break;
+    }
+    return value;
+}
+
+string getAggregateFunctionName(AggregateFunction function) {
+    const char * names[] = {"COUNT", "SUM", "MIN", "MAX", "AVG"};
+    return names[function];
+}
+
+#endif //AGGREGATESTATE_H
@@ -0,0 +1,599 @@
+#ifndef AGGREGATION_H
+#define AGGREGATION_H
+
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <stdio.h>
+
+#include "util.h"
+#include "schema.h"
+#include "queryable.h"
+#include "scanner.h"
+#include "typedkey.h"
+#include "parallelsort.h"
+#include "aggregatestate.h"
+#include "join.h"
+
+struct AggregationOptions {
+    // Bytes of groups held in memory, across threads, before spilling
+    long long memory_budget;
+    // Threads reading the input, 0 for one per core
+    unsigned threads;
+
+    AggregationOptions() : memory_budget(64LL << 20), threads(0) {}
+};
+
+/**
+ * Hash group by over the rows of a table or of a join output.
+ *
+ *     Aggregation jobs(&worked_table);
+ *     jobs.groupBy("person_id");
+ *     jobs.aggregate(COUNT_AGGREGATE);
+ *     jobs.aggregate(MIN_AGGREGATE, "company_id");
+ *     jobs.print(20);
+ *
+ * The input is split between threads, each aggregating its share into a
+ * hash table of its own, and the partial aggregates are merged at the end.
+ * A thread whose groups outgrow its share of the memory budget writes them
+ * to partition files, and the partitions are then merged one at a time.
+ */
+class Aggregation {
+private:
+    typedef unordered_map<GroupKey, vector<AggregateState>, GroupKeyHash> group_table_t;
+
+    struct ColumnReference {
+        int table;
+        int column_position;
+        KeyKind key_kind;
+        string name;
+    };
+
+    struct Aggregate {
+        AggregateFunction function;
+        // Column index in columns, -1 for COUNT(*)
+        int column;
+    };
+
+    struct Partial {
+        group_table_t groups;
+        long long bytes;
+        long long rows;
+        bool spilled;
+        int spills;
+        vector<string> spill_paths;
+    };
+
+    vector<Queryable*> tables;
+    Join * join;
+    AggregationOptions options;
+
+    // Group by columns first, then the aggregated ones
+    vector<ColumnReference> columns;
+    int number_of_group_columns;
+    vector<Aggregate> aggregates;
+
+    vector<Partial> partials;
+    // Scanners of each thread over each table, for join input
+    vector<vector<Scanner*> > scans;
+    int spill_id;
+    long long input_rows;
+    int number_of_spills;
+
+    // Output
+    group_table_t * groups;
+    group_table_t::iterator current;
+    bool started;
+    bool spilled;
+    int partition;
+
+    int addColumn(Queryable * table, string column_name);
+    unsigned getThreads(long long rows);
+
+    void update(Partial & partial, vector<TypedKey> & values, GroupKey & key);
+    void merge(group_table_t & groups, GroupKey & key, vector<AggregateState> & states);
+    void spill(Partial & partial, int thread);
+
+    void aggregateTable(unsigned thread, unsigned threads);
+    void aggregateJoin(JoinBatch & window, unsigned thread, unsigned threads);
+
+    bool loadPartition();
+
+public:
+    static const int SPILL_PARTITIONS = 16;
+    // Pairs of join output aggregated at once, held besides the groups
+    static const size_t JOIN_WINDOW = 1 << 16;
+    static const long long JOIN_WINDOW_BYTES = JOIN_WINDOW * 2 * sizeof(long long);
+
+    /**
+     * @constructor
+     */
+    Aggregation(Queryable * table, AggregationOptions options = AggregationOptions());
+
+    /**
+     * Aggregates the rows of the join output: columns of either table.
+     */
+    Aggregation(Join * join, AggregationOptions options = AggregationOptions());
+
+    /**
+     * @destructor
+     */
+    ~Aggregation();
+
+    void groupBy(string column_name);
+    void groupBy(Queryable * table, string column_name);
+
+    /**
+     * @param column_name may be empty for COUNT, to count rows
+     */
+    void aggregate(AggregateFunction function, string column_name = "");
+    void aggregate(AggregateFunction function, Queryable * table, string column_name);
+
+    /**
+     * Reads the whole input and aggregates it.
+     */
+    void open();
+
+    /**
+     * Moves to the next group.
+     * @return false when there are no more groups
+     */
+    bool next();
+
+    void close();
+
+    TypedKey getGroupValue(int group_column);
+
+    /**
+     * COUNT is an INTEGER_KEY, AVG a REAL_KEY, SUM of the kind of its
+     * column (REAL_KEY for strings), MIN and MAX of the kind of their column.
+     */
+    TypedKey getAggregateValue(int aggregate);
+
+    vector<string> getColumnNames();
+    vector<string> getRow();
+
+    long long getNumberOfInputRows();
+    int getNumberOfSpills();
+
+    void print(int number_of_values = -1);
+};
+
+Aggregation::Aggregation(Queryable * table, AggregationOptions options) {
+    this->tables.push_back(table);
+    this->join = NULL;
+    this->options = options;
+    this->number_of_group_columns = 0;
+    this->groups = NULL;
+    this->partition = -1;
+    this->input_rows = 0;
+    this->number_of_spills = 0;
+}
+
+Aggregation::Aggregation(Join * join, AggregationOptions options) {
+    this->tables = join->getTables();
+    this->join = join;
+    this->options = options;
+    this->number_of_group_columns = 0;
+    this->groups = NULL;
+    this->partition = -1;
+    this->input_rows = 0;
+    this->number_of_spills = 0;
+}
+
+Aggregation::~Aggregation() {
+    close();
+}
+
+int Aggregation::addColumn(Queryable * table, string column_name) {
+    ColumnReference column;
+    column.table = find(tables.begin(), tables.end(), table) - tables.begin();
+    column.column_position = table->getSchema().getColPosition(column_name);
+    column.key_kind = getKeyKind(table->getSchema().getCols()->at(column.column_position).type);
+    column.name = column_name;
+    if (tables.size() > 1) {
+        column.name = table->getName() + "." + column_name;
+    }
+    columns.push_back(column);
+    return columns.size() - 1;
+}
+
+void Aggregation::groupBy(string column_name) {
+    groupBy(tables[0], column_name);
+}
+
+void Aggregation::groupBy(Queryable * table, string column_name) {
+    // Group columns stay in front of the aggregated ones
+    int column = addColumn(table, column_name);
+    ColumnReference reference = columns[column];
+    columns.pop_back();
+    columns.insert(columns.begin() + number_of_group_columns, reference);
+    number_of_group_columns++;
+    for (size_t a = 0; a < aggregates.size(); a++) {
+        if (aggregates[a].column >= 0) aggregates[a].column++;
+    }
+}
+
+void Aggregation::aggregate(AggregateFunction function, string column_name) {
+    if (column_name.empty()) {
+        Aggregate aggregate;
+        aggregate.function = function;
+        aggregate.column = -1;
+        aggregates.push_back(aggregate);
+        return;
+    }
+    aggregate(function, tables[0], column_name);
+}
+
+void Aggregation::aggregate(AggregateFunction function, Queryable * table, string column_name) {
+    Aggregate aggregate;
+    aggregate.function = function;
+    aggregate.column = addColumn(table, column_name);
+    aggregates.push_back(aggregate);
+}
+
+unsigned Aggregation::getThreads(long long rows) {
+    unsigned threads = options.threads == 0 ? getDefaultSortThreads() : options.threads;
+    // A thread gets at least PARALLEL_SORT_MIN_SIZE rows, as when sorting
+    return max(1LL, min((long long) threads, rows / (long long) PARALLEL_SORT_MIN_SIZE));
+}
+
+void Aggregation::update(Partial & partial, vector<TypedKey> & values, GroupKey & key) {
+    key.values.assign(values.begin(), values.begin() + number_of_group_columns);
+
+    group_table_t::iterator group = partial.groups.find(key);
+    if (group == partial.groups.end()) {
+        group = partial.groups.insert(make_pair(key, vector<AggregateState>(aggregates.size()))).first;
+        long long bytes = sizeof(GroupKey) + HASH_NODE_BYTES + aggregates.size() * sizeof(AggregateState);
+        for (int i = 0; i < number_of_group_columns; i++) {
+            bytes += sizeof(TypedKey) + values[i].string_value.capacity();
+        }
+        partial.bytes += bytes;
+    }
+    partial.rows++;
+
+    vector<AggregateState> & states = group->second;
+    for (size_t a = 0; a < aggregates.size(); a++) {
+        int column = aggregates[a].column;
+        updateAggregateState(states[a], aggregates[a].function, column < 0 ? NULL : &values[column]);
+    }
+}
+
+void Aggregation::merge(group_table_t & groups, GroupKey & key, vector<AggregateState> & states) {
+    pair<group_table_t::iterator, bool> inserted = groups.insert(make_pair(key, states));
+    if (inserted.second) return;
+
+    vector<AggregateState> & merged = inserted.first->second;
+    for (size_t a = 0; a < aggregates.size(); a++) {
+        AggregateState & state = merged[a];
+        AggregateState & other = states[a];
+        if (other.count == 0) continue;
+        if (state.count == 0) {
+            state = other;
+            continue;
+        }
+        if (aggregates[a].function == MIN_AGGREGATE && other.extreme < state.extreme) state.extreme = other.extreme;
+        if (aggregates[a].function == MAX_AGGREGATE && state.extreme < other.extreme) state.extreme = other.extreme;
+        state.count += other.count;
+        state.integer_sum += other.integer_sum;
+        state.real_sum += other.real_sum;
+    }
+}
+
+void Aggregation::spill(Partial & partial, int thread) {
+    if (partial.spill_paths.empty()) {
+        for (int p = 0; p < SPILL_PARTITIONS; p++) {
+            ostringstream path;
+            path << "aggregation_" << spill_id << "_" << thread << "_" << p << ".tmp";
+            partial.spill_paths.push_back(path.str());
+            ofstream truncate(path.str().c_str(), ios::binary | ios::trunc);
+        }
+    }
+
+    vector<ofstream*> files;
+    for (int p = 0; p < SPILL_PARTITIONS; p++) {
+        files.push_back(new ofstream(partial.spill_paths[p].c_str(), ios::binary | ios::app));
+    }
+
+    GroupKeyHash hash;
+    for (group_table_t::iterator group = partial.groups.begin(); group != partial.groups.end(); group++) {
+        // High bits, the hash table uses the low ones
+        ostream & out = *files[(hash(group->first) >> 7) % SPILL_PARTITIONS];
+        for (int i = 0; i < number_of_group_columns; i++) {
+            writeTypedKey(out, group->first.values[i]);
+        }
+        for (size_t a = 0; a < aggregates.size(); a++) {
+            AggregateState & state = group->second[a];
+            out.write(reinterpret_cast<const char *> (&state.count), sizeof(state.count));
+            out.write(reinterpret_cast<const char *> (&state.integer_sum), sizeof(state.integer_sum));
+            out.write(reinterpret_cast<const char *> (&state.real_sum), sizeof(state.real_sum));
+            writeTypedKey(out, state.extreme);
+        }
+    }
+
+    for (int p = 0; p < SPILL_PARTITIONS; p++) {
+        delete files[p];
+    }
+    group_table_t().swap(partial.groups);
+    partial.bytes = 0;
+    partial.spilled = true;
+    partial.spills++;
+}
+
+void Aggregation::aggregateTable(unsigned thread, unsigned threads) {
+    Partial & partial = partials[thread];
+    long long rows = tables[0]->getHeader()->size();
+    long long first = rows * thread / threads;
+    long long last = rows * (thread + 1) / threads;
+    long long budget = options.memory_budget / threads;
+
+    vector<TypedKey> values(columns.size());
+    GroupKey key;
+    Scanner * scan = tables[0]->scan();
+    scan->seek(first);
+    while (scan->next() && scan->getIndex() < last) {
+        for (size_t c = 0; c < columns.size(); c++) {
+            values[c] = readTypedKey(scan, columns[c].column_position, columns[c].key_kind);
+        }
+        update(partial, values, key);
+        if (partial.bytes > budget) {
+            spill(partial, thread);
+        }
+    }
+    delete scan;
+}
+
+void Aggregation::aggregateJoin(JoinBatch & window, unsigned thread, unsigned threads) {
+    Partial & partial = partials[thread];
+    size_t first = window.size() * thread / threads;
+    size_t last = window.size() * (thread + 1) / threads;
+    long long budget = max(0LL, options.memory_budget - JOIN_WINDOW_BYTES) / threads;
+    vector<vector<long long> *> window_positions;
+    window_positions.push_back(&window.this_positions);
+    window_positions.push_back(&window.other_positions);
+
+    // As in LateMaterializer: each table's rows of the window are read
+    // once, in file order, and only the columns used are decoded
+    vector<vector<long long> > positions(tables.size());
+    vector<vector<TypedKey> > decoded(tables.size());
+    for (size_t t = 0; t < tables.size(); t++) {
+        positions[t].assign(window_positions[t]->begin() + first, window_positions[t]->begin() + last);
+        sort(positions[t].begin(), positions[t].end());
+        positions[t].erase(unique(positions[t].begin(), positions[t].end()), positions[t].end());
+
+        Scanner * scan = scans[thread][t];
+        for (size_t p = 0; p < positions[t].size(); p++) {
+            scan->fetch(positions[t][p]);
+            for (size_t c = 0; c < columns.size(); c++) {
+                if ((size_t) columns[c].table != t) continue;
+                decoded[t].push_back(readTypedKey(scan, columns[c].column_position, columns[c].key_kind));
+            }
+        }
+    }
+
+    vector<int> columns_per_table(tables.size(), 0);
+    for (size_t c = 0; c < columns.size(); c++) {
+        columns_per_table[columns[c].table]++;
+    }
+
+    vector<TypedKey> values(columns.size());
+    GroupKey key;
+    for (size_t i = first; i < last; i++) {
+        vector<int> next_column(tables.size(), 0);
+        vector<size_t> row(tables.size());
+        for (size_t t = 0; t < tables.size(); t++) {
+            row[t] = lower_bound(positions[t].begin(), positions[t].end(), window_positions[t]->at(i)) - positions[t].begin();
+        }
+        for (size_t c = 0; c < columns.size(); c++) {
+            int t = columns[c].table;
+            values[c] = decoded[t][row[t] * columns_per_table[t] + next_column[t]++];
+        }
+        update(partial, values, key);
+        if (partial.bytes > budget) {
+            spill(partial, thread);
+        }
+    }
+}
+
+void Aggregation::open() {
+    close();
+
+    spill_id = nextSpillId();
+
+    // The join output is not counted up front, its biggest table stands in
+    long long rows = 0;
+    for (size_t t = 0; t < tables.size(); t++) {
+        rows = max(rows, (long long) tables[t]->getHeader()->size());
+    }
+
+    unsigned threads = getThreads(rows);
+    partials.assign(threads, Partial());
+    for (unsigned t = 0; t < threads; t++) {
+        partials[t].bytes = 0;
+        partials[t].rows = 0;
+        partials[t].spilled = false;
+        partials[t].spills = 0;
+    }
+
+    if (join == NULL) {
+        runParallel(threads, [&](unsigned thread) {
+            aggregateTable(thread, threads);
+        });
+    } else {
+        // The pairs are aggregated a window at a time as the join yields them
+        scans.assign(threads, vector<Scanner*>());
+        for (unsigned thread = 0; thread < threads; thread++) {
+            for (size_t t = 0; t < tables.size(); t++) {
+                scans[thread].push_back(tables[t]->scan());
+            }
+        }
+        JoinBatch window(JOIN_WINDOW);
+        join->open();
+        while (join->next(window)) {
+            runParallel(threads, [&](unsigned thread) {
+                aggregateJoin(window, thread, threads);
+            });
+        }
+        join->close();
+        for (unsigned thread = 0; thread < threads; thread++) {
+            for (size_t t = 0; t < tables.size(); t++) {
+                delete scans[thread][t];
+            }
+        }
+        scans.clear();
+    }
+
+    input_rows = 0;
+    spilled = false;
+    for (unsigned t = 0; t < threads; t++) {
+        input_rows += partials[t].rows;
+        spilled = spilled || partials[t].spilled;
+    }
+
+    groups = new group_table_t();
+    started = false;
+    partition = -1;
+    if (spilled) {
+        // Everything goes to the partitions, merged one at a time by next
+        for (unsigned t = 0; t < threads; t++) {
+            if (!partials[t].groups.empty()) {
+                spill(partials[t], t);
+            }
+            number_of_spills += partials[t].spills;
+        }
+        return;
+    }
+
+    groups->swap(partials[0].groups);
+    for (unsigned t = 1; t < threads; t++) {
+        for (group_table_t::iterator group = partials[t].groups.begin(); group != partials[t].groups.end(); group++) {
+            GroupKey key = group->first;
+            merge(*groups, key, group->second);
+        }
+        group_table_t().swap(partials[t].groups);
+    }
+}
+
+bool Aggregation::loadPartition() {
+    groups->clear();
+    partition++;
+    if (partition >= SPILL_PARTITIONS) {
+        return false;
+    }
+
+    for (size_t t = 0; t < partials.size(); t++) {
+        if (partials[t].spill_paths.empty()) continue;
+
+        ifstream in(partials[t].spill_paths[partition].c_str(), ios::binary);
+        GroupKey key;
+        key.values.resize(number_of_group_columns);
+        vector<AggregateState> states(aggregates.size());
+        while (true) {
+            bool read = true;
+            for (int i = 0; i < number_of_group_columns && read; i++) {
+                read = readTypedKey(in, key.values[i]);
+            }
+            for (size_t a = 0; a < aggregates.size() && read; a++) {
+                AggregateState & state = states[a];
+                read = in.read(reinterpret_cast<char *> (&state.count), sizeof(state.count)) &&
+                       in.read(reinterpret_cast<char *> (&state.integer_sum), sizeof(state.integer_sum)) &&
+                       in.read(reinterpret_cast<char *> (&state.real_sum), sizeof(state.real_sum)) &&
+                       readTypedKey(in, state.extreme);
+            }
+            if (!read) break;
+            merge(*groups, key, states);
+        }
+        in.close();
+        remove(partials[t].spill_paths[partition].c_str());
+    }
+    return true;
+}
+
+bool Aggregation::next() {
+    if (groups == NULL) {
+        return false;
+    }
+    if (!started) {
+        started = true;
+        current = groups->begin();
+    } else if (current != groups->end()) {
+        current++;
+    }
+    while (current == groups->end()) {
+        if (!spilled || !loadPartition()) {
+            return false;
+        }
+        current = groups->begin();
+    }
+    return true;
+}
+
+void Aggregation::close() {
+    delete groups;
+    groups = NULL;
+    for (size_t t = 0; t < partials.size(); t++) {
+        for (size_t p = partition + 1; p < partials[t].spill_paths.size(); p++) {
+            remove(partials[t].spill_paths[p].c_str());
+        }
+    }
+    partials.clear();
+    partition = -1;
+    number_of_spills = 0;
+}
+
+TypedKey Aggregation::getGroupValue(int group_column) {
+    return current->first.values[group_column];
+}
+
+TypedKey Aggregation::getAggregateValue(int aggregate) {
+    Aggregate & definition = aggregates[aggregate];
+    KeyKind column_kind = definition.column < 0 ? INTEGER_KEY : columns[definition.column].key_kind;
+    return getAggregateResult(current->second[aggregate], definition.function, column_kind);
+}
+
+vector<string> Aggregation::getColumnNames() {
+    vector<string> column_names;
+    for (int i = 0; i < number_of_group_columns; i++) {
+        column_names.push_back(columns[i].name);
+    }
+    for (size_t a = 0; a < aggregates.size(); a++) {
+        string column = aggregates[a].column < 0 ? "*" : columns[aggregates[a].column].name;
+        column_names.push_back(getAggregateFunctionName(aggregates[a].function) + "(" + column + ")");
+    }
+    return column_names;
+}
+
+vector<string> Aggregation::getRow() {
+    vector<string> row;
+    for (int i = 0; i < number_of_group_columns; i++) {
+        row.push_back(toString(getGroupValue(i)));
+    }
+    for (size_t a = 0; a < aggregates.size(); a++) {
+        row.push_back(toString(getAggregateValue(a)));
+    }
+    return row;
+}
+
+long long Aggregation::getNumberOfInputRows() {
+    return input_rows;
+}
+
+int Aggregation::getNumberOfSpills() {
+    return number_of_spills;
+}
+
+void Aggregation::print(int number_of_values) {
+    open();
+    vector<string> column_names = getColumnNames();
+    ::print(&column_names);
+
+    int line = 0;
+    while (line != number_of_values && next()) {
+        vector<string> row = getRow();
+        ::print(&row);
+        line++;
+    }
+    close();
+}
+
+#endif //AGGREGATION_H
@@ -0,0 +1,148 @@
+#ifndef AGGREGATIONBENCHMARK_H
+#define AGGREGATIONBENCHMARK_H
+
+#include "aggregation.h"
+#include "timer.h"
+
+class AggregationBenchmark {
+
+public:
+
+    Queryable * person_table;
+    Queryable * worked_table;
+
+    AggregationBenchmark(Queryable * person_table, Queryable * worked_table);
+
+    void runBenchmark();
+
+private:
+
+    vector<unsigned> getThreadCounts();
+
+    /**
+     * Runs the aggregation to the end and prints its throughput.
+     */
+    void run(string name, Aggregation & aggregation);
+
+    void jobsPerPerson();
+    void employeesPerCompany();
+    void jobsPerFirstName();
+    void spilledJobsPerPerson();
+};
+
+AggregationBenchmark::AggregationBenchmark(Queryable * person_table, Queryable * worked_table) {
+    this->person_table = person_table;
+    this->worked_table = worked_table;
+}
+
+void AggregationBenchmark::runBenchmark() {
+    jobsPerPerson();
+    employeesPerCompany();
+    jobsPerFirstName();
+    spilledJobsPerPerson();
+}
+
+vector<unsigned> AggregationBenchmark::getThreadCounts() {
+    vector<unsigned> thread_counts;
+    for (unsigned threads = 1; threads <= getDefaultSortThreads(); threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    return thread_counts;
+}
+
+void AggregationBenchmark::run(string name, Aggregation & aggregation) {
+    Timer timer;
+    timer.start();
+    aggregation.open();
+    long long groups = 0;
+    while (aggregation.next()) {
+        groups++;
+    }
+    double time = timer.getElapsedTime();
+    long long rows = aggregation.getNumberOfInputRows();
+
+    cout << "\t" << name << ": " << time << " s, " << rows << " rows, " << groups << " groups, "
+         << (long long) (rows / time) << " rows/s";
+    if (aggregation.getNumberOfSpills() > 0) {
+        cout << ", " << aggregation.getNumberOfSpills() << " spills";
+    }
+    cout << endl;
+    aggregation.close();
+}
+
+void AggregationBenchmark::jobsPerPerson() {
+    cout << "\nJobs per person" << endl;
+
+    vector<unsigned> thread_counts = getThreadCounts();
+    for (size_t i = 0; i < thread_counts.size(); i++) {
+        AggregationOptions options;
+        options.threads = thread_counts[i];
+
+        Aggregation aggregation(worked_table, options);
+        aggregation.groupBy("person_id");
+        aggregation.aggregate(COUNT_AGGREGATE);
+        aggregation.aggregate(MIN_AGGREGATE, "company_id");
+        aggregation.aggregate(MAX_AGGREGATE, "company_id");
+
+        ostringstream name;
+        name << thread_counts[i] << " thread(s)";
+        run(name.str(), aggregation);
+    }
+}
+
+void AggregationBenchmark::employeesPerCompany() {
+    cout << "\nEmployees per company" << endl;
+
+    vector<unsigned> thread_counts = getThreadCounts();
+    for (size_t i = 0; i < thread_counts.size(); i++) {
+        AggregationOptions options;
+        options.threads = thread_counts[i];
+
+        Aggregation aggregation(worked_table, options);
+        aggregation.groupBy("company_id");
+        aggregation.aggregate(COUNT_AGGREGATE);
+
+        ostringstream name;
+        name << thread_counts[i] << " thread(s)";
+        run(name.str(), aggregation);
+    }
+}
+
+void AggregationBenchmark::jobsPerFirstName() {
+    cout << "\nJobs per first name, over Person x Worked" << endl;
+
+    vector<unsigned> thread_counts = getThreadCounts();
+    for (size_t i = 0; i < thread_counts.size(); i++) {
+        AggregationOptions options;
+        options.threads = thread_counts[i];
+
+        Join join(person_table, "_id", worked_table, "person_id", AUTO);
+        Aggregation aggregation(&join, options);
+        aggregation.groupBy(person_table, "nome");
+        aggregation.aggregate(COUNT_AGGREGATE);
+        aggregation.aggregate(AVG_AGGREGATE, worked_table, "company_id");
+
+        ostringstream name;
+        name << thread_counts[i] << " thread(s)";
+        run(name.str(), aggregation);
+    }
+}
+
+void AggregationBenchmark::spilledJobsPerPerson() {
+    cout << "\nJobs per person, spilling to disk" << endl;
+
+    AggregationOptions options;
+    options.memory_budget = 16 << 10;
+
+    Aggregation aggregation(worked_table, options);
+    aggregation.groupBy("person_id");
+    aggregation.aggregate(COUNT_AGGREGATE);
+    aggregation.aggregate(MIN_AGGREGATE, "company_id");
+    aggregation.aggregate(MAX_AGGREGATE, "company_id");
+
+    ostringstream name;
+    name << options.memory_budget << " bytes of memory";
+    run(name.str(), aggregation);
+}
+
+#endif //AGGREGATIONBENCHMARK_H
@@ -0,0 +1,878 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <functional>
+#include <limits>
+
+#include "util.h"
+#include "schema.h"
+#include "queryable.h"
+#include "scanner.h"
+#include "typedkey.h"
+#include "bloomfilter.h"
+#include "operator.h"
+
+/**
+ * Rows per batch: enough to pay for a virtual call and a type switch per
+ * column, few enough for the arrays of a batch to stay in cache.
+ */
+const int BATCH_SIZE = 1024;
+
+/**
+ * The values of one column for the rows of a batch, in the array of its
+ * kind; the other two arrays are empty.
+ */
+struct ColumnVector {
+    KeyKind kind;
+    vector<long long> integers;
+    vector<double> reals;
+    vector<string> strings;
+
+    ColumnVector(KeyKind kind = INTEGER_KEY);
+
+    void resize(int size);
+
+    TypedKey get(int row) const;
+
+    void read(int row, Scanner * scan, int column_position);
+
+    /**
+     * Sets the first count rows to from's rows at rows.
+     */
+    void gather(const ColumnVector & from, const int * rows, int count);
+
+    /**
+     * Adds from's rows at rows after the last row.
+     */
+    void append(const ColumnVector & from, const int * rows, int count);
+};
+
+/**
+ * Columns of up to BATCH_SIZE rows. Filters do not move rows: they shrink
+ * the selection, the rows still alive, in increasing order.
+ */
+struct Batch {
+    vector<ColumnVector> columns;
+    int size;
+    vector<int> selection;
+    int selected;
+
+    Batch();
+
+    /**
+     * Sets up a column per operator column, with no rows.
+     */
+    void reset(const vector<OperatorColumn> & operator_columns);
+
+    void selectAll();
+};
+
+/**
+ * The array of T of the column.
+ */
+template <typename T>
+vector<T> & getValues(ColumnVector & column);
+
+/**
+ * @return the first size values of the column as key_kind, the column's
+ *         own array when it is of that kind, converted otherwise
+ */
+template <typename T>
+const T * getValues(ColumnVector & column, KeyKind key_kind, int size, vector<T> & converted);
+
+template <typename T>
+T getKeyValue(const TypedKey & key);
+
+/**
+ * Keeps in selection the rows whose value passes comparator value.
+ *
+ * @return the new number of selected rows
+ */
+template <typename T>
+int selectMatching(const T * values, int * selection, int selected, JoinComparator comparator, const T & value);
+
+/**
+ * Pull-based operator that exchanges batches instead of tuples: open, then
+ * next until it returns false, then close. An operator owns its children.
+ */
+class BatchOperator {
+protected:
+    vector<OperatorColumn> columns;
+    // Rows the planner expects the operator to output, -1 if unknown
+    double estimated_rows;
+
+public:
+    BatchOperator() : estimated_rows(-1) {}
+    virtual ~BatchOperator() {}
+
+    virtual void open() =0;
+
+    /**
+     * @return false when there are no more rows; a batch returned has at
+     *         least one selected row
+     */
+    virtual bool next(Batch & batch) =0;
+
+    virtual void close() =0;
+
+    vector<OperatorColumn> & getColumns();
+
+    int findColumn(string table, string name);
+
+    /**
+     * @return the operator and its arguments, in one line, for EXPLAIN
+     */
+    virtual string describe() =0;
+
+    virtual vector<BatchOperator*> getChildren();
+
+    /**
+     * Adds a line per operator of the tree, as Operator::explain.
+     */
+    void explain(vector<string> & lines, int depth = 0);
+
+    void setEstimatedRows(double estimated_rows);
+    double getEstimatedRows();
+};
+
+/**
+ * Reads the registries whose _id is in [min_id, max_id] into batches.
+ */
+class BatchScanOperator : public BatchOperator {
+private:
+    Queryable * table;
+    string alias;
+    vector<int> column_positions;
+    long long min_id;
+    long long max_id;
+    Scanner * scan;
+
+public:
+    BatchScanOperator(Queryable * table, string alias, vector<int> column_positions,
+                      long long min_id = numeric_limits<long long>::min(),
+                      long long max_id = numeric_limits<long long>::max());
+    ~BatchScanOperator();
+
+    void open();
+    bool next(Batch & batch);
+    void close();
+
+    string describe();
+};
+
+/**
+ * Narrows the selection of its child's batches to the rows that pass
+ * every predicate, one tight loop per predicate.
+ */
+class BatchFilterOperator : public BatchOperator {
+private:
+    BatchOperator * child;
+    vector<ColumnPredicate> predicates;
+
+    vector<long long> converted_integers;
+    vector<double> converted_reals;
+    vector<string> converted_strings;
+
+public:
+    /**
+     * @param predicates on column indexes of the child
+     */
+    BatchFilterOperator(BatchOperator * child, vector<ColumnPredicate> predicates);
+    ~BatchFilterOperator();
+
+    void open();
+    bool next(Batch & batch);
+    void close();
+
+    string describe();
+    vector<BatchOperator*> getChildren();
+};
+
+/**
+ * Chained hash table over the keys of the build rows, probed a batch at a
+ * time: the buckets of the whole batch are looked up first, then the
+ * chains are walked until the output is full, resuming there next time.
+ */
+template <typename T>
+class BatchHashTable {
+private:
+    vector<T> keys;
+    // First build row of each bucket, -1 if none
+    vector<int> buckets;
+    // Next build row of the same bucket, -1 at the end
+    vector<int> chain;
+    unsigned long long mask;
+
+    const T * probe_values;
+    const int * probe_selection;
+    int probe_selected;
+    vector<int> heads;
+    int position;
+    int match;
+
+public:
+    BatchHashTable();
+
+    void clear();
+
+    void insert(const T * values, const int * selection, int selected);
+
+    /**
+     * Builds the buckets, once every key is inserted.
+     */
+    void finish();
+
+    /**
+     * Starts probing the selected rows of values, which must stay valid
+     * until probe returns 0.
+     */
+    void lookup(const T * values, const int * selection, int selected);
+
+    /**
+     * @return the number of pairs of probe and build rows written, at most
+     *         capacity, 0 once the looked up rows are done
+     */
+    int probe(int * probe_rows, int * build_rows, int capacity);
+};
+
+/**
+ * Hash join of batches: build is read whole on open, then each probe batch
+ * gives batches of the probe columns followed by the build columns.
+ */
+class BatchHashJoinOperator : public BatchOperator {
+private:
+    BatchOperator * probe;
+    BatchOperator * build;
+    int probe_key;
+    int build_key;
+    KeyKind key_kind;
+
+    vector<ColumnVector> build_columns;
+    BatchHashTable<long long> integer_table;
+    BatchHashTable<double> real_table;
+    BatchHashTable<string> string_table;
+
+    Batch probe_batch;
+    vector<long long> converted_integers;
+    vector<double> converted_reals;
+    vector<string> converted_strings;
+    vector<int> probe_rows;
+    vector<int> build_rows;
+
+    void insert(Batch & batch);
+    void lookup();
+    int probeTable();
+
+public:
+    /**
+     * @param key_kind what both keys are compared as
+     */
+    BatchHashJoinOperator(BatchOperator * probe, BatchOperator * build, int probe_key, int build_key, KeyKind key_kind);
+    ~BatchHashJoinOperator();
+
+    void open();
+    bool next(Batch & batch);
+    void close();
+
+    string describe();
+    vector<BatchOperator*> getChildren();
+};
+
+/**
+ * Hands the selected rows of a batch pipeline to tuple operators.
+ */
+class BatchToTupleOperator : public Operator {
+private:
+    BatchOperator * child;
+    Batch batch;
+    int position;
+
+public:
+    BatchToTupleOperator(BatchOperator * child);
+    ~BatchToTupleOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+
+    /**
+     * Goes on into the batch operators under it.
+     */
+    void explain(vector<string> & lines, int depth = 0);
+};
+
+/*****************************************
+ ************ COLUMN VECTOR **************
+ *****************************************/
+
+ColumnVector::ColumnVector(KeyKind kind) {
+    this->kind = kind;
+}
+
+void ColumnVector::resize(int size) {
+    switch (kind) {
+        case INTEGER_KEY : integers.resize(size); break;
+        case REAL_KEY    : reals.resize(size); break;
+        case STRING_KEY  : strings.resize(size); break;
+    }
+}
+
+TypedKey ColumnVector::get(int row) const {
+    TypedKey key;
+    key.kind = kind;
+    switch (kind) {
+        case INTEGER_KEY : key.integer_value = integers[row]; break;
+        case REAL_KEY    : key.real_value = reals[row]; break;
+        case STRING_KEY  : key.string_value = strings[row]; break;
+    }
+    return key;
+}
+
+void ColumnVector::read(int row, Scanner * scan, int column_position) {
+    switch (kind) {
+        case INTEGER_KEY : integers[row] = scan->getInt(column_position); break;
+        case REAL_KEY    : reals[row] = scan->getDouble(column_position); break;
+        case STRING_KEY  : strings[row] = scan->getString(column_position); break;
+    }
+}
+
+void ColumnVector::gather(const ColumnVector & from, const int * rows, int count) {
+    resize(count);
+    switch (kind) {
+        case INTEGER_KEY :
+            for (int i = 0; i < count; i++) integers[i] = from.integers[rows[i]];
+            break;
+        case REAL_KEY :
+            for (int i = 0; i < count; i++) reals[i] = from.reals[rows[i]];
+            break;
+        case STRING_KEY :
+            for (int i = 0; i < count; i++) strings[i] = from.strings[rows[i]];
+            break;
+    }
+}
+
+void ColumnVector::append(const ColumnVector & from, const int * rows, int count) {
+    switch (kind) {
+        case INTEGER_KEY :
+            for (int i = 0; i < count; i++) integers.push_back(from.integers[rows[i]]);
+            break;
+        case REAL_KEY :
+            for (int i = 0; i < count; i++) reals.push_back(from.reals[rows[i]]);
+            break;
+        case STRING_KEY :
+            for (int i = 0; i < count; i++) strings.push_back(from.strings[rows[i]]);
+            break;
+    }
+}
+
+template <>
+vector<long long> & getValues<long long>(ColumnVector & column) {
+    return column.integers;
+}
+
+template <>
+vector<double> & getValues<double>(ColumnVector & column) {
+    return column.reals;
+}
+
+template <>
+vector<string> & getValues<string>(ColumnVector & column) {
+    return column.strings;
+}
+
+template <typename T>
+const T * getValues(ColumnVector & column, KeyKind key_kind, int size, vector<T> & converted) {
+    if (column.kind == key_kind) {
+        return getValues<T>(column).data();
+    }
+    converted.resize(size);
+    for (int row = 0; row < size; row++) {
+        converted[row] = getKeyValue<T>(convertKey(column.get(row), key_kind));
+    }
+    return converted.data();
+}
+
+template <>
+long long getKeyValue<long long>(const TypedKey & key) {
+    return key.integer_value;
+}
+
+template <>
+double getKeyValue<double>(const TypedKey & key) {
+    return key.real_value;
+}
+
+template <>
+string getKeyValue<string>(const TypedKey & key) {
+    return key.string_value;
+}
+
+/*****************************************
+ ***************** BATCH *****************
+ *****************************************/
+
+Batch::Batch() {
+    size = 0;
+    selected = 0;
+}
+
+void Batch::reset(const vector<OperatorColumn> & operator_columns) {
+    columns.resize(operator_columns.size());
+    for (size_t i = 0; i < operator_columns.size(); i++) {
+        if (columns[i].kind != operator_columns[i].key_kind) {
+            columns[i] = ColumnVector(operator_columns[i].key_kind);
+        }
+        columns[i].resize(BATCH_SIZE);
+    }
+    selection.resize(BATCH_SIZE);
+    size = 0;
+    selected = 0;
+}
+
+void Batch::selectAll() {
+    for (int row = 0; row < size; row++) {
+        selection[row] = row;
+    }
+    selected = size;
+}
+
+/**
+ * Branch free: every row is written, only the matching ones are kept.
+ */
+template <typename T, typename Compare>
+int selectMatching(const T * values, int * selection, int selected, const T & value, Compare compare) {
+    int kept = 0;
+    for (int i = 0; i < selected; i++) {
+        int row = selection[i];
+        selection[kept] = row;
+        kept += compare(values[row], value);
+    }
+    return kept;
+}
+
+template <typename T>
+int selectMatching(const T * values, int * selection, int selected, JoinComparator comparator, const T & value) {
+    switch (comparator) {
+        case EQUAL         : return selectMatching(values, selection, selected, value, equal_to<T>());
+        case NOT_EQUAL     : return selectMatching(values, selection, selected, value, not_equal_to<T>());
+        case LESS          : return selectMatching(values, selection, selected, value, less<T>());
+        case LESS_EQUAL    : return selectMatching(values, selection, selected, value, less_equal<T>());
+        case GREATER       : return selectMatching(values, selection, selected, value, greater<T>());
+        case GREATER_EQUAL : return selectMatching(values, selection, selected, value, greater_equal<T>());
+        default            : return 0;
+    }
+}
+
+vector<OperatorColumn> & BatchOperator::getColumns() {
+    return columns;
+}
+
+int BatchOperator::findColumn(string table, string name) {
+    return ::findColumn(columns, table, name);
+}
+
+vector<BatchOperator*> BatchOperator::getChildren() {
+    return vector<BatchOperator*>();
+}
+
+void BatchOperator::explain(vector<string> & lines, int depth) {
+    lines.push_back(getExplainLine(describe(), estimated_rows, depth));
+    vector<BatchOperator*> children = getChildren();
+    for (size_t i = 0; i < children.size(); i++) {
+        children[i]->explain(lines, depth + 1);
+    }
+}
+
+void BatchOperator::setEstimatedRows(double estimated_rows) {
+    this->estimated_rows = estimated_rows;
+}
+
+double BatchOperator::getEstimatedRows() {
+    return estimated_rows;
+}
+
+/*****************************************
+ ************** BATCH SCAN ***************
+ *****************************************/
+
+BatchScanOperator::BatchScanOperator(Queryable * table, string alias, vector<int> column_positions, long long min_id, long long max_id) {
+    this->table = table;
+    this->alias = alias;
+    this->column_positions = column_positions;
+    this->min_id = min_id;
+    this->max_id = max_id;
+    this->columns = getTableColumns(table, alias, column_positions);
+    this->scan = NULL;
+}
+
+BatchScanOperator::~BatchScanOperator() {
+    close();
+}
+
+void BatchScanOperator::open() {
+    close();
+    scan = table->scan();
+    if (min_id > numeric_limits<long long>::min()) {
+        header_t * header = table->getHeader();
+        header_t::iterator first = lower_bound(header->begin(), header->end(), make_pair(min_id, numeric_limits<long long>::min()));
+        scan->seek(first - header->begin());
+    }
+}
+
+bool BatchScanOperator::next(Batch & batch) {
+    batch.reset(columns);
+    if (scan == NULL) return false;
+    while (batch.size < BATCH_SIZE && scan->next()) {
+        if (scan->getId() > max_id) {
+            close();
+            break;
+        }
+        for (size_t i = 0; i < column_positions.size(); i++) {
+            batch.columns[i].read(batch.size, scan, column_positions[i]);
+        }
+        batch.size++;
+    }
+    batch.selectAll();
+    return batch.size > 0;
+}
+
+void BatchScanOperator::close() {
+    delete scan;
+    scan = NULL;
+}
+
+string BatchScanOperator::describe() {
+    string description = "BatchScan " + describeTable(table, alias);
+    if (min_id > numeric_limits<long long>::min() || max_id < numeric_limits<long long>::max()) {
+        description += " ON " + describeIdRange(min_id, max_id);
+    }
+    return description;
+}
+
+/*****************************************
+ ************* BATCH FILTER **************
+ *****************************************/
+
+BatchFilterOperator::BatchFilterOperator(BatchOperator * child, vector<ColumnPredicate> predicates) {
+    this->child = child;
+    this->predicates = predicates;
+    this->columns = child->getColumns();
+}
+
+BatchFilterOperator::~BatchFilterOperator() {
+    delete child;
+}
+
+void BatchFilterOperator::open() {
+    child->open();
+}
+
+bool BatchFilterOperator::next(Batch & batch) {
+    while (child->next(batch)) {
+        for (size_t i = 0; i < predicates.size() && batch.selected > 0; i++) {
+            ColumnPredicate & predicate = predicates[i];
+            ColumnVector & column = batch.columns[predicate.column];
+            int * selection = batch.selection.data();
+
+            switch (predicate.value.kind) {
+                case INTEGER_KEY :
+                    batch.selected = selectMatching(getValues(column, INTEGER_KEY, batch.size, converted_integers), selection,
+                                                    batch.selected, predicate.comparator, predicate.value.integer_value);
+                    break;
+                case REAL_KEY :
+                    batch.selected = selectMatching(getValues(column, REAL_KEY, batch.size, converted_reals), selection,
+                                                    batch.selected, predicate.comparator, predicate.value.real_value);
+                    break;
+                case STRING_KEY :
+                    batch.selected = selectMatching(getValues(column, STRING_KEY, batch.size, converted_strings), selection,
+                                                    batch.selected, predicate.comparator, predicate.value.string_value);
+                    break;
+            }
+        }
+        if (batch.selected > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BatchFilterOperator::close() {
+    child->close();
+}
+
+string BatchFilterOperator::describe() {
+    string description = "BatchFilter";
+    for (size_t i = 0; i < predicates.size(); i++) {
+        description += (i == 0 ? " " : " AND ") + describePredicate(describeColumn(columns[predicates[i].column]), predicates[i]);
+    }
+    return description;
+}
+
+vector<BatchOperator*> BatchFilterOperator::getChildren() {
+    return vector<BatchOperator*>(1, child);
+}
+
+/*****************************************
+ ********** BATCH HASH TABLE *************
+ *****************************************/
+
+template <typename T>
+BatchHashTable<T>::BatchHashTable() {
+    clear();
+}
+
+template <typename T>
+void BatchHashTable<T>::clear() {
+    vector<T>().swap(keys);
+    vector<int>().swap(buckets);
+    vector<int>().swap(chain);
+    mask = 0;
+    probe_values = NULL;
+    probe_selection = NULL;
+    probe_selected = 0;
+    position = 0;
+    match = -1;
+}
+
+template <typename T>
+void BatchHashTable<T>::insert(const T * values, const int * selection, int selected) {
+    for (int i = 0; i < selected; i++) {
+        keys.push_back(values[selection[i]]);
+    }
+}
+
+template <typename T>
+void BatchHashTable<T>::finish() {
+    // Power of two with at least two buckets per key, for a short chain
+    unsigned long long number_of_buckets = 2;
+    while (number_of_buckets < 2 * keys.size()) {
+        number_of_buckets *= 2;
+    }
+    mask = number_of_buckets - 1;
+    buckets.assign(number_of_buckets, -1);
+    chain.resize(keys.size());
+
+    // Inserted backwards, so each chain is in build order
+    for (int row = (int) keys.size() - 1; row >= 0; row--) {
+        unsigned long long bucket = hashKey(keys[row]) & mask;
+        chain[row] = buckets[bucket];
+        buckets[bucket] = row;
+    }
+}
+
+template <typename T>
+void BatchHashTable<T>::lookup(const T * values, const int * selection, int selected) {
+    probe_values = values;
+    probe_selection = selection;
+    probe_selected = selected;
+    heads.resize(selected);
+    for (int i = 0; i < selected; i++) {
+        heads[i] = buckets[hashKey(values[selection[i]]) & mask];
+    }
+    position = 0;
+    match = selected > 0 ? heads[0] : -1;
+}
+
+template <typename T>
+int BatchHashTable<T>::probe(int * probe_rows, int * build_rows, int capacity) {
+    int produced = 0;
+    while (position < probe_selected) {
+        int row = probe_selection[position];
+        for (; match >= 0; match = chain[match]) {
+            if (produced == capacity) {
+                return produced;
+            }
+            if (keys[match] == probe_values[row]) {
+                probe_rows[produced] = row;
+                build_rows[produced] = match;
+                produced++;
+            }
+        }
+        position++;
+        if (position < probe_selected) {
+            match = heads[position];
+        }
+    }
+    return produced;
+}
+
+/*****************************************
+ ************ BATCH HASH JOIN ************
+ *****************************************/
+
+BatchHashJoinOperator::BatchHashJoinOperator(BatchOperator * probe, BatchOperator * build, int probe_key, int build_key, KeyKind key_kind) {
+    this->probe = probe;
+    this->build = build;
+    this->probe_key = probe_key;
+    this->build_key = build_key;
+    this->key_kind = key_kind;
+
+    columns = probe->getColumns();
+    columns.insert(columns.end(), build->getColumns().begin(), build->getColumns().end());
+    probe_rows.resize(BATCH_SIZE);
+    build_rows.resize(BATCH_SIZE);
+}
+
+BatchHashJoinOperator::~BatchHashJoinOperator() {
+    delete probe;
+    delete build;
+}
+
+void BatchHashJoinOperator::insert(Batch & batch) {
+    for (size_t i = 0; i < build_columns.size(); i++) {
+        build_columns[i].append(batch.columns[i], batch.selection.data(), batch.selected);
+    }
+
+    ColumnVector & keys = batch.columns[build_key];
+    switch (key_kind) {
+        case INTEGER_KEY :
+            integer_table.insert(getValues(keys, key_kind, batch.size, converted_integers), batch.selection.data(), batch.selected);
+            break;
+        case REAL_KEY :
+            real_table.insert(getValues(keys, key_kind, batch.size, converted_reals), batch.selection.data(), batch.selected);
+            break;
+        case STRING_KEY :
+            string_table.insert(getValues(keys, key_kind, batch.size, converted_strings), batch.selection.data(), batch.selected);
+            break;
+    }
+}
+
+void BatchHashJoinOperator::lookup() {
+    ColumnVector & keys = probe_batch.columns[probe_key];
+    const int * selection = probe_batch.selection.data();
+    switch (key_kind) {
+        case INTEGER_KEY :
+            integer_table.lookup(getValues(keys, key_kind, probe_batch.size, converted_integers), selection, probe_batch.selected);
+            break;
+        case REAL_KEY :
+            real_table.lookup(getValues(keys, key_kind, probe_batch.size, converted_reals), selection, probe_batch.selected);
+            break;
+        case STRING_KEY :
+            string_table.lookup(getValues(keys, key_kind, probe_batch.size, converted_strings), selection, probe_batch.selected);
+            break;
+    }
+}
+
+int BatchHashJoinOperator::probeTable() {
+    switch (key_kind) {
+        case INTEGER_KEY : return integer_table.probe(probe_rows.data(), build_rows.data(), BATCH_SIZE);
+        case REAL_KEY    : return real_table.probe(probe_rows.data(), build_rows.data(), BATCH_SIZE);
+        default          : return string_table.probe(probe_rows.data(), build_rows.data(), BATCH_SIZE);
+    }
+}
+
+void BatchHashJoinOperator::open() {
+    close();
+    vector<OperatorColumn> & build_operator_columns = build->getColumns();
+    for (size_t i = 0; i < build_operator_columns.size(); i++) {
+        build_columns.push_back(ColumnVector(build_operator_columns[i].key_kind));
+    }
+
+    Batch batch;
+    build->open();
+    while (build->next(batch)) {
+        insert(batch);
+    }
+    build->close();
+
+    switch (key_kind) {
+        case INTEGER_KEY : integer_table.finish(); break;
+        case REAL_KEY    : real_table.finish(); break;
+        case STRING_KEY  : string_table.finish(); break;
+    }
+    probe->open();
+}
+
+bool BatchHashJoinOperator::next(Batch & batch) {
+    batch.reset(columns);
+    int produced;
+    while ((produced = probeTable()) == 0) {
+        if (!probe->next(probe_batch)) {
+            return false;
+        }
+        lookup();
+    }
+
+    int number_of_probe_columns = probe_batch.columns.size();
+    for (int i = 0; i < number_of_probe_columns; i++) {
+        batch.columns[i].gather(probe_batch.columns[i], probe_rows.data(), produced);
+    }
+    for (size_t i = 0; i < build_columns.size(); i++) {
+        batch.columns[number_of_probe_columns + i].gather(build_columns[i], build_rows.data(), produced);
+    }
+    batch.size = produced;
+    batch.selectAll();
+    return true;
+}
+
+void BatchHashJoinOperator::close() {
+    probe->close();
+    vector<ColumnVector>().swap(build_columns);
+    integer_table.clear();
+    real_table.clear();
+    string_table.clear();
+}
+
+string BatchHashJoinOperator::describe() {
+    return "BatchHashJoin ON " + describeColumn(probe->getColumns()[probe_key]) + " = " + describeColumn(build->getColumns()[build_key]);
+}
+
+vector<BatchOperator*> BatchHashJoinOperator::getChildren() {
+    vector<BatchOperator*> children;
+    children.push_back(probe);
+    children.push_back(build);
+    return children;
+}
+
+/*****************************************
+ ************ BATCH TO TUPLE *************
+ *****************************************/
+
+BatchToTupleOperator::BatchToTupleOperator(BatchOperator * child) {
+    this->child = child;
+    this->columns = child->getColumns();
+    this->position = 0;
+}
+
+BatchToTupleOperator::~BatchToTupleOperator() {
+    delete child;
+}
+
+void BatchToTupleOperator::open() {
+    child->open();
+    batch.selected = 0;
+    position = 0;
+}
+
+bool BatchToTupleOperator::next(Tuple & tuple) {
+    while (position >= batch.selected) {
+        if (!child->next(batch)) {
+            batch.selected = 0;
+            return false;
+        }
+        position = 0;
+    }
+    int row = batch.selection[position++];
+    tuple.resize(batch.columns.size());
+    for (size_t i = 0; i < batch.columns.size(); i++) {
+        tuple[i] = batch.columns[i].get(row);
+    }
+    return true;
+}
+
+void BatchToTupleOperator::close() {
+    child->close();
+}
+
+string BatchToTupleOperator::describe() {
+    return "BatchToTuple";
+}
+
+void BatchToTupleOperator::explain(vector<string> & lines, int depth) {
+    lines.push_back(getExplainLine(describe(), estimated_rows, depth));
+    child->explain(lines, depth + 1);
+}
+
+#endif //BATCH_H
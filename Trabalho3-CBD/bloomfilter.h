@@ -0,0 +1,117 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <math.h>
+#include <string.h>
+#include <functional>
+
+#include "util.h"
+
+/**
+ * 64 bit mix (splitmix64 finalizer), so nearby keys spread over the bits.
+ */
+unsigned long long mixHash(unsigned long long value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+unsigned long long hashKey(long long key) {
+    return mixHash((unsigned long long) key);
+}
+
+unsigned long long hashKey(double key) {
+    if (key == 0) key = 0; // -0.0 == 0.0
+    unsigned long long bits;
+    memcpy(&bits, &key, sizeof(bits));
+    return mixHash(bits);
+}
+
+unsigned long long hashKey(const string & key) {
+    return mixHash(hash<string>()(key));
+}
+
+/**
+ * Set of key hashes that may answer "maybe present" for absent keys, but
+ * never "absent" for present ones.
+ */
+class BloomFilter {
+private:
+    vector<unsigned long long> bits;
+    unsigned long long bit_mask;
+    int number_of_hashes;
+    long long number_of_keys;
+
+public:
+    /**
+     * @constructor
+     * @param expected_keys number of keys that will be added
+     * @param false_positive_rate target rate of "maybe present" for absent keys
+     */
+    BloomFilter(long long expected_keys, double false_positive_rate = 0.01);
+
+    void add(unsigned long long key_hash);
+
+    bool mayContain(unsigned long long key_hash);
+
+    /**
+     * @return the false positive rate expected for the keys added so far
+     */
+    double getExpectedFalsePositiveRate();
+
+    long long getSizeInBytes();
+};
+
+BloomFilter::BloomFilter(long long expected_keys, double false_positive_rate) {
+    if (expected_keys < 1) expected_keys = 1;
+
+    // m = -n ln(p) / ln(2)^2, rounded up to a power of two
+    double wanted_bits = -expected_keys * log(false_positive_rate) / (log(2.0) * log(2.0));
+    unsigned long long number_of_bits = 64;
+    while (number_of_bits < wanted_bits) {
+        number_of_bits *= 2;
+    }
+
+    bits.resize(number_of_bits / 64);
+    bit_mask = number_of_bits - 1;
+    number_of_hashes = max(1, (int) round(number_of_bits / (double) expected_keys * log(2.0)));
+    number_of_hashes = min(number_of_hashes, 16);
+    number_of_keys = 0;
+}
+
+void BloomFilter::add(unsigned long long key_hash) {
+    // Double hashing: the i-th probe is h1 + i * h2
+    unsigned long long step = (key_hash >> 32) | 1;
+    for (int i = 0; i < number_of_hashes; i++) {
+        unsigned long long bit = key_hash & bit_mask;
+        bits[bit >> 6] |= 1ULL << (bit & 63);
+        key_hash += step;
+    }
+    number_of_keys++;
+}
+
+bool BloomFilter::mayContain(unsigned long long key_hash) {
+    unsigned long long step = (key_hash >> 32) | 1;
+    for (int i = 0; i < number_of_hashes; i++) {
+        unsigned long long bit = key_hash & bit_mask;
+        if ((bits[bit >> 6] & (1ULL << (bit & 63))) == 0) {
+            return false;
+        }
+        key_hash += step;
+    }
+    return true;
+}
+
+double BloomFilter::getExpectedFalsePositiveRate() {
+    double number_of_bits = bit_mask + 1.0;
+    return pow(1 - exp(-number_of_hashes * number_of_keys / number_of_bits), number_of_hashes);
+}
+
+long long BloomFilter::getSizeInBytes() {
+    return bits.size() * sizeof(unsigned long long);
+}
+
+#endif //BLOOMFILTER_H
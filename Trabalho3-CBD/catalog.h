@@ -0,0 +1,57 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <map>
+
+#include "util.h"
+#include "queryable.h"
+
+/**
+ * The tables a query can name, by name. Every Table adds itself to the
+ * default catalog when created and removes itself when destroyed.
+ */
+class Catalog {
+private:
+    map<string, Queryable*> tables;
+
+public:
+    static Catalog & getDefault();
+
+    /**
+     * Replaces any table of the same name.
+     */
+    void add(Queryable * table);
+
+    /**
+     * Removes the table, if it is still the one under its name.
+     */
+    void remove(Queryable * table);
+
+    /**
+     * @return the table, or NULL if there is none of that name
+     */
+    Queryable * get(string name);
+};
+
+Catalog & Catalog::getDefault() {
+    static Catalog catalog;
+    return catalog;
+}
+
+void Catalog::add(Queryable * table) {
+    tables[table->getName()] = table;
+}
+
+void Catalog::remove(Queryable * table) {
+    map<string, Queryable*>::iterator it = tables.find(table->getName());
+    if (it != tables.end() && it->second == table) {
+        tables.erase(it);
+    }
+}
+
+Queryable * Catalog::get(string name) {
+    map<string, Queryable*>::iterator it = tables.find(name);
+    return it == tables.end() ? NULL : it->second;
+}
+
+#endif //CATALOG_H
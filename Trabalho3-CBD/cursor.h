@@ -1,26 +1,277 @@
 #ifndef CURSOR_H
 #define CURSOR_H
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "schema.h"
+#include "typedkey.h"
+#include "operator.h"
 
 using namespace std;
 
+/**
+ * Rows of a query result, pulled one at a time from the query's operators,
+ * so a result of any size takes the memory of one row and the first row
+ * comes before the query has read everything:
+ *
+ *     Cursor cursor = person_table.query("SELECT nome FROM person WHERE _id < 10");
+ *     int nome = cursor.getColumnIndex("nome");
+ *     for (bool row = cursor.moveToFirst(); row; row = cursor.moveToNext()) {
+ *         cout << cursor.getString(nome) << endl;
+ *     }
+ *
+ * The tables queried must outlive the cursor. A cursor can be moved but not
+ * copied, as it runs the query; the operators of a prepared statement are
+ * shared with it, and taken by no other cursor while this one holds them.
+ */
 class Cursor {
 private:
-    vector<vector <string> >::iterator it;
-    vector<vector <string> > data;
-    Schema schema;
-    
+    shared_ptr<Operator> root;
+    vector<string> column_names;
+    Tuple tuple;
+    // Index of the current row, -1 before the first
+    long long position;
+    bool opened;
+    bool after_last;
+    string error;
+
+    void close();
+    const TypedKey * getKey(int column_index);
+
 public:
-    Cursor(Schema schema, vector<vector <string> > data){};
-    void moveToFirst(){};
-    void moveToNext(){};
-    string getString(string column_name){};
-    string getString(int column_index){};
-    int getColumnIndex(string column_name){};
+    /**
+     * @param root the query, run from the first move, deleted with the cursor
+     * @param column_names table.column when the query joins tables, column otherwise
+     */
+    Cursor(Operator * root, vector<string> column_names);
+
+    /**
+     * @param root the query, run from the first move, held until the cursor
+     *        is deleted
+     */
+    Cursor(shared_ptr<Operator> root, vector<string> column_names);
+
+    /**
+     * A query that failed, with no rows.
+     */
+    explicit Cursor(string error);
+
+    Cursor(Cursor && other);
+    Cursor & operator=(Cursor && other);
+    Cursor(const Cursor & other) = delete;
+    Cursor & operator=(const Cursor & other) = delete;
+
+    ~Cursor();
+
+    /**
+     * Runs the query, again if it already ran.
+     * @return false if there are no rows
+     */
+    bool moveToFirst();
+
+    /**
+     * Runs the query first if no row was read yet.
+     * @return false once past the last row
+     */
+    bool moveToNext();
+
+    bool isAfterLast();
+
+    /**
+     * @return the index of the current row, -1 before the first
+     */
+    long long getPosition();
+
+    /**
+     * Reads the rows left to count them, which leaves the cursor after the
+     * last row.
+     */
+    int getCount();
+
+    /**
+     * The getters convert the value if the column is of another type, and
+     * give "", 0 or 0.0 without a current row or for an unknown column.
+     * Getting by index skips looking the column up on every row.
+     */
+    string getString(int column_index);
+    long long getInt(int column_index);
+    double getDouble(int column_index);
+
+    string getString(string column_name);
+    long long getInt(string column_name);
+    double getDouble(string column_name);
+
+    /**
+     * @param column_name column or table.column
+     * @return -1 if the result has no such column
+     */
+    int getColumnIndex(string column_name);
+
+    vector<string> getColumnNames();
+
+    /**
+     * @return empty unless the query failed
+     */
+    string getError();
 };
 
-#endif //CURSOR_H
\ No newline at end of file
+Cursor::Cursor(Operator * root, vector<string> column_names) {
+    this->root.reset(root);
+    this->column_names = column_names;
+    this->position = -1;
+    this->opened = false;
+    this->after_last = false;
+}
+
+Cursor::Cursor(shared_ptr<Operator> root, vector<string> column_names) {
+    this->root = root;
+    this->column_names = column_names;
+    this->position = -1;
+    this->opened = false;
+    this->after_last = false;
+}
+
+Cursor::Cursor(string error) {
+    this->position = -1;
+    this->opened = false;
+    this->after_last = true;
+    this->error = error;
+}
+
+Cursor::Cursor(Cursor && other) {
+    opened = false;
+    *this = std::move(other);
+}
+
+Cursor & Cursor::operator=(Cursor && other) {
+    if (this != &other) {
+        close();
+        root.swap(other.root);
+        other.root.reset();
+        column_names.swap(other.column_names);
+        tuple.swap(other.tuple);
+        position = other.position;
+        opened = other.opened;
+        after_last = other.after_last;
+        error.swap(other.error);
+
+        other.position = -1;
+        other.opened = false;
+        other.after_last = true;
+    }
+    return *this;
+}
+
+Cursor::~Cursor() {
+    close();
+}
+
+void Cursor::close() {
+    if (opened) {
+        root->close();
+        opened = false;
+    }
+}
+
+bool Cursor::moveToFirst() {
+    if (root == NULL) {
+        return false;
+    }
+    close();
+    root->open();
+    opened = true;
+    after_last = false;
+    position = -1;
+    return moveToNext();
+}
+
+bool Cursor::moveToNext() {
+    if (!opened) {
+        return after_last ? false : moveToFirst();
+    }
+    if (root->next(tuple)) {
+        position++;
+        return true;
+    }
+    // The operators let go of their files and tables as soon as the end is reached
+    close();
+    after_last = true;
+    position++;
+    tuple.clear();
+    return false;
+}
+
+bool Cursor::isAfterLast() {
+    return after_last;
+}
+
+long long Cursor::getPosition() {
+    return position;
+}
+
+int Cursor::getCount() {
+    // Past the last row, position is the number of rows
+    while (moveToNext()) {}
+    return position < 0 ? 0 : (int) position;
+}
+
+const TypedKey * Cursor::getKey(int column_index) {
+    if (after_last || position < 0 || column_index < 0 || column_index >= (int) tuple.size()) {
+        return NULL;
+    }
+    return &tuple[column_index];
+}
+
+string Cursor::getString(int column_index) {
+    const TypedKey * key = getKey(column_index);
+    return key == NULL ? "" : toString(*key);
+}
+
+long long Cursor::getInt(int column_index) {
+    const TypedKey * key = getKey(column_index);
+    if (key == NULL) return 0;
+    return key->kind == INTEGER_KEY ? key->integer_value : convertKey(*key, INTEGER_KEY).integer_value;
+}
+
+double Cursor::getDouble(int column_index) {
+    const TypedKey * key = getKey(column_index);
+    if (key == NULL) return 0.0;
+    return key->kind == REAL_KEY ? key->real_value : convertKey(*key, REAL_KEY).real_value;
+}
+
+string Cursor::getString(string column_name) {
+    return getString(getColumnIndex(column_name));
+}
+
+long long Cursor::getInt(string column_name) {
+    return getInt(getColumnIndex(column_name));
+}
+
+double Cursor::getDouble(string column_name) {
+    return getDouble(getColumnIndex(column_name));
+}
+
+int Cursor::getColumnIndex(string column_name) {
+    for (size_t i = 0; i < column_names.size(); i++) {
+        if (column_names[i] == column_name) return i;
+    }
+    // column alone matches table.column
+    string suffix = "." + column_name;
+    for (size_t i = 0; i < column_names.size(); i++) {
+        const string & name = column_names[i];
+        if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) return i;
+    }
+    return -1;
+}
+
+vector<string> Cursor::getColumnNames() {
+    return column_names;
+}
+
+string Cursor::getError() {
+    return error;
+}
+
+#endif //CURSOR_H
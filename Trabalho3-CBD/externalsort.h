@@ -0,0 +1,402 @@
+#ifndef EXTERNALSORT_H
+#define EXTERNALSORT_H
+
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+
+#include "util.h"
+#include "parallelsort.h"
+
+/**
+ * Approximate bytes an entry holds in memory, used to bound the runs.
+ */
+template <typename T>
+long long entryBytes(const T &) {
+    return sizeof(pair<T, long long>);
+}
+
+template <>
+long long entryBytes<string>(const string & key) {
+    return sizeof(pair<string, long long>) + key.capacity();
+}
+
+/**
+ * @return a number no other spill of the process has used, to name its
+ *         temporary files
+ */
+int nextSpillId() {
+    static atomic<int> next_spill_id(0);
+    return next_spill_id++;
+}
+
+/**
+ * Sequential writer/reader of (key, registry position) entries on a run file.
+ */
+template <typename T>
+class RunFile {
+private:
+    string path;
+    ofstream out;
+    ifstream in;
+    vector<char> buffer;
+
+    void writeKey(const T & key);
+    bool readKey(T & key);
+
+public:
+    RunFile(string path);
+    ~RunFile();
+
+    string getPath();
+
+    void write(const pair<T, long long> & entry);
+    void finishWriting();
+    bool read(pair<T, long long> & entry);
+
+    /**
+     * Reads the entries again from the first one.
+     */
+    void rewind();
+};
+
+template <typename T>
+RunFile<T>::RunFile(string path) {
+    this->path = path;
+    buffer.resize(1 << 16);
+    out.rdbuf()->pubsetbuf(&buffer[0], buffer.size());
+    out.open(path.c_str(), ios::binary | ios::trunc);
+}
+
+template <typename T>
+RunFile<T>::~RunFile() {
+    out.close();
+    in.close();
+    remove(path.c_str());
+}
+
+template <typename T>
+string RunFile<T>::getPath() {
+    return path;
+}
+
+template <typename T>
+void RunFile<T>::writeKey(const T & key) {
+    out.write(reinterpret_cast<const char *> (&key), sizeof(key));
+}
+
+template <>
+void RunFile<string>::writeKey(const string & key) {
+    unsigned size = key.size();
+    out.write(reinterpret_cast<const char *> (&size), sizeof(size));
+    out.write(key.data(), size);
+}
+
+template <typename T>
+bool RunFile<T>::readKey(T & key) {
+    return (bool) in.read(reinterpret_cast<char *> (&key), sizeof(key));
+}
+
+template <>
+bool RunFile<string>::readKey(string & key) {
+    unsigned size;
+    if (!in.read(reinterpret_cast<char *> (&size), sizeof(size))) {
+        return false;
+    }
+    key.resize(size);
+    return size == 0 || (bool) in.read(&key[0], size);
+}
+
+template <typename T>
+void RunFile<T>::write(const pair<T, long long> & entry) {
+    writeKey(entry.first);
+    out.write(reinterpret_cast<const char *> (&entry.second), sizeof(entry.second));
+}
+
+template <typename T>
+void RunFile<T>::finishWriting() {
+    out.close();
+    in.rdbuf()->pubsetbuf(&buffer[0], buffer.size());
+    in.open(path.c_str(), ios::binary);
+}
+
+template <typename T>
+bool RunFile<T>::read(pair<T, long long> & entry) {
+    return readKey(entry.first) &&
+        (bool) in.read(reinterpret_cast<char *> (&entry.second), sizeof(entry.second));
+}
+
+template <typename T>
+void RunFile<T>::rewind() {
+    in.clear();
+    in.seekg(0);
+}
+
+/**
+ * Tournament tree of losers over k sorted runs: each pop costs log2(k)
+ * comparisons, against the winner only. The runs are in the order of Less.
+ */
+template <typename T, typename Less = less<pair<T, long long> > >
+class LoserTree {
+private:
+    vector<RunFile<T>*> runs;
+    Less less;
+    vector<pair<T, long long> > heads;
+    vector<bool> exhausted;
+    vector<int> tree;
+
+    bool isLess(int a, int b);
+    int build(int node);
+
+public:
+    LoserTree(vector<RunFile<T>*> runs, Less less = Less());
+
+    bool next(pair<T, long long> & entry);
+};
+
+template <typename T, typename Less>
+LoserTree<T, Less>::LoserTree(vector<RunFile<T>*> runs, Less less) {
+    this->runs = runs;
+    this->less = less;
+    int k = runs.size();
+    heads.resize(k);
+    exhausted.resize(k);
+    tree.resize(max(k, 1));
+
+    for (int i = 0; i < k; i++) {
+        exhausted[i] = !runs[i]->read(heads[i]);
+    }
+    if (k > 0) {
+        tree[0] = build(1);
+    }
+}
+
+template <typename T, typename Less>
+bool LoserTree<T, Less>::isLess(int a, int b) {
+    if (exhausted[a]) return false;
+    if (exhausted[b]) return true;
+    return less(heads[a], heads[b]);
+}
+
+template <typename T, typename Less>
+int LoserTree<T, Less>::build(int node) {
+    int k = runs.size();
+    if (node >= k) {
+        return node - k;
+    }
+    int left = build(2 * node);
+    int right = build(2 * node + 1);
+    if (isLess(right, left)) {
+        tree[node] = left;
+        return right;
+    }
+    tree[node] = right;
+    return left;
+}
+
+template <typename T, typename Less>
+bool LoserTree<T, Less>::next(pair<T, long long> & entry) {
+    int k = runs.size();
+    if (k == 0) return false;
+
+    int winner = tree[0];
+    if (exhausted[winner]) return false;
+
+    entry = heads[winner];
+    exhausted[winner] = !runs[winner]->read(heads[winner]);
+
+    for (int node = (winner + k) / 2; node > 0; node /= 2) {
+        if (isLess(tree[node], winner)) {
+            swap(tree[node], winner);
+        }
+    }
+    tree[0] = winner;
+    return true;
+}
+
+/**
+ * Sorts (key, registry position) entries that may not fit in memory.
+ * Entries are gathered into memory-bounded runs, each sorted and spilled to
+ * disk, and then read back through a k-way merge. Input that fits in the
+ * budget never touches the disk, and input that arrives in order is not
+ * sorted again. Entries are ordered by Less, by default on key then
+ * registry position.
+ */
+template <typename T, typename Less = less<pair<T, long long> > >
+class ExternalSort {
+private:
+    long long memory_budget;
+    long long buffer_bytes;
+    string path_prefix;
+    unsigned threads;
+    int sort_id;
+    int next_run_id;
+
+    vector<pair<T, long long> > buffer;
+    bool buffer_sorted;
+    size_t buffer_position;
+    vector<RunFile<T>*> runs;
+    LoserTree<T, Less> * merger;
+    Less less;
+
+    void spill();
+    void mergePass(size_t max_fan_in);
+    string newRunPath();
+
+public:
+    /**
+     * @constructor
+     * @param memory_budget bytes of entries held in memory at once
+     * @param path_prefix prefix of the run files
+     * @param threads threads sorting each run, 0 for one per core
+     */
+    ExternalSort(long long memory_budget, string path_prefix = "sort_run", unsigned threads = 0, Less less = Less());
+
+    /**
+     * @destructor removes the run files
+     */
+    ~ExternalSort();
+
+    void add(const T & key, long long registry_position);
+
+    /**
+     * Ends the input. Entries can then be read in order with next.
+     */
+    void sort();
+
+    bool next(T & key, long long & registry_position);
+
+    int getNumberOfRuns();
+};
+
+template <typename T, typename Less>
+ExternalSort<T, Less>::ExternalSort(long long memory_budget, string path_prefix, unsigned threads, Less less) {
+    this->memory_budget = memory_budget;
+    this->less = less;
+    this->path_prefix = path_prefix;
+    this->threads = threads;
+    this->sort_id = nextSpillId();
+    this->next_run_id = 0;
+    this->buffer_bytes = 0;
+    this->buffer_sorted = true;
+    this->buffer_position = 0;
+    this->merger = NULL;
+}
+
+template <typename T, typename Less>
+ExternalSort<T, Less>::~ExternalSort() {
+    delete merger;
+    for (size_t i = 0; i < runs.size(); i++) {
+        delete runs[i];
+    }
+}
+
+template <typename T, typename Less>
+string ExternalSort<T, Less>::newRunPath() {
+    ostringstream stream;
+    stream << path_prefix << "_" << sort_id << "_" << next_run_id++ << ".tmp";
+    return stream.str();
+}
+
+template <typename T, typename Less>
+void ExternalSort<T, Less>::add(const T & key, long long registry_position) {
+    pair<T, long long> entry(key, registry_position);
+    if (buffer_sorted && !buffer.empty() && less(entry, buffer.back())) {
+        buffer_sorted = false;
+    }
+    buffer.push_back(entry);
+    buffer_bytes += entryBytes(key);
+    if (buffer_bytes >= memory_budget) {
+        spill();
+    }
+}
+
+template <typename T, typename Less>
+void ExternalSort<T, Less>::spill() {
+    if (!buffer_sorted) {
+        parallelSort(buffer, threads, less);
+    }
+
+    RunFile<T> * run = new RunFile<T>(newRunPath());
+    for (size_t i = 0; i < buffer.size(); i++) {
+        run->write(buffer[i]);
+    }
+    run->finishWriting();
+    runs.push_back(run);
+
+    buffer.clear();
+    buffer.shrink_to_fit();
+    buffer_sorted = true;
+    buffer_bytes = 0;
+}
+
+template <typename T, typename Less>
+void ExternalSort<T, Less>::mergePass(size_t max_fan_in) {
+    vector<RunFile<T>*> merged_runs;
+
+    for (size_t first = 0; first < runs.size(); first += max_fan_in) {
+        size_t last = min(runs.size(), first + max_fan_in);
+        vector<RunFile<T>*> group(runs.begin() + first, runs.begin() + last);
+
+        LoserTree<T, Less> tree(group, less);
+        RunFile<T> * run = new RunFile<T>(newRunPath());
+        pair<T, long long> entry;
+        while (tree.next(entry)) {
+            run->write(entry);
+        }
+        run->finishWriting();
+        merged_runs.push_back(run);
+
+        for (size_t i = 0; i < group.size(); i++) {
+            delete group[i];
+        }
+    }
+    runs = merged_runs;
+}
+
+template <typename T, typename Less>
+void ExternalSort<T, Less>::sort() {
+    if (runs.empty()) {
+        if (!buffer_sorted) {
+            parallelSort(buffer, threads, less);
+        }
+        buffer_position = 0;
+        return;
+    }
+
+    if (!buffer.empty()) {
+        spill();
+    }
+
+    // Every open run holds a 64 KB read buffer
+    size_t max_fan_in = max(2LL, memory_budget / (1 << 16));
+    while (runs.size() > max_fan_in) {
+        mergePass(max_fan_in);
+    }
+    merger = new LoserTree<T, Less>(runs, less);
+}
+
+template <typename T, typename Less>
+bool ExternalSort<T, Less>::next(T & key, long long & registry_position) {
+    if (merger == NULL) {
+        if (buffer_position == buffer.size()) return false;
+        key = buffer[buffer_position].first;
+        registry_position = buffer[buffer_position].second;
+        buffer_position++;
+        return true;
+    }
+
+    pair<T, long long> entry;
+    if (!merger->next(entry)) return false;
+    key = entry.first;
+    registry_position = entry.second;
+    return true;
+}
+
+template <typename T, typename Less>
+int ExternalSort<T, Less>::getNumberOfRuns() {
+    return runs.size();
+}
+
+#endif //EXTERNALSORT_H
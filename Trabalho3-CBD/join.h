@@ -3,182 +3,391 @@
 
 #include "util.h"
 #include "schema.h"
-#include "cursor.h"
 #include "queryable.h"
+#include "joinstream.h"
+#include "joinplanner.h"
+#include "joinresult.h"
+#include "materializer.h"
+#include "timer.h"
 
 
-enum JoinType { NESTED_LOOP, NESTED, MERGE, HASH };
+/**
+ * What a run of a join actually did, for EXPLAIN ANALYZE.
+ */
+struct JoinAnalysis {
+    long long pairs;
+    // Seconds creating the stream, building or sorting what it needs, and
+    // pulling the pairs
+    double open_time;
+    double next_time;
+    // Bytes the table scanners read during the run
+    long long bytes_read;
 
+    JoinAnalysis() : pairs(0), open_time(0), next_time(0), bytes_read(0) {}
+};
+
+/**
+ * Join of this_table and other_table. Nothing is computed up front: the
+ * output is pulled in batches of registry position pairs through
+ * open/next/close, so it is never held whole in memory.
+ *
+ *     Join join = person_table.join("_id", &worked_table, "person_id", HASH);
+ *     JoinBatch batch;
+ *     join.open();
+ *     while (join.next(batch)) {
+ *         // batch.this_positions[i] joins batch.other_positions[i]
+ *     }
+ *     join.close();
+ */
 class Join {
 private:
     
     vector<Queryable*> tables; 
-    vector<vector<long long>> * join_result; 
-    void nestedLoopJoin(Queryable *this_table, int this_column_position, Queryable* other_table, int other_column_position);
+    vector<int> column_positions;
+    JoinType join_type;
+    // Whether other_table is the build, outer or indexed side
+    bool swapped;
+    bool planned;
+    JoinPlan plan;
+    JoinComparator comparator;
+    JoinOptions options;
+    BloomFilterStatistics bloom_statistics;
+    AdaptiveJoinStatistics adaptive_statistics;
+    JoinStream * stream;
+    string error;
 
-     void mergeJoin(Queryable *this_table, int this_column_position, Queryable* other_table, int other_column_position);
-     
-    
-     void hashJoin(Queryable *this_table, int this_column_position, Queryable* other_table, int other_column_position);
+    JoinStream * createStream();
+
+    template <typename T>
+    JoinStream * createStream();
     
 public:
 
     /**
      * @constructor
      */
-    Join(Queryable *this_table, string this_column_name, Queryable* other_table, string other_column_name,  JoinType join_type);
+    Join(Queryable *this_table, string this_column_name, Queryable* other_table, string other_column_name, JoinType join_type,
+         JoinComparator comparator = EQUAL, JoinOptions options = JoinOptions());
     
     /**
      * @destructor
      */
     ~Join();
+
+    /**
+     * Starts (or restarts) the join. Builds or sorts what the algorithm needs.
+     */
+    void open();
+
+    /**
+     * Clears the batch and fills it with the next pairs of the join.
+     * @return false when the join is over
+     */
+    bool next(JoinBatch & batch);
+
+    void close();
+
+    /**
+     * Runs the join to the end without keeping the output.
+     * @return the number of pairs
+     */
+    long long count();
+
+    /**
+     * Runs the join to the end without keeping the output, timing the
+     * open and the pairs apart.
+     */
+    JoinAnalysis analyze();
+
+    /**
+     * Prints the plan of printPlan, then what the run actually did.
+     */
+    void printAnalysis(const JoinAnalysis & analysis);
+
+    /**
+     * Runs the join to the end and keeps its output.
+     * @return the pairs, to be deleted by the caller
+     */
+    JoinResult * materialize();
     
     void print(int number_of_values = -1);
-};
 
-void Join::nestedLoopJoin(Queryable *this_table, int this_column_position, Queryable* other_table, int other_column_position) {
-    int counter = 0;
+    BloomFilterStatistics getBloomFilterStatistics();
 
-    while (counter != this_table->getHeader()->size()) { 
-        
-        vector<string> this_row = this_table->getRow(this_table->getHeader()->at(counter).second);
+    void printBloomFilterStatistics();
 
-        
-        for(int i=0; i < other_table->getHeader()->size(); i++){
-            vector<string> other_row = other_table->getRow(other_table->getHeader()->at(i).second);
-        
-            if(this_row.at(this_column_position) == other_row.at(other_column_position)){
-                
-                vector<long long> join_row;
+    /**
+     * @return the algorithm run, the one the planner chose for AUTO
+     */
+    JoinType getJoinType();
+
+    AdaptiveJoinStatistics getAdaptiveJoinStatistics();
+
+    /**
+     * @return this_table and other_table
+     */
+    vector<Queryable*> getTables();
+
+    /**
+     * Prints the algorithm, and for AUTO the planner's estimates. For
+     * ADAPTIVE, the switches made by the last run.
+     */
+    void printPlan();
+
+    /**
+     * @return why the join cannot run, empty if it can. A join that
+     *         cannot run yields no pairs.
+     */
+    string getError();
+};
 
+Join::Join(Queryable *this_table, string this_column_name, Queryable* other_table, string other_column_name, JoinType join_type,
+           JoinComparator comparator, JoinOptions options) {
+    this->stream = NULL;
+    this->comparator = comparator;
+    this->options = options;
 
-                join_row.push_back(this_table->getHeader()->at(counter).second);
-                join_row.push_back(other_table->getHeader()->at(i).second);
-                this->join_result->push_back(join_row);
+    tables.push_back(this_table);
+    tables.push_back(other_table);
+
+    column_positions.push_back(this_table->getSchema().getColPosition(this_column_name));
+    column_positions.push_back(other_table->getSchema().getColPosition(other_column_name));
 
-                
+    this->swapped = false;
+    this->planned = false;
+
+    if (comparator == BAND && getKeyKind(this_table->getSchema().getCols()->at(column_positions[0]).type,
+                                         other_table->getSchema().getCols()->at(column_positions[1]).type) == STRING_KEY) {
+        // other - this has no meaning on strings
+        error = "BAND needs numeric keys";
+    }
+    if (comparator == NOT_EQUAL) {
+        // Matches nearly every pair, nothing beats comparing them all
+        join_type = NESTED_LOOP;
+    } else if (comparator != EQUAL && (join_type != NESTED_LOOP || comparator == BAND)) {
+        // Ranges are swept over sorted keys, no hash or index finds them
+        join_type = MERGE;
+    }
+    if (join_type == AUTO) {
+        plan = planJoin(this_table, column_positions[0], other_table, column_positions[1], this->options);
+        planned = true;
+        join_type = plan.join_type;
+        swapped = plan.swapped;
+    }
+    if (join_type == NESTED) {
+        // The index is the _id header, of whichever side joins on _id
+        KeyKind key_kind = getKeyKind(this_table->getSchema().getCols()->at(column_positions[0]).type,
+                                      other_table->getSchema().getCols()->at(column_positions[1]).type);
+        if (!swapped && !IndexNestedLoopStream::canUseIndex(column_positions[0], key_kind)) {
+            swapped = true;
+        }
+        if (swapped && !IndexNestedLoopStream::canUseIndex(column_positions[1], key_kind)) {
+            join_type = NESTED_LOOP;
+            swapped = false;
+        }
+    }
+    if (join_type == DIRECT) {
+        // Needs integer keys, dense on the build side
+        KeyKind key_kind = getKeyKind(this_table->getSchema().getCols()->at(column_positions[0]).type,
+                                      other_table->getSchema().getCols()->at(column_positions[1]).type);
+        if (key_kind != INTEGER_KEY) {
+            join_type = HASH;
+        } else if (!planned) {
+            ColumnStatistics this_statistics = this_table->getStatistics(column_positions[0]);
+            ColumnStatistics other_statistics = other_table->getStatistics(column_positions[1]);
+            swapped = !DirectJoinStream::isDense(this_statistics, this->options.memory_budget);
+            if (swapped && !DirectJoinStream::isDense(other_statistics, this->options.memory_budget)) {
+                join_type = HASH;
+                swapped = false;
             }
         }
-        counter ++;
     }
+    this->join_type = join_type;
+}
+
+Join::~Join() {
+    close();
 }
 
-void Join::hashJoin(Queryable *build_table, int build_table_column_position, Queryable* probe_table, int probe_table_column_position) {
-    map<string, long long> hash_table;
+JoinStream * Join::createStream() {
+    SchemaType this_type = tables[0]->getSchema().getCols()->at(column_positions[0]).type;
+    SchemaType other_type = tables[1]->getSchema().getCols()->at(column_positions[1]).type;
 
-    header_t* hash_header = build_table->getHeader();
-    
-    for (header_t::iterator it = hash_header->begin(); it != hash_header->end(); it++) {
-        string column_value = build_table->getValue(it->first, build_table_column_position);
-        long long registry_position = it->second;
-        
-        hash_table.insert(pair<string, long long>(column_value, registry_position));
+    KeyKind key_kind = getKeyKind(this_type, other_type);
+    if (!error.empty()) {
+        return NULL;
     }
-    
-    header_t* probe_header = probe_table->getHeader();
-    
-    for (header_t::iterator it = probe_header->begin(); it != probe_header->end(); it++) {
-        string column_value = probe_table->getValue(it->first, probe_table_column_position);
-        
-        map<string, long long>:: iterator hash_it = hash_table.find(column_value);
-        if (hash_it != hash_table.end()) {
-            // Found it
-            // cout << "Found " << column_value << endl;
-            this->join_result->push_back({hash_it->second, it->second});
+    if (comparator == BAND) {
+        // Always a MERGE, on numeric keys
+        if (key_kind == INTEGER_KEY) {
+            return new BandJoinStream<long long>(tables[0], column_positions[0], tables[1], column_positions[1], options);
         }
+        return new BandJoinStream<double>(tables[0], column_positions[0], tables[1], column_positions[1], options);
+    }
+    switch (key_kind) {
+        case INTEGER_KEY : return createStream<long long>();
+        case REAL_KEY    : return createStream<double>();
+        default          : return createStream<string>();
     }
 }
 
-void Join::mergeJoin(Queryable *this_table, int this_column_position, Queryable* other_table, int other_column_position) {
-    // cout << "Start merge join" << endl;
-    vector<pair<string, long long>> *table_a = this_table->getColumn(this_column_position);
-    vector<pair<string, long long>> *table_b = other_table->getColumn(other_column_position);
-    // cout << "Start sort on merge join" << endl;
-    sort(table_a->begin(), table_a->end(),
-        [](const pair<string, long long> &left, const pair<string, long long> &right){
-            return left.first.compare(right.first) <= 0;
-        });
-    sort(table_b->begin(), table_b->end(),
-        [](const pair<string, long long> &left, const pair<string, long long> &right){
-            return left.first.compare(right.first) <= 0;
-        });
-    // cout << "End sort on merge join" << endl;
-
-    int n = table_a->size();
-    int m = table_b->size();
-    int i = 0;
-    int j = 0;
-    int l, k;
-
-    // cout << "Start loop on merge join" << endl;
-    while(i < n and j < m){ 
-        if(table_a->at(i).first.compare(table_b->at(j).first) > 0) {
-            j++;
-        } else if(table_a->at(i).first.compare(table_b->at(j).first) < 0) {
-            i++;
-        } else {
-            l = i;
-
-            while(l < n and table_a->at(l).first.compare(table_a->at(i).first) == 0) {
-                k = j;
-                while(k < m and table_b->at(k).first.compare(table_b->at(j).first) == 0) {
-                    this->join_result->push_back({table_a->at(l).second, table_b->at(k).second});
-                    k++;
-                }   
-                l++;
-            }   
-
-            i = l;
-            j = k;
-        }   
-    }   
-
-    delete table_a;
-    delete table_b;
-
-    // cout << this->join_result->size() << endl;
-    // cout << "End merge join" << endl;
-}
-
-Join::Join(Queryable *this_table, string this_column_name, Queryable* other_table, string other_column_name, JoinType join_type) {
-    this->join_result = new vector<vector<long long>>;
+template <typename T>
+JoinStream * Join::createStream() {
+    switch(join_type) {
+        case NESTED_LOOP  : return createNestedLoopStream<T>(tables[0], column_positions[0], tables[1], column_positions[1], comparator, options);
+        case MERGE  :
+            if (comparator != EQUAL) {
+                return new SweepJoinStream<T>(tables[0], column_positions[0], tables[1], column_positions[1], comparator, options);
+            }
+            return new MergeJoinStream<T>(tables[0], column_positions[0], tables[1], column_positions[1], options, &bloom_statistics);
+        case ADAPTIVE  : return new AdaptiveJoinStream<T>(tables[0], column_positions[0], tables[1], column_positions[1], options, &adaptive_statistics);
+        default  : break;
+    }
 
-    tables.push_back(this_table);
-    tables.push_back(other_table);
+    int build = swapped ? 1 : 0;
+    int probe = 1 - build;
+    switch(join_type) {
+        case HASH  : return new HashJoinStream<T>(tables[build], column_positions[build], tables[probe], column_positions[probe], options, &bloom_statistics, swapped);
+        case RADIX_HASH  : return new RadixHashJoinStream<T>(tables[build], column_positions[build], tables[probe], column_positions[probe], swapped);
+        case NESTED  : return new IndexNestedLoopStream(tables[build], tables[probe], column_positions[probe], swapped);
+        case DIRECT  : return new DirectJoinStream(tables[build], column_positions[build], tables[probe], column_positions[probe], swapped);
+        default  : return NULL;
+    }
+}
 
+void Join::open() {
+    close();
+    bloom_statistics = BloomFilterStatistics();
+    adaptive_statistics = AdaptiveJoinStatistics();
+    stream = createStream();
+}
 
-    int this_column_position = this_table->getSchema().getColPosition(this_column_name);
-    int other_column_position = other_table->getSchema().getColPosition(other_column_name);
-    
-    switch(join_type) {
-        case NESTED_LOOP  : nestedLoopJoin(this_table, this_column_position, other_table, other_column_position); break;
-        case NESTED  : break; 
-        case HASH  : hashJoin(this_table, this_column_position, other_table, other_column_position); break;
-        case MERGE  : mergeJoin(this_table, this_column_position, other_table, other_column_position); break;
+bool Join::next(JoinBatch & batch) {
+    if (stream == NULL) {
+        batch.clear();
+        return false;
+    }
+    return stream->next(batch);
+}
+
+void Join::close() {
+    delete stream;
+    stream = NULL;
+}
+
+long long Join::count() {
+    open();
+    JoinBatch batch;
+    long long number_of_pairs = 0;
+    while (next(batch)) {
+        number_of_pairs += batch.size();
+    }
+    close();
+    return number_of_pairs;
+}
+
+JoinAnalysis Join::analyze() {
+    JoinAnalysis analysis;
+    long long bytes_read = Scanner::getTotalBytesRead();
+    Timer timer;
+    timer.start();
+    open();
+    analysis.open_time = timer.getElapsedTime();
+
+    timer.start();
+    JoinBatch batch;
+    while (next(batch)) {
+        analysis.pairs += batch.size();
     }
+    close();
+    analysis.next_time = timer.getElapsedTime();
+    analysis.bytes_read = Scanner::getTotalBytesRead() - bytes_read;
+    return analysis;
+}
+
+void Join::printAnalysis(const JoinAnalysis & analysis) {
+    printPlan();
+    ostringstream actual;
+    actual << fixed << setprecision(3) << "\tactual " << analysis.pairs << " pairs";
+    if (planned) {
+        actual << " (estimated " << (long long) plan.estimated_pairs << ")";
+    }
+    actual << ", " << (analysis.open_time + analysis.next_time) * 1e3 << " ms (open " << analysis.open_time * 1e3
+           << " ms, next " << analysis.next_time * 1e3 << " ms), read " << describeBytes(analysis.bytes_read);
+    cout << actual.str() << endl;
+}
+
+JoinResult * Join::materialize() {
+    JoinResult * result = new JoinResult();
+    open();
+    JoinBatch batch;
+    while (next(batch)) {
+        result->add(batch);
+    }
+    close();
+    return result;
 }
 
 void Join::print(int number_of_values) {
+    open();
+    JoinBatch batch;
+    // No pair past the last one printed is joined
+    if (number_of_values >= 0 && (size_t) number_of_values < batch.capacity) {
+        batch.capacity = max(number_of_values, 1);
+    }
+    LateMaterializer materializer(tables, cout);
+    int line = 0;
     
-    for(int line=0; line < join_result->size(); line++){ 
-        if(line==number_of_values) break;
+    while (line != number_of_values && next(batch)) {
+        for (size_t i = 0; i < batch.size() && line != number_of_values; i++, line++) {
+            long long registry_positions[] = {batch.this_positions[i], batch.other_positions[i]};
+            materializer.add(registry_positions);
+        }
+    }
+    materializer.flush();
+    close();
+}
 
-        for(int table_order=0; table_order<tables.size(); table_order++) { 
-            long long registry_position = join_result->at(line).at(table_order);
-            Queryable* table = tables.at(table_order);
-            vector<string> row_partial = table->getRow(registry_position);
+BloomFilterStatistics Join::getBloomFilterStatistics() {
+    return bloom_statistics;
+}
 
-            for(int column=0; column < table->getSchema().getCols()->size(); column++) { 
-                cout<<row_partial.at(column) << " | ";
-            }
-     
-        }
-    cout << endl;
+void Join::printBloomFilterStatistics() {
+    if (!bloom_statistics.used) {
+        cout << "Bloom filter: not used" << endl;
+        return;
     }
+    cout << "Bloom filter: " << bloom_statistics.filter_bytes << " bytes, "
+         << bloom_statistics.eliminated_rows << " of " << bloom_statistics.probed_rows << " rows eliminated, "
+         << "false positive rate " << bloom_statistics.getFalsePositiveRate()
+         << " (expected " << bloom_statistics.expected_false_positive_rate << ")" << endl;
 }
 
-Join::~Join() {
-    delete this->join_result;
+JoinType Join::getJoinType() {
+    return join_type;
+}
+
+vector<Queryable*> Join::getTables() {
+    return tables;
+}
+
+AdaptiveJoinStatistics Join::getAdaptiveJoinStatistics() {
+    return adaptive_statistics;
+}
+
+void Join::printPlan() {
+    if (planned) {
+        plan.print();
+    } else {
+        cout << "Join plan: " << getJoinTypeName(join_type) << (swapped ? " (sides swapped)" : "") << endl;
+    }
+    for (size_t i = 0; i < adaptive_statistics.switches.size(); i++) {
+        cout << "\t" << (i + 1) << ". " << adaptive_statistics.switches[i] << endl;
+    }
+}
+
+string Join::getError() {
+    return error;
 }
 
-#endif //JOIN_H
\ No newline at end of file
+#endif //JOIN_H
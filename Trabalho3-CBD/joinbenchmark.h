@@ -1,7 +1,10 @@
 #ifndef JOINBENCHMARK_H
 #define JOINBENCHMARK_H
 
+#include <set>
+
 #include "table.h"
+#include "semijoin.h"
 #include "timer.h"
 
 class JoinBenchmark {
@@ -24,6 +27,19 @@ private:
     void mergeJoin();
     void hashJoin();
     void nestedLoopJoin();
+    void mergeJoinWithBloomFilter();
+    void hashJoinWithBloomFilter();
+    void materialize();
+    void indexNestedLoopJoin();
+    void radixHashJoin();
+    void directJoin();
+    void adaptiveJoin();
+    void autoJoin();
+    void semiJoin();
+    void antiJoin();
+    void rangeJoin();
+    
+    double timeJoin(JoinType join_type);
 };
 
 JoinBenchmark::JoinBenchmark(Queryable *this_table, string this_column_name, Queryable* other_table, string other_column_name) {
@@ -37,6 +53,17 @@ void JoinBenchmark::runBenchmark() {
     mergeJoin();
     hashJoin();
     nestedLoopJoin();
+    indexNestedLoopJoin();
+    radixHashJoin();
+    directJoin();
+    adaptiveJoin();
+    autoJoin();
+    semiJoin();
+    antiJoin();
+    rangeJoin();
+    mergeJoinWithBloomFilter();
+    hashJoinWithBloomFilter();
+    materialize();
 }
 
 void JoinBenchmark::mergeJoin() {
@@ -45,7 +72,8 @@ void JoinBenchmark::mergeJoin() {
     Timer timer;
     timer.start();
     Join join(this_table, this_column_name, other_table, other_column_name, MERGE);
-    cout << "\tTime: " << timer.getElapsedTime() << " s" << endl;
+    long long number_of_pairs = join.count();
+    cout << "\tTime: " << timer.getElapsedTime() << " s (" << number_of_pairs << " pairs)" << endl;
 }
 
 void JoinBenchmark::hashJoin() {
@@ -54,61 +82,231 @@ void JoinBenchmark::hashJoin() {
     Timer timer;
     timer.start();
     Join join(this_table, this_column_name, other_table, other_column_name, HASH);
-    cout << "\tTime: " << timer.getElapsedTime() << " s" << endl;
+    long long number_of_pairs = join.count();
+    cout << "\tTime: " << timer.getElapsedTime() << " s (" << number_of_pairs << " pairs)" << endl;
 }
 
 void JoinBenchmark::nestedLoopJoin() {
     cout << "\nNested Loop Join" << endl;
     
     Timer timer;
-    int counter = 0;
-    vector<vector<long long>> * join_result = new vector<vector<long long>>;
-    int this_column_position = this_table->getSchema().getColPosition(this_column_name);
-    int other_column_position = other_table->getSchema().getColPosition(other_column_name);
-    vector<vector<string>> this_rows;
-    vector<vector<string>> other_rows;
+    timer.start();
+    Join join(this_table, this_column_name, other_table, other_column_name, NESTED_LOOP);
+    long long number_of_pairs = join.count();
+    double time = timer.getElapsedTime();
+    double comparisons = (double) this_table->getNumberOfRows() * other_table->getNumberOfRows();
+    cout << "\tTime: " << time << " s (" << number_of_pairs << " pairs)" << endl;
+    cout << "\t" << (long long) (comparisons / time) << " comparisons/s, " << getTileCompareInstructionSet() << " kernel" << endl;
+}
+
+void JoinBenchmark::indexNestedLoopJoin() {
+    cout << "\nIndex Nested Loop Join" << endl;
     
+    Timer timer;
     timer.start();
+    Join join(this_table, this_column_name, other_table, other_column_name, NESTED);
+    long long number_of_pairs = join.count();
+    cout << "\tTime: " << timer.getElapsedTime() << " s (" << number_of_pairs << " pairs)" << endl;
+    cout << "\t";
+    join.printPlan();
+}
+
+void JoinBenchmark::radixHashJoin() {
+    cout << "\nRadix Hash Join" << endl;
     
-    for (int i = 0; i < this_table->getHeader()->size(); i++) {
-        this_rows.push_back(this_table->getRow(this_table->getHeader()->at(counter).second));
-    }
-    for (int i = 0; i < other_table->getHeader()->size(); i++) {
-        other_rows.push_back(other_table->getRow(other_table->getHeader()->at(counter).second));
-    }
+    Timer timer;
+    timer.start();
+    Join join(this_table, this_column_name, other_table, other_column_name, RADIX_HASH);
+    long long number_of_pairs = join.count();
+    cout << "\tTime: " << timer.getElapsedTime() << " s (" << number_of_pairs << " pairs)" << endl;
+}
+
+void JoinBenchmark::directJoin() {
+    cout << "\nDirect Address Join" << endl;
+    
+    Timer timer;
+    timer.start();
+    Join join(this_table, this_column_name, other_table, other_column_name, DIRECT);
+    long long number_of_pairs = join.count();
+    cout << "\tTime: " << timer.getElapsedTime() << " s (" << number_of_pairs << " pairs)" << endl;
+    cout << "\t";
+    join.printPlan();
+}
+
+void JoinBenchmark::adaptiveJoin() {
+    cout << "\nAdaptive Join" << endl;
     
-    cout << "\tTime to load: " << timer.getElapsedTime() << " s" << endl;
+    Timer timer;
+    timer.start();
+    Join join(this_table, this_column_name, other_table, other_column_name, ADAPTIVE);
+    long long number_of_pairs = join.count();
+    cout << "\tTime: " << timer.getElapsedTime() << " s (" << number_of_pairs << " pairs)" << endl;
+    join.printPlan();
     
+    // A budget far below the build side, as if its size had been underestimated
+    JoinOptions options;
+    options.memory_budget = 16 << 10;
+    
+    cout << "\nAdaptive Join, " << options.memory_budget << " bytes of memory" << endl;
     timer.start();
+    Join small_join(this_table, this_column_name, other_table, other_column_name, ADAPTIVE, EQUAL, options);
+    number_of_pairs = small_join.count();
+    cout << "\tTime: " << timer.getElapsedTime() << " s (" << number_of_pairs << " pairs)" << endl;
+    small_join.printPlan();
+}
 
-    while (counter != this_table->getHeader()->size()) {
-        
-        vector<string> this_row = this_rows.at(counter);
+void JoinBenchmark::semiJoin() {
+    cout << "\nSemi Join" << endl;
+    
+    // The inner join emits a pair per match, so the rows are deduplicated after
+    Timer timer;
+    timer.start();
+    Join join(this_table, this_column_name, other_table, other_column_name, HASH);
+    set<long long> rows;
+    JoinBatch batch;
+    join.open();
+    while (join.next(batch)) {
+        rows.insert(batch.this_positions.begin(), batch.this_positions.end());
+    }
+    join.close();
+    cout << "\tInner join + distinct: " << timer.getElapsedTime() << " s (" << rows.size() << " rows)" << endl;
+    
+    JoinType join_types[] = {HASH, MERGE};
+    for (int i = 0; i < 2; i++) {
+        timer.start();
+        SemiJoin semi_join(this_table, this_column_name, other_table, other_column_name, SEMI_JOIN, join_types[i]);
+        long long number_of_rows = semi_join.count();
+        cout << "\t" << getJoinTypeName(join_types[i]) << ": " << timer.getElapsedTime() << " s (" << number_of_rows << " rows)" << endl;
+    }
+}
 
-       
-        for(int i=0; i < other_table->getHeader()->size(); i++){
-            vector<string> other_row = other_rows.at(i);
+void JoinBenchmark::antiJoin() {
+    cout << "\nAnti Join" << endl;
+    
+    Timer timer;
+    JoinType join_types[] = {HASH, MERGE};
+    for (int i = 0; i < 2; i++) {
+        timer.start();
+        SemiJoin anti_join(this_table, this_column_name, other_table, other_column_name, ANTI_JOIN, join_types[i]);
+        long long number_of_rows = anti_join.count();
+        cout << "\t" << getJoinTypeName(join_types[i]) << ": " << timer.getElapsedTime() << " s (" << number_of_rows << " rows)" << endl;
+    }
+}
+
+void JoinBenchmark::rangeJoin() {
+    cout << "\nRange Join" << endl;
+    
+    JoinOptions options;
+    options.band_lower = -2;
+    options.band_upper = 2;
+    JoinComparator comparators[] = {BAND, LESS};
+    string names[] = {"Band [-2, 2]", "Less"};
+    
+    Timer timer;
+    for (int i = 0; i < 2; i++) {
+        timer.start();
+        Join sweep(this_table, this_column_name, other_table, other_column_name, MERGE, comparators[i], options);
+        if (!sweep.getError().empty()) {
+            cout << "\t" << names[i] << ": " << sweep.getError() << endl;
+            continue;
+        }
+        long long number_of_pairs = sweep.count();
+        cout << "\t" << names[i] << ", sweep: " << timer.getElapsedTime() << " s (" << number_of_pairs << " pairs)" << endl;
         
-            if(this_row.at(this_column_position) == other_row.at(other_column_position)){
-                
-                vector<long long> join_row;
-
-                
-                join_row.push_back(this_table->getHeader()->at(counter).second);
-                join_row.push_back(other_table->getHeader()->at(i).second);
-                join_result->push_back(join_row);
-
-                // cout << "insterted " << this_table->getHeader()->at(counter).second << " and " << other_table->getHeader()->at(i).second << endl;
-                //For debugging purpose, cout << "insterted "<< this_table->getHeader()->at(counter).second<< " and " << other_table->getHeader()->at(i).second << endl;
-            }
+        // The nested loop cannot evaluate a band, and would take the whole benchmark on big tables
+        if (comparators[i] == BAND || (double) this_table->getNumberOfRows() * other_table->getNumberOfRows() > 1e8) {
+            continue;
         }
-        counter ++;
+        timer.start();
+        Join nested_loop(this_table, this_column_name, other_table, other_column_name, NESTED_LOOP, comparators[i], options);
+        number_of_pairs = nested_loop.count();
+        cout << "\t" << names[i] << ", nested loop: " << timer.getElapsedTime() << " s (" << number_of_pairs << " pairs)" << endl;
     }
+}
+
+double JoinBenchmark::timeJoin(JoinType join_type) {
+    Join join(this_table, this_column_name, other_table, other_column_name, join_type);
+    Timer timer;
+    timer.start();
+    join.count();
+    return timer.getElapsedTime();
+}
+
+void JoinBenchmark::autoJoin() {
+    cout << "\nAuto Join" << endl;
+    
+    // Planning gathers the column statistics, once per table
+    Timer timer;
+    timer.start();
+    Join join(this_table, this_column_name, other_table, other_column_name, AUTO);
+    cout << "\tPlanning: " << timer.getElapsedTime() << " s" << endl;
     
-    cout << "\tTime to complete: " << timer.getElapsedTime() << " s" << endl;
+    JoinAnalysis analysis = join.analyze();
+    join.printAnalysis(analysis);
+    double auto_time = analysis.open_time + analysis.next_time;
     
-    delete join_result;
+    JoinType join_types[] = {NESTED_LOOP, NESTED, MERGE, HASH, RADIX_HASH, DIRECT};
+    JoinType best_type = AUTO;
+    double best_time = -1;
+    for (int i = 0; i < 6; i++) {
+        // A nested loop over big tables would take the whole benchmark
+        if (join_types[i] == NESTED_LOOP && (double) this_table->getNumberOfRows() * other_table->getNumberOfRows() > 1e8) {
+            continue;
+        }
+        double time = timeJoin(join_types[i]);
+        if (best_time < 0 || time < best_time) {
+            best_time = time;
+            best_type = join_types[i];
+        }
+    }
+    cout << "\tBest: " << getJoinTypeName(best_type) << " " << best_time << " s, AUTO took "
+         << auto_time / best_time << "x the best" << endl;
 }
 
+void JoinBenchmark::mergeJoinWithBloomFilter() {
+    cout << "\nMerge Join with Bloom filter" << endl;
+    
+    JoinOptions options;
+    options.bloom_filter = true;
+    
+    Timer timer;
+    timer.start();
+    Join join(this_table, this_column_name, other_table, other_column_name, MERGE, EQUAL, options);
+    long long number_of_pairs = join.count();
+    cout << "\tTime: " << timer.getElapsedTime() << " s (" << number_of_pairs << " pairs)" << endl;
+    cout << "\t";
+    join.printBloomFilterStatistics();
+}
+
+void JoinBenchmark::hashJoinWithBloomFilter() {
+    cout << "\nHash Join with Bloom filter" << endl;
+    
+    JoinOptions options;
+    options.bloom_filter = true;
+    
+    Timer timer;
+    timer.start();
+    Join join(this_table, this_column_name, other_table, other_column_name, HASH, EQUAL, options);
+    long long number_of_pairs = join.count();
+    cout << "\tTime: " << timer.getElapsedTime() << " s (" << number_of_pairs << " pairs)" << endl;
+    cout << "\t";
+    join.printBloomFilterStatistics();
+}
+void JoinBenchmark::materialize() {
+    cout << "\nMaterialized Hash Join" << endl;
+    
+    Timer timer;
+    timer.start();
+    Join join(this_table, this_column_name, other_table, other_column_name, HASH);
+    JoinResult * result = join.materialize();
+    cout << "\tTime: " << timer.getElapsedTime() << " s (" << result->size() << " pairs)" << endl;
+    
+    // One vector header, plus a 16 byte block and its malloc header per pair
+    long long rows_bytes = sizeof(vector<vector<long long> >) + result->size() * (sizeof(vector<long long>) + 2 * sizeof(long long) + 16);
+    cout << "\tJoinResult: " << result->getSizeInBytes() << " bytes" << (result->isWide() ? " (64 bit)" : " (32 bit)")
+         << ", vector<vector<long long>>: " << rows_bytes << " bytes" << endl;
+    
+    delete result;
+}
 
 #endif //JOINBENCHMARK_H
\ No newline at end of file
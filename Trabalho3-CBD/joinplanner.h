@@ -0,0 +1,226 @@
+#ifndef JOINPLANNER_H
+#define JOINPLANNER_H
+
+#include <math.h>
+
+#include "util.h"
+#include "schema.h"
+#include "queryable.h"
+#include "statistics.h"
+#include "joinstream.h"
+
+// Costs are in units of one registry read by a Scanner
+const double SCAN_ROW_COST = 1.0;
+const double HASH_INSERT_COST = 1.5;
+const double HASH_PROBE_COST = 0.4;
+// Extra per probe once the hash table no longer fits in cache
+const double HASH_MISS_COST = 0.6;
+const double RADIX_PARTITION_COST = 0.3;
+const double RADIX_PROBE_COST = 0.2;
+const double DIRECT_BUILD_COST = 0.2;
+const double DIRECT_PROBE_COST = 0.1;
+// Numbers are radix sorted, strings compared n log n times
+const double RADIX_SORT_COST = 0.8;
+const double SORT_COMPARE_COST = 0.15;
+// Buffers of a sort, paid even for a few rows
+const double SORT_SETUP_COST = 10000;
+const double SORT_SPILL_COST = 2.0;
+const double INDEX_LOOKUP_COST = 0.1;
+const double NESTED_LOOP_COMPARE_COST = 0.003;
+const double OUTPUT_PAIR_COST = 0.05;
+
+const long long CACHE_BYTES = 1LL << 20;
+
+struct JoinCost {
+    JoinType join_type;
+    // Whether the build, outer or indexed side is other_table
+    bool swapped;
+    bool feasible;
+    double cost;
+    string reason;
+};
+
+/**
+ * The algorithm the planner chose for an equi-join, and what it estimated
+ * for each one it considered.
+ */
+struct JoinPlan {
+    JoinType join_type;
+    bool swapped;
+    ColumnStatistics this_statistics;
+    ColumnStatistics other_statistics;
+    double estimated_pairs;
+    vector<JoinCost> costs;
+
+    void print();
+};
+
+string getJoinTypeName(JoinType join_type);
+
+/**
+ * Chooses the cheapest algorithm for this_table.this_column = other_table.other_column.
+ */
+JoinPlan planJoin(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                  JoinOptions & options);
+
+string getJoinTypeName(JoinType join_type) {
+    switch (join_type) {
+        case NESTED_LOOP : return "NESTED_LOOP";
+        case NESTED      : return "INDEX_NESTED_LOOP";
+        case MERGE       : return "MERGE";
+        case HASH        : return "HASH";
+        case RADIX_HASH  : return "RADIX_HASH";
+        case DIRECT      : return "DIRECT";
+        case ADAPTIVE    : return "ADAPTIVE";
+        default          : return "AUTO";
+    }
+}
+
+void JoinPlan::print() {
+    cout << "Join plan: " << getJoinTypeName(join_type) << (swapped ? " (sides swapped)" : "") << endl;
+    cout << "\tthis: " << this_statistics.number_of_rows << " rows, ~" << this_statistics.distinct_keys << " keys; "
+         << "other: " << other_statistics.number_of_rows << " rows, ~" << other_statistics.distinct_keys << " keys; "
+         << "~" << (long long) estimated_pairs << " pairs" << endl;
+    for (size_t i = 0; i < costs.size(); i++) {
+        cout << "\t" << getJoinTypeName(costs[i].join_type) << (costs[i].swapped ? " (swapped)" : "") << ": ";
+        if (costs[i].feasible) {
+            cout << (long long) costs[i].cost;
+        } else {
+            cout << "-";
+        }
+        if (!costs[i].reason.empty()) {
+            cout << " (" << costs[i].reason << ")";
+        }
+        cout << endl;
+    }
+}
+
+double getSortCost(Queryable *table, int column_position, KeyKind key_kind, long long rows, long long key_size, long long memory_budget) {
+    // Same test as SortedColumn::canElideSort
+    KeyKind column_kind = getKeyKind(table->getSchema().getCols()->at(column_position).type);
+    bool same_order = column_kind == key_kind || (column_kind == INTEGER_KEY && key_kind == REAL_KEY);
+    if (same_order && table->isSortedOn(column_position)) {
+        return 0;
+    }
+    double cost = SORT_SETUP_COST;
+    cost += key_kind == STRING_KEY ? rows * log2(max(2LL, rows)) * SORT_COMPARE_COST : rows * RADIX_SORT_COST;
+    if (rows * key_size > memory_budget) {
+        cost += rows * SORT_SPILL_COST;
+    }
+    return cost;
+}
+
+JoinPlan planJoin(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                  JoinOptions & options) {
+    JoinPlan plan;
+    plan.this_statistics = this_table->getStatistics(this_column_position);
+    plan.other_statistics = other_table->getStatistics(other_column_position);
+
+    SchemaCol this_col = this_table->getSchema().getCols()->at(this_column_position);
+    SchemaCol other_col = other_table->getSchema().getCols()->at(other_column_position);
+    KeyKind key_kind = getKeyKind(this_col.type, other_col.type);
+
+    long long n[] = {plan.this_statistics.number_of_rows, plan.other_statistics.number_of_rows};
+    long long distinct = max(1LL, max(plan.this_statistics.distinct_keys, plan.other_statistics.distinct_keys));
+    plan.estimated_pairs = (double) n[0] * n[1] / distinct;
+    double output_cost = plan.estimated_pairs * OUTPUT_PAIR_COST;
+
+    // In memory size of one key, with its registry position
+    long long key_size = 16;
+    if (key_kind == STRING_KEY) {
+        key_size += 32 + max(this_col.getSize(), other_col.getSize());
+    }
+    long long memory_budget = options.memory_budget;
+
+    for (int side = 0; side < 2; side++) {
+        bool swapped = side == 1;
+        long long build_rows = n[side];
+        long long probe_rows = n[1 - side];
+
+        // Hash: one node per build row
+        JoinCost hash;
+        hash.join_type = HASH;
+        hash.swapped = swapped;
+        long long hash_bytes = build_rows * (key_size + HASH_NODE_BYTES);
+        hash.feasible = hash_bytes <= memory_budget;
+        hash.cost = (build_rows + probe_rows) * SCAN_ROW_COST + build_rows * HASH_INSERT_COST
+                  + probe_rows * (HASH_PROBE_COST + (hash_bytes > CACHE_BYTES ? HASH_MISS_COST : 0)) + output_cost;
+        if (!hash.feasible) hash.reason = "build side over the memory budget";
+        plan.costs.push_back(hash);
+
+        // Radix hash: both sides in memory, partitions in cache
+        JoinCost radix;
+        radix.join_type = RADIX_HASH;
+        radix.swapped = swapped;
+        radix.feasible = (build_rows + probe_rows) * (key_size + 16) <= memory_budget;
+        radix.cost = (build_rows + probe_rows) * (SCAN_ROW_COST + RADIX_PARTITION_COST)
+                   + build_rows * RADIX_PROBE_COST + probe_rows * RADIX_PROBE_COST + output_cost;
+        if (!radix.feasible) radix.reason = "both sides over the memory budget";
+        plan.costs.push_back(radix);
+    }
+
+    // Direct addressing: an array over the key range of the build side
+    for (int side = 0; side < 2; side++) {
+        ColumnStatistics & build_statistics = side == 0 ? plan.this_statistics : plan.other_statistics;
+        long long build_rows = n[side];
+        long long probe_rows = n[1 - side];
+
+        JoinCost direct;
+        direct.join_type = DIRECT;
+        direct.swapped = side == 1;
+        direct.feasible = key_kind == INTEGER_KEY && DirectJoinStream::isDense(build_statistics, memory_budget);
+        direct.cost = (build_rows + probe_rows) * SCAN_ROW_COST + build_rows * DIRECT_BUILD_COST
+                    + probe_rows * DIRECT_PROBE_COST + output_cost;
+        if (!direct.feasible) direct.reason = "keys not dense integers";
+        plan.costs.push_back(direct);
+    }
+
+    // Index nested loop: scan one side, binary search the _id header of the other
+    for (int side = 0; side < 2; side++) {
+        int index_column = side == 0 ? this_column_position : other_column_position;
+        long long index_rows = n[side];
+        long long probe_rows = n[1 - side];
+
+        JoinCost index;
+        index.join_type = NESTED;
+        index.swapped = side == 1;
+        index.feasible = IndexNestedLoopStream::canUseIndex(index_column, key_kind);
+        index.cost = probe_rows * (SCAN_ROW_COST + log2(max(2LL, index_rows)) * INDEX_LOOKUP_COST) + output_cost;
+        if (!index.feasible) index.reason = "no index on the column";
+        plan.costs.push_back(index);
+    }
+
+    JoinCost merge;
+    merge.join_type = MERGE;
+    merge.swapped = false;
+    merge.feasible = true;
+    merge.cost = (n[0] + n[1]) * SCAN_ROW_COST
+               + getSortCost(this_table, this_column_position, key_kind, n[0], key_size, memory_budget / 2)
+               + getSortCost(other_table, other_column_position, key_kind, n[1], key_size, memory_budget / 2)
+               + output_cost;
+    plan.costs.push_back(merge);
+
+    // The nested loop puts the smaller table outside
+    long long outer_rows = min(n[0], n[1]);
+    long long inner_rows = max(n[0], n[1]);
+    long long blocks = max(1LL, (outer_rows * key_size + memory_budget - 1) / memory_budget);
+    JoinCost nested_loop;
+    nested_loop.join_type = NESTED_LOOP;
+    nested_loop.swapped = n[1] < n[0];
+    nested_loop.feasible = true;
+    nested_loop.cost = outer_rows * SCAN_ROW_COST + blocks * inner_rows * SCAN_ROW_COST
+                     + (double) outer_rows * inner_rows * NESTED_LOOP_COMPARE_COST + output_cost;
+    plan.costs.push_back(nested_loop);
+
+    int best = -1;
+    for (size_t i = 0; i < plan.costs.size(); i++) {
+        if (plan.costs[i].feasible && (best < 0 || plan.costs[i].cost < plan.costs[best].cost)) {
+            best = (int) i;
+        }
+    }
+    plan.join_type = plan.costs[best].join_type;
+    plan.swapped = plan.costs[best].swapped;
+    return plan;
+}
+
+#endif //JOINPLANNER_H
@@ -0,0 +1,177 @@
+#ifndef JOINRESULT_H
+#define JOINRESULT_H
+
+#include "util.h"
+#include "parallelsort.h"
+#include "joinstream.h"
+
+/**
+ * Materialized join output, as two parallel arrays of registry positions
+ * (this_table and other_table) stored in chunks of up to CHUNK_SIZE pairs:
+ * no allocation per pair, and growing never copies more than one chunk.
+ * Positions are kept in 32 bits until one does not fit, and only then
+ * widened to 64 bits.
+ */
+class JoinResult {
+private:
+    static const int CHUNK_BITS = 16;
+    static const size_t CHUNK_SIZE = 1 << CHUNK_BITS;
+
+    size_t number_of_pairs;
+    bool wide;
+
+    // [0] this_table positions, [1] other_table positions
+    vector<vector<unsigned> > narrow_chunks[2];
+    vector<vector<long long> > wide_chunks[2];
+
+    void widen();
+    void sortBy(int side, unsigned threads);
+
+public:
+    JoinResult();
+
+    void add(long long this_position, long long other_position);
+    void add(JoinBatch & batch);
+
+    size_t size();
+
+    long long getThisPosition(size_t index);
+    long long getOtherPosition(size_t index);
+
+    /**
+     * @param side 0 for this_table, 1 for other_table
+     */
+    long long getPosition(int side, size_t index);
+
+    /**
+     * Sorts the pairs by one of the positions, e.g. to read that table in
+     * file order. Pairs with the same position keep their order.
+     */
+    void sortByThis(unsigned threads = 0);
+    void sortByOther(unsigned threads = 0);
+
+    bool isWide();
+
+    long long getSizeInBytes();
+};
+
+JoinResult::JoinResult() {
+    number_of_pairs = 0;
+    wide = false;
+}
+
+void JoinResult::widen() {
+    for (int side = 0; side < 2; side++) {
+        for (size_t c = 0; c < narrow_chunks[side].size(); c++) {
+            vector<unsigned> & narrow = narrow_chunks[side][c];
+            wide_chunks[side].push_back(vector<long long>(narrow.begin(), narrow.end()));
+            vector<unsigned>().swap(narrow);
+        }
+        narrow_chunks[side].clear();
+    }
+    wide = true;
+}
+
+void JoinResult::add(long long this_position, long long other_position) {
+    if (!wide && (this_position > 0xFFFFFFFFLL || other_position > 0xFFFFFFFFLL ||
+                  this_position < 0 || other_position < 0)) {
+        widen();
+    }
+
+    size_t offset = number_of_pairs & (CHUNK_SIZE - 1);
+    if (wide) {
+        if (offset == 0) {
+            for (int side = 0; side < 2; side++) {
+                wide_chunks[side].push_back(vector<long long>());
+            }
+        }
+        wide_chunks[0].back().push_back(this_position);
+        wide_chunks[1].back().push_back(other_position);
+    } else {
+        if (offset == 0) {
+            for (int side = 0; side < 2; side++) {
+                narrow_chunks[side].push_back(vector<unsigned>());
+            }
+        }
+        narrow_chunks[0].back().push_back((unsigned) this_position);
+        narrow_chunks[1].back().push_back((unsigned) other_position);
+    }
+    number_of_pairs++;
+}
+
+void JoinResult::add(JoinBatch & batch) {
+    for (size_t i = 0; i < batch.size(); i++) {
+        add(batch.this_positions[i], batch.other_positions[i]);
+    }
+}
+
+size_t JoinResult::size() {
+    return number_of_pairs;
+}
+
+long long JoinResult::getPosition(int side, size_t index) {
+    size_t chunk = index >> CHUNK_BITS;
+    size_t offset = index & (CHUNK_SIZE - 1);
+    if (wide) {
+        return wide_chunks[side][chunk][offset];
+    }
+    return narrow_chunks[side][chunk][offset];
+}
+
+long long JoinResult::getThisPosition(size_t index) {
+    return getPosition(0, index);
+}
+
+long long JoinResult::getOtherPosition(size_t index) {
+    return getPosition(1, index);
+}
+
+void JoinResult::sortBy(int side, unsigned threads) {
+    // (key, payload) = (sorted side, the other side)
+    vector<pair<long long, long long> > entries;
+    entries.reserve(number_of_pairs);
+    for (size_t i = 0; i < number_of_pairs; i++) {
+        entries.push_back(make_pair(getPosition(side, i), getPosition(1 - side, i)));
+    }
+
+    parallelSort(entries, threads);
+
+    for (size_t i = 0; i < number_of_pairs; i++) {
+        size_t chunk = i >> CHUNK_BITS;
+        size_t offset = i & (CHUNK_SIZE - 1);
+        if (wide) {
+            wide_chunks[side][chunk][offset] = entries[i].first;
+            wide_chunks[1 - side][chunk][offset] = entries[i].second;
+        } else {
+            narrow_chunks[side][chunk][offset] = (unsigned) entries[i].first;
+            narrow_chunks[1 - side][chunk][offset] = (unsigned) entries[i].second;
+        }
+    }
+}
+
+void JoinResult::sortByThis(unsigned threads) {
+    sortBy(0, threads);
+}
+
+void JoinResult::sortByOther(unsigned threads) {
+    sortBy(1, threads);
+}
+
+bool JoinResult::isWide() {
+    return wide;
+}
+
+long long JoinResult::getSizeInBytes() {
+    long long bytes = sizeof(JoinResult);
+    for (int side = 0; side < 2; side++) {
+        for (size_t c = 0; c < narrow_chunks[side].size(); c++) {
+            bytes += sizeof(vector<unsigned>) + narrow_chunks[side][c].capacity() * sizeof(unsigned);
+        }
+        for (size_t c = 0; c < wide_chunks[side].size(); c++) {
+            bytes += sizeof(vector<long long>) + wide_chunks[side][c].capacity() * sizeof(long long);
+        }
+    }
+    return bytes;
+}
+
+#endif //JOINRESULT_H
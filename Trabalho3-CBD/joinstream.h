@@ -0,0 +1,1526 @@
+#ifndef JOINSTREAM_H
+#define JOINSTREAM_H
+
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+
+#include "util.h"
+#include "schema.h"
+#include "queryable.h"
+#include "scanner.h"
+#include "externalsort.h"
+#include "bloomfilter.h"
+#include "statistics.h"
+#include "tilecompare.h"
+
+/**
+ * Predicate between this_column and other_column. BAND matches
+ * band_lower <= other - this <= band_upper, bounds taken from JoinOptions,
+ * and only joins numeric keys.
+ * NOT_EQUAL only runs as a NESTED_LOOP, BAND and the inequalities as a
+ * MERGE (a sort and sweep) or a NESTED_LOOP.
+ */
+enum JoinComparator { EQUAL, NOT_EQUAL, LESS, LESS_EQUAL, GREATER, GREATER_EQUAL, BAND };
+
+/**
+ * NESTED is the index nested loop, over the _id header of one table.
+ * DIRECT is a hash join on an array indexed by key, for dense integer keys.
+ * ADAPTIVE starts as a hash join and changes strategy on what it finds.
+ * AUTO leaves the choice to the cost based planner.
+ */
+enum JoinType { NESTED_LOOP, NESTED, MERGE, HASH, RADIX_HASH, DIRECT, ADAPTIVE, AUTO };
+
+/**
+ * @return the comparator with its sides swapped (a < b  <=>  b > a)
+ */
+JoinComparator flip(JoinComparator comparator);
+
+// Bytes of a hash table node besides its entry
+const long long HASH_NODE_BYTES = 32;
+
+struct JoinOptions {
+    // Bytes of keys an algorithm may hold in memory at once
+    long long memory_budget;
+    // Threads used to sort, 0 for one per core
+    unsigned threads;
+    // HASH and MERGE: drop other_table rows whose key is not in a Bloom
+    // filter of this_table keys while scanning them
+    bool bloom_filter;
+    double bloom_false_positive_rate;
+    // BAND: bounds of other - this, both included
+    double band_lower;
+    double band_upper;
+
+    JoinOptions() : memory_budget(64LL << 20), threads(0), bloom_filter(false), bloom_false_positive_rate(0.01),
+                    band_lower(0), band_upper(0) {}
+};
+
+struct BloomFilterStatistics {
+    bool used;
+    long long filter_bytes;
+    // other_table rows scanned, and how many of those the filter dropped
+    long long probed_rows;
+    long long eliminated_rows;
+    // Rows the filter let through that matched nothing
+    long long false_positives;
+    double expected_false_positive_rate;
+
+    BloomFilterStatistics() : used(false), filter_bytes(0), probed_rows(0), eliminated_rows(0), false_positives(0),
+                              expected_false_positive_rate(0) {}
+
+    /**
+     * @return the share of rows without a match that the filter let through
+     */
+    double getFalsePositiveRate();
+};
+
+struct AdaptiveJoinStatistics {
+    bool used;
+    long long build_rows;
+    int partitions;
+    // What the join switched to, and why, in order
+    vector<string> switches;
+
+    AdaptiveJoinStatistics() : used(false), build_rows(0), partitions(0) {}
+};
+
+/**
+ * A batch of join output: this_table and other_table registry positions of
+ * each matching pair, in two parallel arrays.
+ */
+struct JoinBatch {
+    vector<long long> this_positions;
+    vector<long long> other_positions;
+    size_t capacity;
+
+    JoinBatch(size_t capacity = 1024);
+
+    size_t size();
+    bool isFull();
+    void clear();
+    void add(long long this_position, long long other_position);
+};
+
+/**
+ * Pull-based join algorithm. Each call resumes where the last one stopped,
+ * so the output is never held beyond one batch.
+ */
+class JoinStream {
+public:
+    virtual ~JoinStream() {}
+
+    /**
+     * Clears the batch and fills it with up to batch.capacity pairs.
+     * @return false when the join is over and the batch is empty
+     */
+    virtual bool next(JoinBatch & batch) =0;
+};
+
+/**
+ * A column read in key order. Tables already ordered on the column are
+ * streamed as they are; anything else goes through an ExternalSort.
+ */
+template <typename T>
+class SortedColumn {
+private:
+    Scanner *scan;
+    ExternalSort<T> *sorter;
+    int column_position;
+    long long filtered_rows;
+
+public:
+    /**
+     * @param build_filter if set, gets every key of the column
+     * @param probe_filter if set, rows whose key it rejects are skipped
+     */
+    SortedColumn(Queryable *table, int column_position, KeyKind key_kind, long long memory_budget, unsigned threads,
+                 BloomFilter *build_filter = NULL, BloomFilter *probe_filter = NULL);
+    ~SortedColumn();
+
+    /**
+     * @return whether the table can be read in key_kind order without sorting
+     */
+    static bool canElideSort(Queryable *table, int column_position, KeyKind key_kind);
+
+    bool next(T & key, long long & registry_position);
+
+    bool isSortElided();
+
+    long long getFilteredRows();
+};
+
+/**
+ * Block nested loop: a memory-budgeted block of outer keys is compared
+ * against every inner row, the inner table being scanned once per block.
+ * The block is compared TILE_SIZE keys at a time into a match mask, with
+ * SIMD for integer and real keys (see tilecompare.h).
+ */
+template <typename T, typename Compare>
+class NestedLoopStream : public JoinStream {
+private:
+    Scanner *outer_scan;
+    Scanner *inner_scan;
+    int outer_column_position;
+    int inner_column_position;
+    bool swapped;
+
+    vector<T> block_keys;
+    vector<long long> block_positions;
+    size_t block_rows;
+    bool block_loaded;
+
+    T inner_key;
+    long long inner_position;
+    bool has_inner_row;
+    size_t block_index;
+    // Matches of the tile starting at tile_start not yet emitted
+    unsigned long long tile_mask;
+    size_t tile_start;
+
+    bool loadBlock();
+
+public:
+    /**
+     * @param swapped whether outer is other_table, so pairs are emitted reversed
+     */
+    NestedLoopStream(Queryable *outer_table, int outer_column_position, Queryable *inner_table, int inner_column_position,
+                     bool swapped, long long memory_budget);
+    ~NestedLoopStream();
+
+    bool next(JoinBatch & batch);
+};
+
+/**
+ * Builds an in-memory hash table of this_table and streams other_table
+ * through it.
+ */
+template <typename T>
+class HashJoinStream : public JoinStream {
+private:
+    typedef unordered_multimap<T, long long> hash_table_t;
+
+    hash_table_t hash_table;
+    Scanner *probe_scan;
+    int probe_column_position;
+    typename hash_table_t::iterator match;
+    typename hash_table_t::iterator match_end;
+    long long probe_position;
+
+    bool swapped;
+
+    BloomFilter *filter;
+    BloomFilterStatistics *bloom_statistics;
+    long long probed_rows;
+    long long false_positives;
+
+    void finish();
+
+public:
+    /**
+     * @param swapped whether build_table is other_table, so pairs are emitted reversed
+     */
+    HashJoinStream(Queryable *build_table, int build_column_position, Queryable *probe_table, int probe_column_position,
+                   JoinOptions & options, BloomFilterStatistics *bloom_statistics, bool swapped = false);
+    ~HashJoinStream();
+
+    bool next(JoinBatch & batch);
+};
+
+/**
+ * Index nested loop: the probe table is scanned and each key is looked up
+ * by binary search in the header of the indexed table, which is sorted by
+ * _id, so the indexed table itself is never read.
+ */
+class IndexNestedLoopStream : public JoinStream {
+private:
+    header_t *index;
+    Scanner *probe_scan;
+    int probe_column_position;
+    bool swapped;
+
+    header_t::iterator match;
+    header_t::iterator match_end;
+    long long probe_position;
+
+public:
+    /**
+     * @param swapped whether index_table is other_table, so pairs are emitted reversed
+     */
+    IndexNestedLoopStream(Queryable *index_table, Queryable *probe_table, int probe_column_position, bool swapped);
+    ~IndexNestedLoopStream();
+
+    /**
+     * @return whether the header of the table indexes the column, compared as key_kind
+     */
+    static bool canUseIndex(int column_position, KeyKind key_kind);
+
+    bool next(JoinBatch & batch);
+};
+
+/**
+ * Radix partitioned hash join: both tables are split on the low bits of the
+ * key hash into partitions small enough for their hash table to stay in
+ * cache, then each partition is built and probed on its own. Both tables'
+ * keys are held in memory.
+ */
+template <typename T>
+class RadixHashJoinStream : public JoinStream {
+private:
+    struct Entry {
+        T key;
+        long long registry_position;
+        unsigned long long hash;
+    };
+
+    // [partition] entries of build_table and probe_table
+    vector<vector<Entry> > build_partitions;
+    vector<vector<Entry> > probe_partitions;
+    bool swapped;
+
+    // Chained hash table of the current partition
+    vector<int> heads;
+    vector<int> chain;
+    size_t bucket_mask;
+
+    size_t partition;
+    size_t probe_index;
+    int match;
+
+    void partitionTable(Queryable *table, int column_position, vector<vector<Entry> > & partitions);
+    void build();
+
+public:
+    /**
+     * @param swapped whether build_table is other_table, so pairs are emitted reversed
+     */
+    RadixHashJoinStream(Queryable *build_table, int build_column_position, Queryable *probe_table, int probe_column_position,
+                        bool swapped);
+
+    /**
+     * @return bytes held per row of both tables
+     */
+    static long long getEntrySize();
+
+    bool next(JoinBatch & batch);
+};
+
+/**
+ * Join on dense integer keys: build_table is laid out in an array indexed by
+ * key - min_key, so a probe is one bounds check and one array load. When
+ * keys repeat, the positions are grouped by key with a counting sort and
+ * found through an array of offsets instead.
+ */
+class DirectJoinStream : public JoinStream {
+private:
+    long long min_key;
+    unsigned long long range;
+    bool unique;
+
+    // unique: the position of each key, or -1. Otherwise positions grouped
+    // by key, those of key k in [offsets[k], offsets[k + 1])
+    vector<long long> positions;
+    vector<unsigned> offsets;
+
+    Scanner *probe_scan;
+    int probe_column_position;
+    bool swapped;
+
+    size_t match;
+    size_t match_end;
+    long long probe_position;
+
+public:
+    /**
+     * @param swapped whether build_table is other_table, so pairs are emitted reversed
+     */
+    DirectJoinStream(Queryable *build_table, int build_column_position, Queryable *probe_table, int probe_column_position,
+                     bool swapped);
+    ~DirectJoinStream();
+
+    /**
+     * @return whether the keys fill enough of their range for an array
+     *         indexed by key to fit in memory_budget
+     */
+    static bool isDense(ColumnStatistics & statistics, long long memory_budget);
+
+    bool next(JoinBatch & batch);
+};
+
+/**
+ * Inequality join: the smaller table is sorted into memory, the other one
+ * read in key order, and the inner rows matching each outer key form a
+ * window [lower, upper) of the sorted array. As the outer keys grow, both
+ * ends of the window only move forward, so the join costs the two sorts
+ * plus its output.
+ */
+template <typename T>
+class SweepJoinStream : public JoinStream {
+private:
+    vector<T> inner_keys;
+    vector<long long> inner_positions;
+    SortedColumn<T> *outer;
+
+    bool has_lower, lower_inclusive;
+    bool has_upper, upper_inclusive;
+
+    size_t lower, upper, match;
+    long long outer_position;
+
+    void setBounds(JoinComparator comparator);
+
+protected:
+    bool swapped;
+    // Added to the outer key to bound the window: T(), which leaves any
+    // key as it is, but for a BAND
+    T lower_offset, upper_offset;
+
+public:
+    /**
+     * Picks the smaller table as the inner one, and swaps the comparator to match.
+     */
+    SweepJoinStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                    JoinComparator comparator, JoinOptions & options);
+    ~SweepJoinStream();
+
+    bool next(JoinBatch & batch);
+};
+
+/**
+ * Sweep of a BAND: the window around each outer key is shifted by the
+ * bounds of the band. Only numeric keys have the arithmetic.
+ */
+template <typename T>
+class BandJoinStream : public SweepJoinStream<T> {
+public:
+    BandJoinStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                   JoinOptions & options);
+};
+
+/**
+ * Hash join that does not trust the row counts it is given. It hashes the
+ * side estimated smaller, and while building:
+ *  - if the hash table outgrows the memory budget, the rows are spread over
+ *    partition files (Grace hash join) and joined one partition at a time;
+ *  - if the side turns out tiny and the other one is indexed, its keys are
+ *    looked up in the index instead of scanning the other side.
+ * Every switch is recorded in the AdaptiveJoinStatistics.
+ */
+template <typename T>
+class AdaptiveJoinStream : public JoinStream {
+private:
+    typedef unordered_multimap<T, long long> hash_table_t;
+    enum Phase { PROBE, INDEX, GRACE, DONE };
+
+    Phase phase;
+    bool swapped;
+    long long memory_budget;
+    AdaptiveJoinStatistics *statistics;
+
+    hash_table_t hash_table;
+    long long hash_table_bytes;
+    typename hash_table_t::iterator match;
+    typename hash_table_t::iterator match_end;
+    long long probe_position;
+
+    // PROBE
+    Scanner *probe_scan;
+    int probe_column_position;
+
+    // INDEX
+    header_t *index;
+    typename hash_table_t::iterator build_row;
+    header_t::iterator index_match;
+    header_t::iterator index_match_end;
+
+    // GRACE
+    vector<RunFile<T>*> build_partitions;
+    vector<RunFile<T>*> probe_partitions;
+    size_t partition;
+    bool chunk_loaded;
+    bool build_exhausted;
+
+    void spill(Queryable *probe_table);
+    bool loadChunk();
+    void record(const string & message);
+
+public:
+    AdaptiveJoinStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                       JoinOptions & options, AdaptiveJoinStatistics *statistics);
+    ~AdaptiveJoinStream();
+
+    bool next(JoinBatch & batch);
+};
+
+/**
+ * Merges both tables read in key order.
+ */
+template <typename T>
+class MergeJoinStream : public JoinStream {
+private:
+    SortedColumn<T> *table_a;
+    SortedColumn<T> *table_b;
+
+    T key_a, key_b;
+    long long position_a, position_b;
+    bool has_a, has_b;
+
+    // other_table positions sharing group_key, joined with each a row of that key
+    vector<long long> group;
+    T group_key;
+    size_t group_index;
+    bool in_group;
+
+    BloomFilter *filter;
+    BloomFilterStatistics *bloom_statistics;
+    long long probed_rows;
+    long long unmatched_b;
+
+    void finish();
+
+public:
+    MergeJoinStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                    JoinOptions & options, BloomFilterStatistics *bloom_statistics);
+    ~MergeJoinStream();
+
+    bool next(JoinBatch & batch);
+};
+
+/**
+ * @return the stream joining this_table.this_column comparator other_table.other_column,
+ *         with the keys compared as T
+ */
+template <typename T>
+JoinStream * createNestedLoopStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                                    JoinComparator comparator, JoinOptions & options);
+
+double BloomFilterStatistics::getFalsePositiveRate() {
+    long long negatives = eliminated_rows + false_positives;
+    return negatives == 0 ? 0 : false_positives / (double) negatives;
+}
+
+JoinComparator flip(JoinComparator comparator) {
+    switch (comparator) {
+        case LESS          : return GREATER;
+        case LESS_EQUAL    : return GREATER_EQUAL;
+        case GREATER       : return LESS;
+        case GREATER_EQUAL : return LESS_EQUAL;
+        default            : return comparator;
+    }
+}
+
+JoinBatch::JoinBatch(size_t capacity) {
+    this->capacity = capacity;
+    this_positions.reserve(capacity);
+    other_positions.reserve(capacity);
+}
+
+size_t JoinBatch::size() {
+    return this_positions.size();
+}
+
+bool JoinBatch::isFull() {
+    return this_positions.size() >= capacity;
+}
+
+void JoinBatch::clear() {
+    this_positions.clear();
+    other_positions.clear();
+}
+
+void JoinBatch::add(long long this_position, long long other_position) {
+    this_positions.push_back(this_position);
+    other_positions.push_back(other_position);
+}
+
+/*****************************************
+ ************ SORTED COLUMN **************
+ *****************************************/
+
+template <typename T>
+SortedColumn<T>::SortedColumn(Queryable *table, int column_position, KeyKind key_kind, long long memory_budget, unsigned threads,
+                              BloomFilter *build_filter, BloomFilter *probe_filter) {
+    this->column_position = column_position;
+    this->scan = table->scan();
+    this->sorter = NULL;
+    this->filtered_rows = 0;
+
+    if (probe_filter != NULL) {
+        scan->setFilter(probe_filter, column_position, key_kind);
+    }
+
+    if (canElideSort(table, column_position, key_kind)) {
+        if (build_filter != NULL) {
+            while (scan->next()) {
+                build_filter->add(hashKey(scan->getKey<T>(column_position)));
+            }
+            scan->rewind();
+        }
+        return;
+    }
+
+    sorter = new ExternalSort<T>(memory_budget, "merge_join", threads);
+    while (scan->next()) {
+        T key = scan->getKey<T>(column_position);
+        sorter->add(key, scan->getRegistryPosition());
+        if (build_filter != NULL) {
+            build_filter->add(hashKey(key));
+        }
+    }
+    sorter->sort();
+    filtered_rows = scan->getFilteredRows();
+    delete scan;
+    scan = NULL;
+}
+
+template <typename T>
+bool SortedColumn<T>::canElideSort(Queryable *table, int column_position, KeyKind key_kind) {
+    // The table order only helps if it is the order the keys are compared in
+    KeyKind column_kind = getKeyKind(table->getSchema().getCols()->at(column_position).type);
+    bool same_order = column_kind == key_kind || (column_kind == INTEGER_KEY && key_kind == REAL_KEY);
+
+    return same_order && table->isSortedOn(column_position);
+}
+
+template <typename T>
+SortedColumn<T>::~SortedColumn() {
+    delete scan;
+    delete sorter;
+}
+
+template <typename T>
+bool SortedColumn<T>::next(T & key, long long & registry_position) {
+    if (sorter != NULL) {
+        return sorter->next(key, registry_position);
+    }
+    if (!scan->next()) {
+        return false;
+    }
+    key = scan->getKey<T>(column_position);
+    registry_position = scan->getRegistryPosition();
+    return true;
+}
+
+template <typename T>
+bool SortedColumn<T>::isSortElided() {
+    return sorter == NULL;
+}
+
+template <typename T>
+long long SortedColumn<T>::getFilteredRows() {
+    return scan != NULL ? scan->getFilteredRows() : filtered_rows;
+}
+
+/*****************************************
+ ************** NESTED LOOP **************
+ *****************************************/
+
+template <typename T, typename Compare>
+NestedLoopStream<T, Compare>::NestedLoopStream(Queryable *outer_table, int outer_column_position, Queryable *inner_table, int inner_column_position,
+                                               bool swapped, long long memory_budget) {
+    this->outer_column_position = outer_column_position;
+    this->inner_column_position = inner_column_position;
+    this->swapped = swapped;
+
+    long long key_size = sizeof(T) + sizeof(long long);
+    if (getKeyKind(outer_table->getSchema().getCols()->at(outer_column_position).type) == STRING_KEY) {
+        key_size += outer_table->getSchema().getCols()->at(outer_column_position).getSize();
+    }
+    block_rows = (size_t) max(1LL, min(memory_budget / key_size, (long long) outer_table->getNumberOfRows()));
+    block_keys.reserve(block_rows);
+    block_positions.reserve(block_rows);
+
+    outer_scan = outer_table->scan();
+    inner_scan = inner_table->scan();
+    block_loaded = false;
+    has_inner_row = false;
+    block_index = 0;
+    tile_mask = 0;
+    tile_start = 0;
+}
+
+template <typename T, typename Compare>
+NestedLoopStream<T, Compare>::~NestedLoopStream() {
+    delete outer_scan;
+    delete inner_scan;
+}
+
+template <typename T, typename Compare>
+bool NestedLoopStream<T, Compare>::loadBlock() {
+    block_keys.clear();
+    block_positions.clear();
+
+    while (block_keys.size() < block_rows && outer_scan->next()) {
+        block_keys.push_back(outer_scan->getKey<T>(outer_column_position));
+        block_positions.push_back(outer_scan->getRegistryPosition());
+    }
+
+    inner_scan->rewind();
+    block_loaded = !block_keys.empty();
+    return block_loaded;
+}
+
+template <typename T, typename Compare>
+bool NestedLoopStream<T, Compare>::next(JoinBatch & batch) {
+    batch.clear();
+
+    while (!batch.isFull()) {
+        if (!has_inner_row) {
+            if (!block_loaded || !inner_scan->next()) {
+                if (!loadBlock()) break;
+                continue;
+            }
+            inner_key = inner_scan->getKey<T>(inner_column_position);
+            inner_position = inner_scan->getRegistryPosition();
+            has_inner_row = true;
+            block_index = 0;
+        }
+
+        const T * keys = block_keys.data();
+        size_t block_size = block_keys.size();
+        while (!batch.isFull()) {
+            if (tile_mask == 0) {
+                if (block_index == block_size) break;
+                size_t tile_size = min(TILE_SIZE, block_size - block_index);
+                tile_mask = TileCompare<T, Compare>::match(keys + block_index, tile_size, inner_key);
+                tile_start = block_index;
+                block_index += tile_size;
+                continue;
+            }
+            size_t match = tile_start + __builtin_ctzll(tile_mask);
+            tile_mask &= tile_mask - 1;
+            if (swapped) {
+                batch.add(inner_position, block_positions[match]);
+            } else {
+                batch.add(block_positions[match], inner_position);
+            }
+        }
+        if (tile_mask == 0 && block_index == block_size) {
+            has_inner_row = false;
+        }
+    }
+    return batch.size() > 0;
+}
+
+template <typename T>
+JoinStream * createNestedLoopStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                                    JoinComparator comparator, JoinOptions & options) {
+    // The smaller table is the outer one, so the bigger is scanned fewer times
+    bool swapped = other_table->getNumberOfRows() < this_table->getNumberOfRows();
+    Queryable *outer_table = swapped ? other_table : this_table;
+    Queryable *inner_table = swapped ? this_table : other_table;
+    int outer_column_position = swapped ? other_column_position : this_column_position;
+    int inner_column_position = swapped ? this_column_position : other_column_position;
+    long long budget = options.memory_budget;
+
+    switch (swapped ? flip(comparator) : comparator) {
+        case EQUAL         : return new NestedLoopStream<T, equal_to<T> >(outer_table, outer_column_position, inner_table, inner_column_position, swapped, budget);
+        case NOT_EQUAL     : return new NestedLoopStream<T, not_equal_to<T> >(outer_table, outer_column_position, inner_table, inner_column_position, swapped, budget);
+        case LESS          : return new NestedLoopStream<T, less<T> >(outer_table, outer_column_position, inner_table, inner_column_position, swapped, budget);
+        case LESS_EQUAL    : return new NestedLoopStream<T, less_equal<T> >(outer_table, outer_column_position, inner_table, inner_column_position, swapped, budget);
+        case GREATER       : return new NestedLoopStream<T, greater<T> >(outer_table, outer_column_position, inner_table, inner_column_position, swapped, budget);
+        default            : return new NestedLoopStream<T, greater_equal<T> >(outer_table, outer_column_position, inner_table, inner_column_position, swapped, budget);
+    }
+}
+
+/*****************************************
+ ************** SWEEP JOIN ***************
+ *****************************************/
+
+/**
+ * Offsets of a BAND, in the type of the key. Integer keys round the bounds
+ * inward.
+ */
+inline void toBandOffset(double lower, double upper, long long & lower_offset, long long & upper_offset) {
+    lower_offset = (long long) ceil(lower);
+    upper_offset = (long long) floor(upper);
+}
+
+inline void toBandOffset(double lower, double upper, double & lower_offset, double & upper_offset) {
+    lower_offset = lower;
+    upper_offset = upper;
+}
+
+template <typename T>
+SweepJoinStream<T>::SweepJoinStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                                    JoinComparator comparator, JoinOptions & options) {
+    // The inner table is held whole, so it is the smaller one
+    swapped = this_table->getNumberOfRows() < other_table->getNumberOfRows();
+    Queryable *outer_table = swapped ? other_table : this_table;
+    Queryable *inner_table = swapped ? this_table : other_table;
+    int outer_column_position = swapped ? other_column_position : this_column_position;
+    int inner_column_position = swapped ? this_column_position : other_column_position;
+
+    setBounds(swapped ? flip(comparator) : comparator);
+
+    KeyKind key_kind = getKeyKind(this_table->getSchema().getCols()->at(this_column_position).type,
+                                  other_table->getSchema().getCols()->at(other_column_position).type);
+    SortedColumn<T> inner(inner_table, inner_column_position, key_kind, options.memory_budget / 2, options.threads);
+    inner_keys.reserve(inner_table->getNumberOfRows());
+    inner_positions.reserve(inner_table->getNumberOfRows());
+    T key;
+    long long registry_position;
+    while (inner.next(key, registry_position)) {
+        inner_keys.push_back(key);
+        inner_positions.push_back(registry_position);
+    }
+
+    outer = new SortedColumn<T>(outer_table, outer_column_position, key_kind, options.memory_budget / 2, options.threads);
+    lower = upper = match = 0;
+}
+
+template <typename T>
+SweepJoinStream<T>::~SweepJoinStream() {
+    delete outer;
+}
+
+template <typename T>
+void SweepJoinStream<T>::setBounds(JoinComparator comparator) {
+    // Bounds on the inner key, given outer comparator inner
+    has_lower = comparator == LESS || comparator == LESS_EQUAL || comparator == EQUAL || comparator == BAND;
+    has_upper = comparator == GREATER || comparator == GREATER_EQUAL || comparator == EQUAL || comparator == BAND;
+    lower_inclusive = comparator != LESS;
+    upper_inclusive = comparator != GREATER;
+    lower_offset = upper_offset = T();
+}
+
+template <typename T>
+bool SweepJoinStream<T>::next(JoinBatch & batch) {
+    batch.clear();
+
+    while (!batch.isFull()) {
+        if (match == upper) {
+            T outer_key;
+            if (!outer->next(outer_key, outer_position)) break;
+
+            size_t size = inner_keys.size();
+            if (has_lower) {
+                const T bound = outer_key + lower_offset;
+                while (lower < size && (lower_inclusive ? inner_keys[lower] < bound : !(bound < inner_keys[lower]))) {
+                    lower++;
+                }
+            }
+            if (has_upper) {
+                const T bound = outer_key + upper_offset;
+                upper = max(upper, lower);
+                while (upper < size && (upper_inclusive ? !(bound < inner_keys[upper]) : inner_keys[upper] < bound)) {
+                    upper++;
+                }
+            } else {
+                upper = size;
+            }
+            match = lower;
+            continue;
+        }
+
+        for (; match < upper && !batch.isFull(); match++) {
+            if (swapped) {
+                batch.add(inner_positions[match], outer_position);
+            } else {
+                batch.add(outer_position, inner_positions[match]);
+            }
+        }
+    }
+    return batch.size() > 0;
+}
+
+template <typename T>
+BandJoinStream<T>::BandJoinStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                                  JoinOptions & options)
+    : SweepJoinStream<T>(this_table, this_column_position, other_table, other_column_position, BAND, options) {
+    // this - other in [-upper, -lower]  <=>  other - this in [lower, upper]
+    if (this->swapped) {
+        toBandOffset(-options.band_upper, -options.band_lower, this->lower_offset, this->upper_offset);
+    } else {
+        toBandOffset(options.band_lower, options.band_upper, this->lower_offset, this->upper_offset);
+    }
+}
+
+/*****************************************
+ *************** HASH JOIN ***************
+ *****************************************/
+
+template <typename T>
+HashJoinStream<T>::HashJoinStream(Queryable *build_table, int build_column_position, Queryable *probe_table, int probe_column_position,
+                                  JoinOptions & options, BloomFilterStatistics *bloom_statistics, bool swapped) {
+    this->probe_column_position = probe_column_position;
+    this->swapped = swapped;
+    this->bloom_statistics = bloom_statistics;
+    this->probed_rows = probe_table->getNumberOfRows();
+    this->false_positives = 0;
+    this->filter = NULL;
+
+    hash_table.reserve(build_table->getNumberOfRows());
+    if (options.bloom_filter) {
+        filter = new BloomFilter(build_table->getNumberOfRows(), options.bloom_false_positive_rate);
+    }
+
+    Scanner *build_scan = build_table->scan();
+    while (build_scan->next()) {
+        T key = build_scan->getKey<T>(build_column_position);
+        hash_table.insert(make_pair(key, build_scan->getRegistryPosition()));
+        if (filter != NULL) {
+            filter->add(hashKey(key));
+        }
+    }
+    delete build_scan;
+
+    probe_scan = probe_table->scan();
+    if (filter != NULL) {
+        KeyKind key_kind = getKeyKind(build_table->getSchema().getCols()->at(build_column_position).type,
+                                      probe_table->getSchema().getCols()->at(probe_column_position).type);
+        probe_scan->setFilter(filter, probe_column_position, key_kind);
+    }
+    match = match_end = hash_table.end();
+}
+
+template <typename T>
+HashJoinStream<T>::~HashJoinStream() {
+    delete probe_scan;
+    delete filter;
+}
+
+template <typename T>
+void HashJoinStream<T>::finish() {
+    if (filter != NULL && !bloom_statistics->used) {
+        bloom_statistics->used = true;
+        bloom_statistics->filter_bytes = filter->getSizeInBytes();
+        bloom_statistics->probed_rows = probed_rows;
+        bloom_statistics->eliminated_rows = probe_scan->getFilteredRows();
+        bloom_statistics->false_positives = false_positives;
+        bloom_statistics->expected_false_positive_rate = filter->getExpectedFalsePositiveRate();
+    }
+}
+
+template <typename T>
+bool HashJoinStream<T>::next(JoinBatch & batch) {
+    batch.clear();
+
+    while (!batch.isFull()) {
+        if (match == match_end) {
+            if (!probe_scan->next()) {
+                finish();
+                break;
+            }
+            probe_position = probe_scan->getRegistryPosition();
+            pair<typename hash_table_t::iterator, typename hash_table_t::iterator> matches =
+                hash_table.equal_range(probe_scan->getKey<T>(probe_column_position));
+            match = matches.first;
+            match_end = matches.second;
+            if (match == match_end) {
+                false_positives++;
+            }
+            continue;
+        }
+        if (swapped) {
+            batch.add(probe_position, match->second);
+        } else {
+            batch.add(match->second, probe_position);
+        }
+        match++;
+    }
+    return batch.size() > 0;
+}
+
+/*****************************************
+ ********** INDEX NESTED LOOP ************
+ *****************************************/
+
+IndexNestedLoopStream::IndexNestedLoopStream(Queryable *index_table, Queryable *probe_table, int probe_column_position, bool swapped) {
+    this->index = index_table->getHeader();
+    this->probe_scan = probe_table->scan();
+    this->probe_column_position = probe_column_position;
+    this->swapped = swapped;
+    match = match_end = index->end();
+}
+
+IndexNestedLoopStream::~IndexNestedLoopStream() {
+    delete probe_scan;
+}
+
+bool IndexNestedLoopStream::canUseIndex(int column_position, KeyKind key_kind) {
+    // Column 0 is _id, the key of the header
+    return column_position == 0 && key_kind == INTEGER_KEY;
+}
+
+bool IndexNestedLoopStream::next(JoinBatch & batch) {
+    batch.clear();
+
+    while (!batch.isFull()) {
+        if (match == match_end) {
+            if (!probe_scan->next()) break;
+            probe_position = probe_scan->getRegistryPosition();
+
+            long long key = probe_scan->getInt(probe_column_position);
+            match = lower_bound(index->begin(), index->end(), make_pair(key, numeric_limits<long long>::min()));
+            match_end = match;
+            while (match_end != index->end() && match_end->first == key) {
+                match_end++;
+            }
+            continue;
+        }
+        if (swapped) {
+            batch.add(probe_position, match->second);
+        } else {
+            batch.add(match->second, probe_position);
+        }
+        match++;
+    }
+    return batch.size() > 0;
+}
+
+/*****************************************
+ ************ RADIX HASH JOIN ************
+ *****************************************/
+
+template <typename T>
+RadixHashJoinStream<T>::RadixHashJoinStream(Queryable *build_table, int build_column_position, Queryable *probe_table, int probe_column_position,
+                                            bool swapped) {
+    this->swapped = swapped;
+
+    // About 256 KB of build entries per partition
+    long long build_bytes = (long long) build_table->getNumberOfRows() * getEntrySize() / 2;
+    int partition_bits = 0;
+    while (partition_bits < 12 && (build_bytes >> partition_bits) > (256LL << 10)) {
+        partition_bits++;
+    }
+    build_partitions.resize(1 << partition_bits);
+    probe_partitions.resize(1 << partition_bits);
+
+    partitionTable(build_table, build_column_position, build_partitions);
+    partitionTable(probe_table, probe_column_position, probe_partitions);
+
+    partition = 0;
+    build();
+}
+
+template <typename T>
+long long RadixHashJoinStream<T>::getEntrySize() {
+    // Build and probe entries, plus the head and chain links of a build entry
+    return 2 * sizeof(Entry) + 2 * sizeof(int);
+}
+
+template <typename T>
+void RadixHashJoinStream<T>::partitionTable(Queryable *table, int column_position, vector<vector<Entry> > & partitions) {
+    size_t partition_mask = partitions.size() - 1;
+    Scanner *scan = table->scan();
+    while (scan->next()) {
+        Entry entry;
+        entry.key = scan->getKey<T>(column_position);
+        entry.registry_position = scan->getRegistryPosition();
+        entry.hash = hashKey(entry.key);
+        partitions[entry.hash & partition_mask].push_back(entry);
+    }
+    delete scan;
+}
+
+template <typename T>
+void RadixHashJoinStream<T>::build() {
+    probe_index = 0;
+    match = -1;
+    if (partition >= build_partitions.size()) return;
+
+    vector<Entry> & entries = build_partitions[partition];
+    size_t buckets = 1;
+    while (buckets < entries.size()) {
+        buckets <<= 1;
+    }
+    bucket_mask = buckets - 1;
+    heads.assign(buckets, -1);
+    chain.resize(entries.size());
+
+    // The partition bits are the low ones, buckets use the high ones
+    for (int i = entries.size() - 1; i >= 0; i--) {
+        size_t bucket = (entries[i].hash >> 32) & bucket_mask;
+        chain[i] = heads[bucket];
+        heads[bucket] = i;
+    }
+}
+
+template <typename T>
+bool RadixHashJoinStream<T>::next(JoinBatch & batch) {
+    batch.clear();
+
+    while (!batch.isFull() && partition < build_partitions.size()) {
+        vector<Entry> & build_entries = build_partitions[partition];
+        vector<Entry> & probe_entries = probe_partitions[partition];
+
+        if (match < 0) {
+            if (probe_index >= probe_entries.size() || build_entries.empty()) {
+                vector<Entry>().swap(build_entries);
+                vector<Entry>().swap(probe_entries);
+                partition++;
+                build();
+                continue;
+            }
+            match = heads[(probe_entries[probe_index].hash >> 32) & bucket_mask];
+        }
+
+        Entry & probe = probe_entries[probe_index];
+        for (; match >= 0 && !batch.isFull(); match = chain[match]) {
+            Entry & entry = build_entries[match];
+            if (entry.hash == probe.hash && entry.key == probe.key) {
+                if (swapped) {
+                    batch.add(probe.registry_position, entry.registry_position);
+                } else {
+                    batch.add(entry.registry_position, probe.registry_position);
+                }
+            }
+        }
+        if (match < 0) {
+            probe_index++;
+        }
+    }
+    return batch.size() > 0;
+}
+
+/*****************************************
+ ********** DIRECT ADDRESS JOIN **********
+ *****************************************/
+
+// At least one key in DENSE_KEY_FACTOR of the range is present
+const long long DENSE_KEY_FACTOR = 4;
+
+DirectJoinStream::DirectJoinStream(Queryable *build_table, int build_column_position, Queryable *probe_table, int probe_column_position,
+                                   bool swapped) {
+    this->probe_column_position = probe_column_position;
+    this->swapped = swapped;
+
+    vector<long long> keys;
+    vector<long long> build_positions;
+    keys.reserve(build_table->getNumberOfRows());
+    build_positions.reserve(build_table->getNumberOfRows());
+
+    min_key = numeric_limits<long long>::max();
+    long long max_key = numeric_limits<long long>::min();
+    Scanner *build_scan = build_table->scan();
+    while (build_scan->next()) {
+        long long key = build_scan->getInt(build_column_position);
+        keys.push_back(key);
+        build_positions.push_back(build_scan->getRegistryPosition());
+        min_key = min(min_key, key);
+        max_key = max(max_key, key);
+    }
+    delete build_scan;
+
+    range = keys.empty() ? 0 : (unsigned long long) max_key - (unsigned long long) min_key + 1;
+
+    unique = true;
+    positions.assign(range, -1);
+    for (size_t i = 0; i < keys.size() && unique; i++) {
+        long long & slot = positions[keys[i] - min_key];
+        unique = slot < 0;
+        slot = build_positions[i];
+    }
+
+    if (!unique) {
+        offsets.assign(range + 1, 0);
+        for (size_t i = 0; i < keys.size(); i++) {
+            offsets[keys[i] - min_key + 1]++;
+        }
+        for (unsigned long long k = 0; k < range; k++) {
+            offsets[k + 1] += offsets[k];
+        }
+        positions.resize(keys.size());
+        vector<unsigned> next(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < keys.size(); i++) {
+            positions[next[keys[i] - min_key]++] = build_positions[i];
+        }
+    }
+
+    probe_scan = probe_table->scan();
+    match = match_end = 0;
+}
+
+DirectJoinStream::~DirectJoinStream() {
+    delete probe_scan;
+}
+
+bool DirectJoinStream::isDense(ColumnStatistics & statistics, long long memory_budget) {
+    if (!statistics.has_integer_range) {
+        return false;
+    }
+    unsigned long long range = (unsigned long long) statistics.max_integer - (unsigned long long) statistics.min_integer + 1;
+    return range != 0 && range <= (unsigned long long) statistics.number_of_rows * DENSE_KEY_FACTOR &&
+           range * sizeof(long long) <= (unsigned long long) memory_budget;
+}
+
+bool DirectJoinStream::next(JoinBatch & batch) {
+    batch.clear();
+
+    while (!batch.isFull()) {
+        if (match == match_end) {
+            if (!probe_scan->next()) break;
+            probe_position = probe_scan->getRegistryPosition();
+
+            // Keys below min_key wrap around to above range
+            unsigned long long k = (unsigned long long) probe_scan->getInt(probe_column_position) - (unsigned long long) min_key;
+            if (k >= range) continue;
+            if (unique) {
+                match = k;
+                match_end = positions[k] < 0 ? k : k + 1;
+            } else {
+                match = offsets[k];
+                match_end = offsets[k + 1];
+            }
+            continue;
+        }
+        if (swapped) {
+            batch.add(probe_position, positions[match]);
+        } else {
+            batch.add(positions[match], probe_position);
+        }
+        match++;
+    }
+    return batch.size() > 0;
+}
+
+/*****************************************
+ ************* ADAPTIVE JOIN *************
+ *****************************************/
+
+// The build side is tiny once the other side has this many times its rows
+const long long ADAPTIVE_INDEX_FACTOR = 16;
+
+long long toIndexKey(long long key) {
+    return key;
+}
+
+long long toIndexKey(double key) {
+    return (long long) key;
+}
+
+long long toIndexKey(const string & key) {
+    return atoll(key.c_str());
+}
+
+template <typename T>
+AdaptiveJoinStream<T>::AdaptiveJoinStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                                          JoinOptions & options, AdaptiveJoinStatistics *statistics) {
+    this->memory_budget = options.memory_budget;
+    this->statistics = statistics;
+    this->probe_scan = NULL;
+    this->partition = 0;
+    this->chunk_loaded = false;
+    this->build_exhausted = false;
+    this->hash_table_bytes = 0;
+    statistics->used = true;
+
+    // The row counts may be stale, they only choose where to start
+    swapped = other_table->getNumberOfRows() < this_table->getNumberOfRows();
+    Queryable *build_table = swapped ? other_table : this_table;
+    Queryable *probe_table = swapped ? this_table : other_table;
+    int build_column_position = swapped ? other_column_position : this_column_position;
+    probe_column_position = swapped ? this_column_position : other_column_position;
+    record(string("hash ") + (swapped ? "other_table" : "this_table") + ", estimated smaller");
+
+    phase = PROBE;
+    Scanner *build_scan = build_table->scan();
+    while (build_scan->next()) {
+        T key = build_scan->getKey<T>(build_column_position);
+        long long position = build_scan->getRegistryPosition();
+        statistics->build_rows++;
+
+        if (phase == GRACE) {
+            build_partitions[(hashKey(key) >> 32) % build_partitions.size()]->write(make_pair(key, position));
+            continue;
+        }
+        hash_table.insert(make_pair(key, position));
+        hash_table_bytes += entryBytes(key) + HASH_NODE_BYTES;
+
+        if (hash_table_bytes > memory_budget) {
+            ostringstream message;
+            message << "hash table over the memory budget after " << statistics->build_rows << " rows";
+            record(message.str());
+            spill(probe_table);
+        }
+    }
+    delete build_scan;
+
+    if (phase == GRACE) {
+        // The probe side goes to partitions too, then both are read back
+        Scanner *scan = probe_table->scan();
+        while (scan->next()) {
+            T key = scan->getKey<T>(probe_column_position);
+            probe_partitions[(hashKey(key) >> 32) % probe_partitions.size()]->write(make_pair(key, scan->getRegistryPosition()));
+        }
+        delete scan;
+        for (size_t p = 0; p < build_partitions.size(); p++) {
+            build_partitions[p]->finishWriting();
+            probe_partitions[p]->finishWriting();
+        }
+        match = match_end = hash_table.end();
+        return;
+    }
+
+    KeyKind key_kind = getKeyKind(this_table->getSchema().getCols()->at(this_column_position).type,
+                                  other_table->getSchema().getCols()->at(other_column_position).type);
+    if (IndexNestedLoopStream::canUseIndex(probe_column_position, key_kind) &&
+        statistics->build_rows * ADAPTIVE_INDEX_FACTOR <= probe_table->getNumberOfRows()) {
+        ostringstream message;
+        message << "build side has only " << statistics->build_rows << " rows, looking them up in the _id index";
+        record(message.str());
+        phase = INDEX;
+        index = probe_table->getHeader();
+        build_row = hash_table.begin();
+        index_match = index_match_end = index->end();
+        return;
+    }
+
+    probe_scan = probe_table->scan();
+    match = match_end = hash_table.end();
+}
+
+template <typename T>
+AdaptiveJoinStream<T>::~AdaptiveJoinStream() {
+    delete probe_scan;
+    for (size_t p = 0; p < build_partitions.size(); p++) {
+        delete build_partitions[p];
+        delete probe_partitions[p];
+    }
+}
+
+template <typename T>
+void AdaptiveJoinStream<T>::record(const string & message) {
+    statistics->switches.push_back(message);
+}
+
+template <typename T>
+void AdaptiveJoinStream<T>::spill(Queryable *probe_table) {
+    // Enough partitions for each to fit in memory, if the estimate was right
+    long long rows = max((long long) probe_table->getNumberOfRows(), statistics->build_rows * 2);
+    long long bytes_per_row = hash_table_bytes / statistics->build_rows;
+    long long partitions = 2 * rows * bytes_per_row / memory_budget + 1;
+    partitions = max(2LL, min(partitions, 64LL));
+    statistics->partitions = partitions;
+
+    ostringstream message;
+    message << "Grace partitioning into " << partitions << " partitions";
+    record(message.str());
+
+    int id = nextSpillId();
+    for (int p = 0; p < partitions; p++) {
+        ostringstream build_path, probe_path;
+        build_path << "grace_" << id << "_build_" << p << ".tmp";
+        probe_path << "grace_" << id << "_probe_" << p << ".tmp";
+        build_partitions.push_back(new RunFile<T>(build_path.str()));
+        probe_partitions.push_back(new RunFile<T>(probe_path.str()));
+    }
+
+    for (typename hash_table_t::iterator it = hash_table.begin(); it != hash_table.end(); it++) {
+        build_partitions[(hashKey(it->first) >> 32) % partitions]->write(*it);
+    }
+    hash_table_t().swap(hash_table);
+    hash_table_bytes = 0;
+    phase = GRACE;
+}
+
+template <typename T>
+bool AdaptiveJoinStream<T>::loadChunk() {
+    // A partition bigger than the budget is built a chunk at a time, its
+    // probe side being read once per chunk
+    hash_table.clear();
+    hash_table_bytes = 0;
+
+    while (partition < build_partitions.size()) {
+        if (build_exhausted) {
+            delete build_partitions[partition];
+            delete probe_partitions[partition];
+            build_partitions[partition] = probe_partitions[partition] = NULL;
+            partition++;
+            build_exhausted = false;
+            continue;
+        }
+
+        pair<T, long long> entry;
+        while (hash_table_bytes <= memory_budget) {
+            if (!build_partitions[partition]->read(entry)) {
+                build_exhausted = true;
+                break;
+            }
+            hash_table.insert(entry);
+            hash_table_bytes += entryBytes(entry.first) + HASH_NODE_BYTES;
+        }
+        if (hash_table.empty()) continue;
+
+        if (!build_exhausted) {
+            ostringstream message;
+            message << "partition " << partition << " over the memory budget, built in chunks";
+            if (statistics->switches.back() != message.str()) {
+                record(message.str());
+            }
+        }
+        probe_partitions[partition]->rewind();
+        return true;
+    }
+    return false;
+}
+
+template <typename T>
+bool AdaptiveJoinStream<T>::next(JoinBatch & batch) {
+    batch.clear();
+
+    while (!batch.isFull() && phase != DONE) {
+        if (phase == INDEX) {
+            if (index_match == index_match_end) {
+                if (build_row == hash_table.end()) {
+                    phase = DONE;
+                    break;
+                }
+                long long key = toIndexKey(build_row->first);
+                index_match = lower_bound(index->begin(), index->end(), make_pair(key, numeric_limits<long long>::min()));
+                index_match_end = index_match;
+                while (index_match_end != index->end() && index_match_end->first == key) {
+                    index_match_end++;
+                }
+                probe_position = build_row->second;
+                build_row++;
+                continue;
+            }
+            if (swapped) {
+                batch.add(index_match->second, probe_position);
+            } else {
+                batch.add(probe_position, index_match->second);
+            }
+            index_match++;
+            continue;
+        }
+
+        if (match == match_end) {
+            if (phase == PROBE) {
+                if (!probe_scan->next()) {
+                    phase = DONE;
+                    break;
+                }
+                probe_position = probe_scan->getRegistryPosition();
+                pair<typename hash_table_t::iterator, typename hash_table_t::iterator> matches =
+                    hash_table.equal_range(probe_scan->getKey<T>(probe_column_position));
+                match = matches.first;
+                match_end = matches.second;
+                continue;
+            }
+
+            // GRACE: the probe partition of the chunk in memory
+            pair<T, long long> entry;
+            if (!chunk_loaded || !probe_partitions[partition]->read(entry)) {
+                chunk_loaded = loadChunk();
+                if (!chunk_loaded) {
+                    phase = DONE;
+                    break;
+                }
+                match = match_end = hash_table.end();
+                continue;
+            }
+            probe_position = entry.second;
+            pair<typename hash_table_t::iterator, typename hash_table_t::iterator> matches = hash_table.equal_range(entry.first);
+            match = matches.first;
+            match_end = matches.second;
+            continue;
+        }
+
+        if (swapped) {
+            batch.add(probe_position, match->second);
+        } else {
+            batch.add(match->second, probe_position);
+        }
+        match++;
+    }
+    return batch.size() > 0;
+}
+
+/*****************************************
+ ************** MERGE JOIN ***************
+ *****************************************/
+
+template <typename T>
+MergeJoinStream<T>::MergeJoinStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                                    JoinOptions & options, BloomFilterStatistics *bloom_statistics) {
+    this->bloom_statistics = bloom_statistics;
+    this->probed_rows = other_table->getNumberOfRows();
+    this->unmatched_b = 0;
+
+    KeyKind key_kind = getKeyKind(this_table->getSchema().getCols()->at(this_column_position).type,
+                                  other_table->getSchema().getCols()->at(other_column_position).type);
+
+    // The filter only saves work when it keeps rows out of the other_table sort
+    filter = NULL;
+    if (options.bloom_filter && !SortedColumn<T>::canElideSort(other_table, other_column_position, key_kind)) {
+        filter = new BloomFilter(this_table->getNumberOfRows(), options.bloom_false_positive_rate);
+    }
+
+    table_a = new SortedColumn<T>(this_table, this_column_position, key_kind, options.memory_budget / 2, options.threads, filter, NULL);
+    table_b = new SortedColumn<T>(other_table, other_column_position, key_kind, options.memory_budget / 2, options.threads, NULL, filter);
+
+    has_a = table_a->next(key_a, position_a);
+    has_b = table_b->next(key_b, position_b);
+    in_group = false;
+    group_index = 0;
+}
+
+template <typename T>
+MergeJoinStream<T>::~MergeJoinStream() {
+    delete table_a;
+    delete table_b;
+    delete filter;
+}
+
+template <typename T>
+void MergeJoinStream<T>::finish() {
+    if (filter != NULL && !bloom_statistics->used) {
+        while (has_b) {
+            unmatched_b++;
+            has_b = table_b->next(key_b, position_b);
+        }
+
+        bloom_statistics->used = true;
+        bloom_statistics->filter_bytes = filter->getSizeInBytes();
+        bloom_statistics->probed_rows = probed_rows;
+        bloom_statistics->eliminated_rows = table_b->getFilteredRows();
+        bloom_statistics->false_positives = unmatched_b;
+        bloom_statistics->expected_false_positive_rate = filter->getExpectedFalsePositiveRate();
+    }
+}
+
+template <typename T>
+bool MergeJoinStream<T>::next(JoinBatch & batch) {
+    batch.clear();
+
+    while (!batch.isFull()) {
+        if (in_group) {
+            if (group_index < group.size()) {
+                batch.add(position_a, group[group_index++]);
+                continue;
+            }
+            has_a = table_a->next(key_a, position_a);
+            group_index = 0;
+            in_group = has_a && !(group_key < key_a);
+            continue;
+        }
+
+        if (!has_a || !has_b) {
+            finish();
+            break;
+        }
+
+        if (key_b < key_a) {
+            unmatched_b++;
+            has_b = table_b->next(key_b, position_b);
+        } else if (key_a < key_b) {
+            has_a = table_a->next(key_a, position_a);
+        } else {
+            group_key = key_b;
+            group.clear();
+            while (has_b && !(group_key < key_b)) {
+                group.push_back(position_b);
+                has_b = table_b->next(key_b, position_b);
+            }
+            group_index = 0;
+            in_group = true;
+        }
+    }
+    return batch.size() > 0;
+}
+
+#endif //JOINSTREAM_H
@@ -2,6 +2,10 @@
 // #include "table.h"
 #include "tablebenchmark.h"
 #include "joinbenchmark.h"
+#include "sortbenchmark.h"
+#include "aggregationbenchmark.h"
+#include "querybenchmark.h"
+#include "multijoin.h"
 #include <stdio.h>
 
 using namespace std;
@@ -15,7 +19,6 @@ int main() {
         person_table.convertFromCSV("person.csv");
     person_table.print(5);
     person_table.printHeaderFile(5);
-    // // Cursor cursor = person_table.query("SELECT *");
     
     // TableBenchmark benchmark(&person_table);
     // benchmark.runBenchmark();
@@ -34,9 +37,55 @@ int main() {
     worked_table.print(5);
     worked_table.printHeaderFile(5);
     
+    cout << "\nSELECT p.nome, c.name FROM person p JOIN worked w ON p._id = w.person_id JOIN company c ON c._id = w.company_id WHERE p._id < 5" << endl;
+    Cursor cursor = person_table.query("SELECT p.nome, c.name FROM person p JOIN worked w ON p._id = w.person_id "
+                                       "JOIN company c ON c._id = w.company_id WHERE p._id < 5");
+    if (!cursor.getError().empty()) {
+        cout << "Query failed: " << cursor.getError() << endl;
+    }
+    int nome = cursor.getColumnIndex("p.nome");
+    int name = cursor.getColumnIndex("c.name");
+    for (bool row = cursor.moveToFirst(); row; row = cursor.moveToNext()) {
+        cout << cursor.getString(nome) << " | " << cursor.getString(name) << " | " << endl;
+    }
+    
+    person_table.createIndex("dre");
+    cout << "\nEXPLAIN SELECT nome FROM person WHERE dre BETWEEN 100 AND 110" << endl;
+    Cursor plan = person_table.query("EXPLAIN SELECT nome FROM person WHERE dre BETWEEN 100 AND 110");
+    while (plan.moveToNext()) {
+        cout << plan.getString("plan") << endl;
+    }
+    
+    cout << "\nEXPLAIN ANALYZE SELECT p.nome, c.name FROM person p JOIN worked w ON p._id = w.person_id JOIN company c ON c._id = w.company_id" << endl;
+    Cursor analyzed = person_table.query("EXPLAIN ANALYZE SELECT p.nome, c.name FROM person p JOIN worked w ON p._id = w.person_id "
+                                         "JOIN company c ON c._id = w.company_id");
+    while (analyzed.moveToNext()) {
+        cout << analyzed.getString("plan") << endl;
+    }
+    
     JoinBenchmark joinbenchmark(&person_table, "_id", &worked_table, "person_id");
     joinbenchmark.runBenchmark();
     
+    AggregationBenchmark aggregationbenchmark(&person_table, &worked_table);
+    aggregationbenchmark.runBenchmark();
+    
+    QueryBenchmark querybenchmark(&person_table, &worked_table);
+    querybenchmark.runBenchmark();
+    
+    // SortBenchmark sortbenchmark;
+    // sortbenchmark.runBenchmark();
+    
+    cout << "\nPerson x Worked x Company" << endl;
+    MultiJoin report;
+    report.addTable(&person_table);
+    report.addTable(&worked_table);
+    report.addTable(&company_table);
+    report.addCondition(&person_table, "_id", &worked_table, "person_id");
+    report.addCondition(&company_table, "_id", &worked_table, "company_id");
+    report.printPlan();
+    report.print(20);
+    if (!report.getError().empty()) cout << report.getError() << endl;
+    
     //cout << "\nNested index join" << endl;
     //Join nested_index_join_result = person_table.join("_id", &worked_table, "person_id", JoinType::NESTED_INDEX);
     //nested_index_join_result.print(20);
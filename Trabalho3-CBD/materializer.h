@@ -0,0 +1,191 @@
+#ifndef MATERIALIZER_H
+#define MATERIALIZER_H
+
+#include <algorithm>
+
+#include "util.h"
+#include "queryable.h"
+#include "scanner.h"
+
+/**
+ * Output stream that collects text in memory and hands it to the underlying
+ * stream in large writes, instead of one write (and flush, with endl) per line.
+ */
+class BufferedWriter {
+private:
+    ostream & out;
+    string buffer;
+    size_t buffer_size;
+
+public:
+    /**
+     * @constructor
+     */
+    BufferedWriter(ostream & out, size_t buffer_size = 1 << 16);
+
+    /**
+     * @destructor
+     */
+    ~BufferedWriter();
+
+    void write(const string & text);
+    void write(char character);
+    void flush();
+};
+
+BufferedWriter::BufferedWriter(ostream & out, size_t buffer_size) : out(out) {
+    this->buffer_size = buffer_size;
+    buffer.reserve(buffer_size);
+}
+
+BufferedWriter::~BufferedWriter() {
+    flush();
+}
+
+void BufferedWriter::write(const string & text) {
+    buffer.append(text);
+    if (buffer.size() >= buffer_size) {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
+
+void BufferedWriter::write(char character) {
+    buffer.push_back(character);
+    if (buffer.size() >= buffer_size) {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
+
+void BufferedWriter::flush() {
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+    out.flush();
+}
+
+/**
+ * Late materialization of join output: tuples of registry positions (one per
+ * table) are collected in windows, and for each window every table is read
+ * once in file order, decoding each distinct registry a single time. The
+ * rows are then written in the order the tuples came in.
+ *
+ *     LateMaterializer materializer(tables, cout);
+ *     while (...) materializer.add(registry_positions);
+ *     materializer.flush();
+ */
+class LateMaterializer {
+private:
+    vector<Queryable*> tables;
+    vector<Scanner*> scans;
+    BufferedWriter writer;
+    size_t window_size;
+
+    // [table][tuple] registry positions of the current window
+    vector<vector<long long> > positions;
+    size_t number_of_tuples;
+
+    // [table] distinct positions of the window, sorted, and their rows
+    vector<vector<long long> > fetched_positions;
+    vector<vector<string> > fetched_rows;
+
+    void fetch(int table);
+
+public:
+    /**
+     * @constructor
+     * @param window_size tuples held before their rows are fetched
+     */
+    LateMaterializer(vector<Queryable*> tables, ostream & out, size_t window_size = 1 << 16);
+
+    /**
+     * @destructor
+     */
+    ~LateMaterializer();
+
+    /**
+     * @param registry_positions one per table, in the order of tables
+     */
+    void add(const long long * registry_positions);
+
+    /**
+     * Writes the rows of every tuple added so far.
+     */
+    void flush();
+};
+
+LateMaterializer::LateMaterializer(vector<Queryable*> tables, ostream & out, size_t window_size) : writer(out) {
+    this->tables = tables;
+    this->window_size = window_size;
+    this->number_of_tuples = 0;
+
+    positions.resize(tables.size());
+    fetched_positions.resize(tables.size());
+    fetched_rows.resize(tables.size());
+    for (size_t t = 0; t < tables.size(); t++) {
+        scans.push_back(tables[t]->scan());
+        positions[t].reserve(window_size);
+    }
+}
+
+LateMaterializer::~LateMaterializer() {
+    flush();
+    for (size_t t = 0; t < scans.size(); t++) {
+        delete scans[t];
+    }
+}
+
+void LateMaterializer::add(const long long * registry_positions) {
+    for (size_t t = 0; t < tables.size(); t++) {
+        positions[t].push_back(registry_positions[t]);
+    }
+    number_of_tuples++;
+    if (number_of_tuples == window_size) {
+        flush();
+    }
+}
+
+void LateMaterializer::fetch(int table) {
+    vector<long long> & distinct = fetched_positions[table];
+    distinct = positions[table];
+    sort(distinct.begin(), distinct.end());
+    distinct.erase(unique(distinct.begin(), distinct.end()), distinct.end());
+
+    // The row is kept already formatted, it is written as is for every tuple
+    vector<string> & rows = fetched_rows[table];
+    rows.assign(distinct.size(), string());
+    Scanner * scan = scans[table];
+    int number_of_columns = tables[table]->getSchema().getCols()->size();
+    for (size_t i = 0; i < distinct.size(); i++) {
+        if (!scan->fetch(distinct[i])) continue;
+        for (int column = 0; column < number_of_columns; column++) {
+            rows[i].append(scan->getString(column));
+            rows[i].append(" | ");
+        }
+    }
+}
+
+void LateMaterializer::flush() {
+    if (number_of_tuples > 0) {
+        for (size_t t = 0; t < tables.size(); t++) {
+            fetch(t);
+        }
+
+        for (size_t i = 0; i < number_of_tuples; i++) {
+            for (size_t t = 0; t < tables.size(); t++) {
+                vector<long long> & distinct = fetched_positions[t];
+                size_t row = lower_bound(distinct.begin(), distinct.end(), positions[t][i]) - distinct.begin();
+                writer.write(fetched_rows[t][row]);
+            }
+            writer.write('\n');
+        }
+
+        for (size_t t = 0; t < tables.size(); t++) {
+            positions[t].clear();
+        }
+        number_of_tuples = 0;
+    }
+    writer.flush();
+}
+
+#endif //MATERIALIZER_H
@@ -0,0 +1,421 @@
+#ifndef MULTIJOIN_H
+#define MULTIJOIN_H
+
+#include <unordered_map>
+
+#include "util.h"
+#include "queryable.h"
+#include "scanner.h"
+#include "typedkey.h"
+#include "materializer.h"
+#include "joinstream.h"
+
+/**
+ * Equi-join of any number of tables, pipelined: the biggest table is
+ * scanned once and each of its rows probes in-memory hash tables of the
+ * others, one after the other, so tuples of registry positions come out as
+ * they are found and no intermediate result is materialized.
+ *
+ *     MultiJoin report;
+ *     report.addTable(&person_table);
+ *     report.addTable(&worked_table);
+ *     report.addTable(&company_table);
+ *     report.addCondition(&person_table, "_id", &worked_table, "person_id");
+ *     report.addCondition(&company_table, "_id", &worked_table, "company_id");
+ *     report.print(20);
+ *
+ * The hash tables must fit in JoinOptions::memory_budget together; if they
+ * do not, open() fails and getError() says which table went over.
+ */
+class MultiJoin {
+private:
+
+    struct Condition {
+        int left_table;
+        int left_column_position;
+        int right_table;
+        int right_column_position;
+        KeyKind key_kind;
+    };
+
+    // Column values a table has to provide to the steps after it
+    struct CarriedColumn {
+        int column_position;
+        KeyKind key_kind;
+    };
+
+    struct BuiltRow {
+        long long registry_position;
+        vector<TypedKey> carried;
+    };
+
+    typedef unordered_multimap<TypedKey, BuiltRow, TypedKeyHash> hash_table_t;
+
+    // Join of one more table onto the ones already bound
+    struct Step {
+        int table;
+        int column_position;
+        int probe_table;
+        int probe_carried;
+        KeyKind key_kind;
+        // (table, carried) pairs that must be equal once this table is bound
+        vector<pair<pair<int, int>, pair<int, int> > > residuals;
+        hash_table_t * hash_table;
+    };
+
+    vector<Queryable*> tables;
+    vector<Condition> conditions;
+    JoinOptions options;
+    string error;
+
+    bool planned;
+    int driving_table;
+    vector<Step> steps;
+    vector<vector<CarriedColumn> > carried_columns;
+
+    Scanner * driving_scan;
+    vector<TypedKey> driving_carried;
+    vector<BuiltRow*> bound_rows;
+    vector<long long> bound_positions;
+    vector<pair<hash_table_t::iterator, hash_table_t::iterator> > ranges;
+    int depth;
+    long long hash_table_bytes;
+
+    int getTableIndex(Queryable * table);
+    int carry(int table, int column_position, KeyKind key_kind);
+    TypedKey & getCarried(int table, int carried);
+    bool plan();
+    bool build(Step & step);
+
+public:
+    /**
+     * @constructor
+     * @param options only memory_budget is used, for the hash tables
+     */
+    MultiJoin(JoinOptions options = JoinOptions());
+
+    /**
+     * @destructor
+     */
+    ~MultiJoin();
+
+    void addTable(Queryable * table);
+
+    /**
+     * Adds left_table.left_column = right_table.right_column.
+     */
+    void addCondition(Queryable * left_table, string left_column, Queryable * right_table, string right_column);
+
+    /**
+     * Chooses the join order and builds the hash tables.
+     * @return false if the conditions do not connect every table or the
+     *         hash tables do not fit in the memory budget, see getError()
+     */
+    bool open();
+
+    /**
+     * @param registry_positions filled with one position per table, in the
+     *        order the tables were added
+     * @return false when there are no more tuples
+     */
+    bool next(vector<long long> & registry_positions);
+
+    void close();
+
+    void printPlan();
+
+    void print(int number_of_values = -1);
+
+    /**
+     * @return why the join cannot run, empty if it can. A join that
+     *         cannot run yields no tuples.
+     */
+    string getError();
+};
+
+MultiJoin::MultiJoin(JoinOptions options) {
+    this->options = options;
+    planned = false;
+    driving_scan = NULL;
+    depth = -1;
+    hash_table_bytes = 0;
+}
+
+MultiJoin::~MultiJoin() {
+    close();
+}
+
+void MultiJoin::addTable(Queryable * table) {
+    tables.push_back(table);
+}
+
+int MultiJoin::getTableIndex(Queryable * table) {
+    for (size_t i = 0; i < tables.size(); i++) {
+        if (tables[i] == table) return i;
+    }
+    addTable(table);
+    return tables.size() - 1;
+}
+
+void MultiJoin::addCondition(Queryable * left_table, string left_column, Queryable * right_table, string right_column) {
+    Condition condition;
+    condition.left_table = getTableIndex(left_table);
+    condition.left_column_position = left_table->getSchema().getColPosition(left_column);
+    condition.right_table = getTableIndex(right_table);
+    condition.right_column_position = right_table->getSchema().getColPosition(right_column);
+    condition.key_kind = getKeyKind(left_table->getSchema().getCols()->at(condition.left_column_position).type,
+                                    right_table->getSchema().getCols()->at(condition.right_column_position).type);
+    conditions.push_back(condition);
+}
+
+int MultiJoin::carry(int table, int column_position, KeyKind key_kind) {
+    vector<CarriedColumn> & columns = carried_columns[table];
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (columns[i].column_position == column_position && columns[i].key_kind == key_kind) return i;
+    }
+    CarriedColumn column;
+    column.column_position = column_position;
+    column.key_kind = key_kind;
+    columns.push_back(column);
+    return columns.size() - 1;
+}
+
+bool MultiJoin::plan() {
+    steps.clear();
+    carried_columns.assign(tables.size(), vector<CarriedColumn>());
+    error = "";
+    if (tables.empty()) {
+        error = "MultiJoin: no tables were added";
+        return false;
+    }
+
+    // The biggest table is streamed, the others are held in hash tables.
+    // Ties go to the table in more conditions, usually the fact table.
+    vector<int> number_of_conditions(tables.size(), 0);
+    for (size_t c = 0; c < conditions.size(); c++) {
+        number_of_conditions[conditions[c].left_table]++;
+        number_of_conditions[conditions[c].right_table]++;
+    }
+    driving_table = 0;
+    for (size_t i = 1; i < tables.size(); i++) {
+        long long rows = tables[i]->getNumberOfRows();
+        long long driving_rows = tables[driving_table]->getNumberOfRows();
+        if (rows > driving_rows || (rows == driving_rows && number_of_conditions[i] > number_of_conditions[driving_table])) {
+            driving_table = i;
+        }
+    }
+
+    vector<bool> bound(tables.size(), false);
+    vector<bool> used(conditions.size(), false);
+    bound[driving_table] = true;
+
+    for (size_t added = 1; added < tables.size(); added++) {
+        // Next is the smallest table joined to what is already bound
+        int next_table = -1;
+        int next_condition = -1;
+        for (size_t c = 0; c < conditions.size(); c++) {
+            Condition & condition = conditions[c];
+            int candidate = -1;
+            if (bound[condition.left_table] && !bound[condition.right_table]) candidate = condition.right_table;
+            if (bound[condition.right_table] && !bound[condition.left_table]) candidate = condition.left_table;
+            if (candidate < 0) continue;
+
+            if (next_table < 0 || tables[candidate]->getNumberOfRows() < tables[next_table]->getNumberOfRows()) {
+                next_table = candidate;
+                next_condition = c;
+            }
+        }
+        if (next_table < 0) {
+            error = "MultiJoin: the conditions do not connect every table";
+            return false;
+        }
+
+        Condition & condition = conditions[next_condition];
+        used[next_condition] = true;
+        bool left_is_new = condition.left_table == next_table;
+
+        Step step;
+        step.table = next_table;
+        step.column_position = left_is_new ? condition.left_column_position : condition.right_column_position;
+        step.probe_table = left_is_new ? condition.right_table : condition.left_table;
+        step.key_kind = condition.key_kind;
+        step.probe_carried = carry(step.probe_table,
+                                   left_is_new ? condition.right_column_position : condition.left_column_position,
+                                   condition.key_kind);
+        step.hash_table = NULL;
+        bound[next_table] = true;
+
+        // Any other condition now fully bound is checked on this step
+        for (size_t c = 0; c < conditions.size(); c++) {
+            Condition & other = conditions[c];
+            if (used[c] || !bound[other.left_table] || !bound[other.right_table]) continue;
+            used[c] = true;
+            step.residuals.push_back(make_pair(
+                make_pair(other.left_table, carry(other.left_table, other.left_column_position, other.key_kind)),
+                make_pair(other.right_table, carry(other.right_table, other.right_column_position, other.key_kind))));
+        }
+        steps.push_back(step);
+    }
+    return true;
+}
+
+bool MultiJoin::build(Step & step) {
+    Queryable * table = tables[step.table];
+    vector<CarriedColumn> & columns = carried_columns[step.table];
+
+    step.hash_table = new hash_table_t();
+    step.hash_table->reserve(table->getNumberOfRows());
+    hash_table_bytes += step.hash_table->bucket_count() * sizeof(void*);
+
+    Scanner * scan = table->scan();
+    bool fits = hash_table_bytes <= options.memory_budget;
+    while (fits && scan->next()) {
+        BuiltRow row;
+        row.registry_position = scan->getRegistryPosition();
+        for (size_t i = 0; i < columns.size(); i++) {
+            row.carried.push_back(readTypedKey(scan, columns[i].column_position, columns[i].key_kind));
+            hash_table_bytes += sizeof(TypedKey) + row.carried.back().string_value.capacity();
+        }
+        TypedKey key = readTypedKey(scan, step.column_position, step.key_kind);
+        hash_table_bytes += sizeof(TypedKey) + key.string_value.capacity() + sizeof(BuiltRow) + HASH_NODE_BYTES;
+        step.hash_table->insert(make_pair(key, row));
+        fits = hash_table_bytes <= options.memory_budget;
+    }
+    delete scan;
+
+    if (!fits) {
+        error = "MultiJoin: the hash table of " + table->getName() + " goes over the memory budget of " +
+                describeBytes(options.memory_budget);
+    }
+    return fits;
+}
+
+bool MultiJoin::open() {
+    close();
+    planned = plan();
+    if (!planned) return false;
+
+    hash_table_bytes = 0;
+    for (size_t s = 0; s < steps.size(); s++) {
+        if (!build(steps[s])) {
+            close();
+            return false;
+        }
+    }
+
+    driving_scan = tables[driving_table]->scan();
+    bound_rows.assign(tables.size(), NULL);
+    bound_positions.assign(tables.size(), -1);
+    ranges.resize(steps.size());
+    depth = -1;
+    return true;
+}
+
+void MultiJoin::close() {
+    for (size_t s = 0; s < steps.size(); s++) {
+        delete steps[s].hash_table;
+        steps[s].hash_table = NULL;
+    }
+    delete driving_scan;
+    driving_scan = NULL;
+    planned = false;
+    hash_table_bytes = 0;
+}
+
+TypedKey & MultiJoin::getCarried(int table, int carried) {
+    if (table == driving_table) {
+        return driving_carried[carried];
+    }
+    return bound_rows[table]->carried[carried];
+}
+
+bool MultiJoin::next(vector<long long> & registry_positions) {
+    if (!planned) return false;
+
+    while (true) {
+        if (depth < 0) {
+            if (!driving_scan->next()) {
+                return false;
+            }
+            bound_positions[driving_table] = driving_scan->getRegistryPosition();
+
+            vector<CarriedColumn> & columns = carried_columns[driving_table];
+            driving_carried.clear();
+            for (size_t i = 0; i < columns.size(); i++) {
+                driving_carried.push_back(readTypedKey(driving_scan, columns[i].column_position, columns[i].key_kind));
+            }
+
+            if (steps.empty()) {
+                registry_positions = bound_positions;
+                return true;
+            }
+            depth = 0;
+            ranges[0] = steps[0].hash_table->equal_range(getCarried(steps[0].probe_table, steps[0].probe_carried));
+        }
+
+        Step & step = steps[depth];
+        pair<hash_table_t::iterator, hash_table_t::iterator> & range = ranges[depth];
+        if (range.first == range.second) {
+            depth--;
+            continue;
+        }
+
+        BuiltRow * row = &range.first->second;
+        range.first++;
+        bound_rows[step.table] = row;
+        bound_positions[step.table] = row->registry_position;
+
+        bool matches = true;
+        for (size_t r = 0; r < step.residuals.size() && matches; r++) {
+            matches = getCarried(step.residuals[r].first.first, step.residuals[r].first.second) ==
+                      getCarried(step.residuals[r].second.first, step.residuals[r].second.second);
+        }
+        if (!matches) continue;
+
+        if ((size_t) depth + 1 == steps.size()) {
+            registry_positions = bound_positions;
+            return true;
+        }
+
+        depth++;
+        ranges[depth] = steps[depth].hash_table->equal_range(getCarried(steps[depth].probe_table, steps[depth].probe_carried));
+    }
+}
+
+void MultiJoin::printPlan() {
+    if (!planned && !plan()) return;
+
+    cout << "Scan " << tables[driving_table]->getName() << " (" << tables[driving_table]->getNumberOfRows() << " rows)" << endl;
+    for (size_t s = 0; s < steps.size(); s++) {
+        Step & step = steps[s];
+        cout << "  Probe hash table of " << tables[step.table]->getName()
+             << " (" << tables[step.table]->getNumberOfRows() << " rows) on "
+             << tables[step.table]->getSchema().getCols()->at(step.column_position).key
+             << " with " << tables[step.probe_table]->getName() << "."
+             << tables[step.probe_table]->getSchema().getCols()->at(carried_columns[step.probe_table][step.probe_carried].column_position).key;
+        if (!step.residuals.empty()) {
+            cout << ", " << step.residuals.size() << " more condition(s)";
+        }
+        cout << endl;
+    }
+}
+
+void MultiJoin::print(int number_of_values) {
+    if (!open()) return;
+
+    vector<long long> registry_positions;
+    LateMaterializer materializer(tables, cout);
+    int line = 0;
+    while (line != number_of_values && next(registry_positions)) {
+        materializer.add(&registry_positions[0]);
+        line++;
+    }
+    materializer.flush();
+    close();
+}
+
+string MultiJoin::getError() {
+    return error;
+}
+
+#endif //MULTIJOIN_H
@@ -0,0 +1,1900 @@
+#ifndef OPERATOR_H
+#define OPERATOR_H
+
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+#include <stdio.h>
+
+#include "util.h"
+#include "schema.h"
+#include "queryable.h"
+#include "scanner.h"
+#include "typedkey.h"
+#include "externalsort.h"
+#include "joinstream.h"
+#include "aggregatestate.h"
+#include "predicate.h"
+#include "secondaryindex.h"
+#include "timer.h"
+
+/**
+ * A row flowing between operators: one value per column of the operator.
+ */
+typedef vector<TypedKey> Tuple;
+
+struct OperatorColumn {
+    // Alias of the table the column comes from
+    string table;
+    string name;
+    KeyKind key_kind;
+};
+
+/**
+ * @param table alias of the table, or empty for any
+ * @return the index of the column, -1 if there is none, -2 if more than
+ *         one table has it
+ */
+int findColumn(vector<OperatorColumn> & columns, string table, string name);
+
+/**
+ * Pull-based physical operator: open, then next until it returns false,
+ * then close. An operator owns its children.
+ */
+class Operator {
+protected:
+    vector<OperatorColumn> columns;
+    // Rows the planner expects the operator to output, -1 if unknown
+    double estimated_rows;
+    // What the operator did so far, for EXPLAIN ANALYZE: bytes its scanner
+    // read from the table, registries decoded into tuples, and the most
+    // memory it held at once
+    long long bytes_read;
+    long long rows_decoded;
+    long long peak_memory;
+
+    /**
+     * Records that the operator holds this many bytes now.
+     */
+    void useMemory(long long bytes);
+
+public:
+    Operator() : estimated_rows(-1), bytes_read(0), rows_decoded(0), peak_memory(0) {}
+    virtual ~Operator() {}
+
+    virtual void open() =0;
+
+    /**
+     * @return false when there are no more tuples
+     */
+    virtual bool next(Tuple & tuple) =0;
+
+    virtual void close() =0;
+
+    vector<OperatorColumn> & getColumns();
+
+    /**
+     * @param table alias of the table, or empty for any
+     * @return the index of the column in the tuples, -1 if there is none,
+     *         -2 if more than one table has it
+     */
+    int findColumn(string table, string name);
+
+    /**
+     * @return the operator and its arguments, in one line, for EXPLAIN
+     */
+    virtual string describe() =0;
+
+    /**
+     * @return the operators this one reads, empty for a scan
+     */
+    virtual vector<Operator*> getChildren();
+
+    /**
+     * Puts other operators in place of the children, in the order of
+     * getChildren. The operator owns the new children; the ones replaced
+     * are not deleted.
+     */
+    virtual void setChildren(const vector<Operator*> & children);
+
+    /**
+     * Adds a line per operator of the tree, each child indented under its
+     * parent.
+     */
+    virtual void explain(vector<string> & lines, int depth = 0);
+
+    /**
+     * Gives the ? parameters of the query their values, before open. An
+     * operator with predicates sets their values; the others pass the
+     * parameters on to their children.
+     */
+    virtual void bind(const vector<TypedKey> & parameters);
+
+    void setEstimatedRows(double estimated_rows);
+    double getEstimatedRows();
+
+    long long getBytesRead();
+    long long getRowsDecoded();
+    long long getPeakMemory();
+};
+
+/**
+ * @return the line of an operator in EXPLAIN: indented by depth, with the
+ *         rows estimated when there is an estimate
+ */
+string getExplainLine(const string & description, double estimated_rows, int depth);
+
+/**
+ * @return " WHERE a AND b" for the predicates on table column positions,
+ *         empty without predicates
+ */
+string describeWhere(Queryable * table, const vector<ColumnPredicate> & predicates);
+
+/**
+ * Narrows [min_id, max_id], from the whole range of long long, to the
+ * integer bounds on _id among the predicates.
+ *
+ * @param bounds the predicates that bound _id
+ * @param rest the other predicates
+ * @return whether _id is bounded
+ */
+bool getIdRange(const vector<ColumnPredicate> & predicates, long long & min_id, long long & max_id,
+                vector<ColumnPredicate> & bounds, vector<ColumnPredicate> & rest);
+
+/**
+ * @return whether the header holds every id from its first to its last,
+ *         so the registry of an id is at header index id - first id
+ */
+bool hasDenseIds(header_t * header);
+
+/**
+ * Full scan of a table. The predicates are compiled once, and tested on
+ * the registry before the output columns are decoded.
+ */
+class ScanOperator : public Operator {
+private:
+    Queryable * table;
+    string alias;
+    vector<int> column_positions;
+    vector<ColumnPredicate> predicates;
+    Conjunction conjunction;
+    Scanner * scan;
+
+public:
+    /**
+     * @param column_positions table columns output, in order
+     * @param predicates on table column positions
+     */
+    ScanOperator(Queryable * table, string alias, vector<int> column_positions, vector<ColumnPredicate> predicates);
+
+    /**
+     * Every column of the table, no predicate.
+     */
+    ScanOperator(Queryable * table);
+    ~ScanOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+    void bind(const vector<TypedKey> & parameters);
+};
+
+/**
+ * Scan of the registries whose _id is in [min_id, max_id]. The first one is
+ * found by binary search in the header, which is sorted by _id, or, when
+ * the ids are dense (every id from the first to the last, as insert gives
+ * them), straight at min_id - first id.
+ */
+class IndexScanOperator : public Operator {
+private:
+    Queryable * table;
+    string alias;
+    vector<int> column_positions;
+    vector<ColumnPredicate> predicates;
+    vector<ColumnPredicate> id_predicates;
+    Conjunction conjunction;
+    long long min_id;
+    long long max_id;
+    bool dense;
+    Scanner * scan;
+
+    /**
+     * Takes the range from the integer bounds on _id and tests every other
+     * predicate on the registries in it.
+     */
+    void setRange(const vector<ColumnPredicate> & predicates, const vector<ColumnPredicate> & id_predicates);
+
+public:
+    /**
+     * @param id_predicates the bounds on _id
+     * @param dense whether to look min_id up as a dense id; the header is
+     *        checked again on open, falling back to binary search
+     */
+    IndexScanOperator(Queryable * table, string alias, vector<int> column_positions, vector<ColumnPredicate> predicates,
+                      vector<ColumnPredicate> id_predicates, bool dense = false);
+    ~IndexScanOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+    void bind(const vector<TypedKey> & parameters);
+};
+
+/**
+ * Reads the registries whose key in a secondary index of the table is in a
+ * range. The registry positions found are read in file order, so the index
+ * range costs one forward pass over the blocks holding them.
+ */
+class IndexLookupOperator : public Operator {
+private:
+    Queryable * table;
+    string alias;
+    vector<int> column_positions;
+    vector<ColumnPredicate> predicates;
+    vector<ColumnPredicate> range_predicates;
+    Conjunction conjunction;
+    int index_column;
+    KeyRange range;
+
+    vector<long long> registry_positions;
+    size_t position;
+    Scanner * scan;
+
+    /**
+     * Takes the range from the range predicates of the index's kind and
+     * tests every other predicate on the registries in it.
+     */
+    void setRange(const vector<ColumnPredicate> & predicates, const vector<ColumnPredicate> & range_predicates);
+
+public:
+    /**
+     * @param index_column column of the index, taken from the table on open
+     *        so the index rebuilt after an insert is the one read
+     * @param range_predicates the predicates on index_column the index answers
+     */
+    IndexLookupOperator(Queryable * table, string alias, vector<int> column_positions, vector<ColumnPredicate> predicates,
+                        int index_column, vector<ColumnPredicate> range_predicates);
+    ~IndexLookupOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+    void bind(const vector<TypedKey> & parameters);
+};
+
+/**
+ * Outputs tuples given up front, such as the lines of an EXPLAIN.
+ */
+class ValuesOperator : public Operator {
+private:
+    vector<Tuple> tuples;
+    size_t position;
+
+public:
+    ValuesOperator(vector<OperatorColumn> columns, vector<Tuple> tuples);
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+};
+
+/**
+ * Hash join: build is read whole into a hash table on open, then each
+ * probe tuple is joined with its matches. Tuples are the probe columns
+ * followed by the build columns.
+ */
+class HashJoinOperator : public Operator {
+private:
+    typedef unordered_multimap<TypedKey, Tuple, TypedKeyHash> hash_table_t;
+
+    Operator * probe;
+    Operator * build;
+    int probe_key;
+    int build_key;
+    KeyKind key_kind;
+
+    hash_table_t hash_table;
+    Tuple probe_tuple;
+    hash_table_t::iterator match;
+    hash_table_t::iterator match_end;
+
+public:
+    /**
+     * @param key_kind what both keys are compared as
+     */
+    HashJoinOperator(Operator * probe, Operator * build, int probe_key, int build_key, KeyKind key_kind);
+    ~HashJoinOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+    vector<Operator*> getChildren();
+    void setChildren(const vector<Operator*> & children);
+};
+
+/**
+ * Keeps some columns of its child, in a given order.
+ */
+class ProjectOperator : public Operator {
+private:
+    Operator * child;
+    vector<int> indexes;
+    Tuple child_tuple;
+
+public:
+    ProjectOperator(Operator * child, vector<int> indexes);
+    ~ProjectOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+    vector<Operator*> getChildren();
+    void setChildren(const vector<Operator*> & children);
+};
+
+/**
+ * Stops after limit tuples, without pulling more from its child.
+ */
+class LimitOperator : public Operator {
+private:
+    Operator * child;
+    long long limit;
+    long long produced;
+
+public:
+    LimitOperator(Operator * child, long long limit);
+    ~LimitOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+    vector<Operator*> getChildren();
+    void setChildren(const vector<Operator*> & children);
+};
+
+/**
+ * Keeps the tuples of its child that pass every predicate.
+ */
+class FilterOperator : public Operator {
+private:
+    Operator * child;
+    vector<ColumnPredicate> planned_predicates;
+    vector<ColumnPredicate> predicates;
+
+public:
+    /**
+     * @param predicates on tuple indexes of the child
+     */
+    FilterOperator(Operator * child, vector<ColumnPredicate> predicates);
+    ~FilterOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+    vector<Operator*> getChildren();
+    void setChildren(const vector<Operator*> & children);
+    void bind(const vector<TypedKey> & parameters);
+};
+
+/**
+ * Merge join of two children already in key order (a Sort, or a scan of a
+ * table sorted on the key). Only the right tuples of the current key are
+ * held. Tuples are the left columns followed by the right columns.
+ */
+class MergeJoinOperator : public Operator {
+private:
+    Operator * left;
+    Operator * right;
+    int left_key;
+    int right_key;
+    KeyKind key_kind;
+
+    Tuple left_tuple;
+    Tuple right_tuple;
+    bool has_right;
+    // Right tuples with key group_key, joined with the current left tuple
+    vector<Tuple> group;
+    TypedKey group_key;
+    size_t group_index;
+
+public:
+    MergeJoinOperator(Operator * left, Operator * right, int left_key, int right_key, KeyKind key_kind);
+    ~MergeJoinOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+    vector<Operator*> getChildren();
+    void setChildren(const vector<Operator*> & children);
+};
+
+/**
+ * Index nested loop join on the _id of a table: each outer tuple finds the
+ * registries of its key in the header, at key - first id when the ids are
+ * dense or by binary search, and only those are read and tested against
+ * the table's predicates. Nothing is built on open, so a Limit above it
+ * reads no more outer tuples than it needs. Tuples are the outer columns
+ * followed by the table's.
+ */
+class IndexNestedLoopOperator : public Operator {
+private:
+    Operator * outer;
+    int outer_key;
+    Queryable * table;
+    string alias;
+    vector<int> column_positions;
+    vector<OperatorColumn> table_columns;
+    vector<ColumnPredicate> predicates;
+    Conjunction conjunction;
+
+    header_t * header;
+    bool dense;
+    Scanner * scan;
+    Tuple outer_tuple;
+    Tuple table_tuple;
+    // Header indexes [match, match_end) of the current outer key
+    long long match;
+    long long match_end;
+
+public:
+    /**
+     * @param outer_key tuple index of the outer column equal to _id, an integer
+     * @param predicates on table column positions
+     */
+    IndexNestedLoopOperator(Operator * outer, int outer_key, Queryable * table, string alias, vector<int> column_positions,
+                            vector<ColumnPredicate> predicates);
+    ~IndexNestedLoopOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+    vector<Operator*> getChildren();
+    void setChildren(const vector<Operator*> & children);
+    void bind(const vector<TypedKey> & parameters);
+};
+
+struct SortKey {
+    int column;
+    bool descending;
+};
+
+/**
+ * Orders tuples on sort keys.
+ */
+struct TupleLess {
+    vector<SortKey> * keys;
+    bool operator()(const Tuple & a, const Tuple & b) const;
+};
+
+/**
+ * Orders (tuple, input position) entries on sort keys, equal tuples in
+ * input order.
+ */
+struct TupleEntryLess {
+    TupleLess less;
+    bool operator()(const pair<Tuple, long long> & a, const pair<Tuple, long long> & b) const;
+};
+
+/**
+ * Sorts its child on open, through an ExternalSort of the tuples: they are
+ * sorted in memory until they outgrow the memory budget, then written to
+ * sorted run files merged on the way out. Tuples with equal keys keep
+ * their input order.
+ */
+class SortOperator : public Operator {
+private:
+    Operator * child;
+    vector<SortKey> keys;
+    long long memory_budget;
+    ExternalSort<Tuple, TupleEntryLess> * sorter;
+
+public:
+    SortOperator(Operator * child, vector<SortKey> keys, long long memory_budget = 64LL << 20);
+    ~SortOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+    vector<Operator*> getChildren();
+    void setChildren(const vector<Operator*> & children);
+
+    int getNumberOfRuns();
+};
+
+/**
+ * ORDER BY with LIMIT: reads its child on open into a heap bounded to limit
+ * tuples, the last in order at the top, so each tuple past the first limit
+ * costs a comparison with the top instead of a place in a full sort.
+ * Tuples with equal keys keep their input order, as with Sort.
+ */
+class TopNOperator : public Operator {
+private:
+    // A tuple and its place in the input, which breaks ties
+    struct Entry {
+        Tuple tuple;
+        long long sequence;
+    };
+
+    struct EntryLess {
+        TupleLess less;
+        bool operator()(const Entry & a, const Entry & b) const;
+    };
+
+    Operator * child;
+    vector<SortKey> keys;
+    long long limit;
+
+    vector<Entry> heap;
+    size_t position;
+
+public:
+    TopNOperator(Operator * child, vector<SortKey> keys, long long limit);
+    ~TopNOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+    vector<Operator*> getChildren();
+    void setChildren(const vector<Operator*> & children);
+};
+
+struct AggregateColumn {
+    AggregateFunction function;
+    // Tuple index of the aggregated column, -1 for COUNT(*)
+    int column;
+};
+
+/**
+ * Hash group by: reads its child on open, then outputs one tuple per group,
+ * the group columns followed by the aggregates. Without group columns there
+ * is a single group, even over no tuples.
+ */
+class AggregateOperator : public Operator {
+private:
+    typedef unordered_map<GroupKey, vector<AggregateState>, GroupKeyHash> group_table_t;
+
+    Operator * child;
+    vector<int> group_columns;
+    vector<AggregateColumn> aggregates;
+
+    group_table_t groups;
+    group_table_t::iterator current;
+
+public:
+    AggregateOperator(Operator * child, vector<int> group_columns, vector<AggregateColumn> aggregates);
+    ~AggregateOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+    vector<Operator*> getChildren();
+    void setChildren(const vector<Operator*> & children);
+};
+
+/**
+ * Runs an operator for EXPLAIN ANALYZE, counting the tuples it outputs and
+ * timing its open, next and close, which include the time of its children.
+ */
+class AnalyzeOperator : public Operator {
+private:
+    Operator * analyzed;
+    long long actual_rows;
+    double time;
+    Timer timer;
+
+public:
+    AnalyzeOperator(Operator * analyzed);
+    ~AnalyzeOperator();
+
+    void open();
+    bool next(Tuple & tuple);
+    void close();
+
+    string describe();
+    vector<Operator*> getChildren();
+    void setChildren(const vector<Operator*> & children);
+    void bind(const vector<TypedKey> & parameters);
+
+    /**
+     * Adds the line of the analyzed operator, followed by what it did: the
+     * rows it output, its time with and without its children's, and the
+     * bytes read, registries decoded and peak memory it counted.
+     */
+    void explain(vector<string> & lines, int depth = 0);
+
+    /**
+     * @return seconds spent in the operator, its children included
+     */
+    double getTime();
+};
+
+/**
+ * Puts an AnalyzeOperator over every operator of the tree.
+ * @return the new root, which owns the tree
+ */
+Operator * analyze(Operator * root);
+
+vector<OperatorColumn> & Operator::getColumns() {
+    return columns;
+}
+
+int Operator::findColumn(string table, string name) {
+    return ::findColumn(columns, table, name);
+}
+
+vector<Operator*> Operator::getChildren() {
+    return vector<Operator*>();
+}
+
+void Operator::setChildren(const vector<Operator*> &) {
+}
+
+void Operator::explain(vector<string> & lines, int depth) {
+    lines.push_back(getExplainLine(describe(), estimated_rows, depth));
+    vector<Operator*> children = getChildren();
+    for (size_t i = 0; i < children.size(); i++) {
+        children[i]->explain(lines, depth + 1);
+    }
+}
+
+void Operator::bind(const vector<TypedKey> & parameters) {
+    vector<Operator*> children = getChildren();
+    for (size_t i = 0; i < children.size(); i++) {
+        children[i]->bind(parameters);
+    }
+}
+
+void Operator::setEstimatedRows(double estimated_rows) {
+    this->estimated_rows = estimated_rows;
+}
+
+double Operator::getEstimatedRows() {
+    return estimated_rows;
+}
+
+void Operator::useMemory(long long bytes) {
+    peak_memory = max(peak_memory, bytes);
+}
+
+long long Operator::getBytesRead() {
+    return bytes_read;
+}
+
+long long Operator::getRowsDecoded() {
+    return rows_decoded;
+}
+
+long long Operator::getPeakMemory() {
+    return peak_memory;
+}
+
+string getExplainLine(const string & description, double estimated_rows, int depth) {
+    ostringstream line;
+    line << string(2 * depth, ' ') << "-> " << description;
+    if (estimated_rows >= 0) {
+        line << "  (~" << (long long) (estimated_rows + 0.5) << " rows)";
+    }
+    return line.str();
+}
+
+string describeWhere(Queryable * table, const vector<ColumnPredicate> & predicates) {
+    string where;
+    for (size_t i = 0; i < predicates.size(); i++) {
+        where += (i == 0 ? " WHERE " : " AND ");
+        where += describePredicate(table->getSchema().getCols()->at(predicates[i].column).key, predicates[i]);
+    }
+    return where;
+}
+
+/**
+ * @return the table, with its alias when it has another name
+ */
+string describeTable(Queryable * table, const string & alias) {
+    return alias.empty() || alias == table->getName() ? table->getName() : table->getName() + " " + alias;
+}
+
+/**
+ * @return [min_id, max_id] as a condition on _id, an end at the limit of
+ *         long long being open
+ */
+string describeIdRange(long long min_id, long long max_id) {
+    KeyRange range;
+    TypedKey bound;
+    bound.kind = INTEGER_KEY;
+    if (min_id > numeric_limits<long long>::min()) {
+        bound.integer_value = min_id;
+        range.has_lower = range.lower_inclusive = true;
+        range.lower = bound;
+    }
+    if (max_id < numeric_limits<long long>::max()) {
+        bound.integer_value = max_id;
+        range.has_upper = range.upper_inclusive = true;
+        range.upper = bound;
+    }
+    return range.toString("_id");
+}
+
+/**
+ * @return table.column, or column for a column of no table
+ */
+string describeColumn(const OperatorColumn & column) {
+    return column.table.empty() ? column.name : column.table + "." + column.name;
+}
+
+int findColumn(vector<OperatorColumn> & columns, string table, string name) {
+    int found = -1;
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (columns[i].name == name && (table.empty() || columns[i].table == table)) {
+            if (found >= 0) return -2;
+            found = (int) i;
+        }
+    }
+    return found;
+}
+
+bool getIdRange(const vector<ColumnPredicate> & predicates, long long & min_id, long long & max_id,
+                vector<ColumnPredicate> & bounds, vector<ColumnPredicate> & rest) {
+    min_id = numeric_limits<long long>::min();
+    max_id = numeric_limits<long long>::max();
+    for (size_t i = 0; i < predicates.size(); i++) {
+        const ColumnPredicate & predicate = predicates[i];
+        long long value = predicate.value.integer_value;
+        bool on_id = predicate.column == 0 && predicate.value.kind == INTEGER_KEY;
+
+        if (on_id && (predicate.comparator == EQUAL || predicate.comparator == GREATER_EQUAL)) {
+            min_id = max(min_id, value);
+        } else if (on_id && predicate.comparator == GREATER && value < numeric_limits<long long>::max()) {
+            min_id = max(min_id, value + 1);
+        }
+        if (on_id && (predicate.comparator == EQUAL || predicate.comparator == LESS_EQUAL)) {
+            max_id = min(max_id, value);
+        } else if (on_id && predicate.comparator == LESS && value > numeric_limits<long long>::min()) {
+            max_id = min(max_id, value - 1);
+        }
+
+        if (on_id && predicate.comparator != NOT_EQUAL) {
+            bounds.push_back(predicate);
+        } else {
+            rest.push_back(predicate);
+        }
+    }
+    return !bounds.empty();
+}
+
+bool hasDenseIds(header_t * header) {
+    // Ids are sorted and unique, so there is no gap when they span the size
+    return !header->empty() && header->back().first - header->front().first + 1 == (long long) header->size();
+}
+
+/**
+ * @return the columns of table at column_positions, as operators output them
+ */
+vector<OperatorColumn> getTableColumns(Queryable * table, string alias, vector<int> & column_positions) {
+    vector<OperatorColumn> columns;
+    Schema schema = table->getSchema();
+    for (size_t i = 0; i < column_positions.size(); i++) {
+        SchemaCol & schema_col = schema.getCols()->at(column_positions[i]);
+        OperatorColumn column;
+        column.table = alias;
+        column.name = schema_col.key;
+        column.key_kind = getKeyKind(schema_col.type);
+        columns.push_back(column);
+    }
+    return columns;
+}
+
+/**
+ * @return the bytes a tuple takes in memory, its strings included
+ */
+long long getTupleBytes(const Tuple & tuple) {
+    long long bytes = sizeof(Tuple) + tuple.size() * sizeof(TypedKey);
+    for (size_t i = 0; i < tuple.size(); i++) {
+        bytes += tuple[i].string_value.capacity();
+    }
+    return bytes;
+}
+
+/**
+ * Decodes the output columns of the scanner's registry.
+ */
+void readTuple(Scanner * scan, vector<OperatorColumn> & columns, vector<int> & column_positions, Tuple & tuple) {
+    tuple.resize(column_positions.size());
+    for (size_t i = 0; i < column_positions.size(); i++) {
+        tuple[i] = readTypedKey(scan, column_positions[i], columns[i].key_kind);
+    }
+}
+
+/*****************************************
+ ***************** SCAN ******************
+ *****************************************/
+
+ScanOperator::ScanOperator(Queryable * table, string alias, vector<int> column_positions, vector<ColumnPredicate> predicates) {
+    this->table = table;
+    this->alias = alias;
+    this->column_positions = column_positions;
+    this->predicates = predicates;
+    this->conjunction.compile(table, predicates);
+    this->columns = getTableColumns(table, alias, column_positions);
+    this->scan = NULL;
+}
+
+ScanOperator::~ScanOperator() {
+    close();
+}
+
+ScanOperator::ScanOperator(Queryable * table) {
+    this->table = table;
+    this->alias = table->getName();
+    for (int i = 0; i < table->getSchema().getNumberOfCols(); i++) {
+        column_positions.push_back(i);
+    }
+    this->columns = getTableColumns(table, table->getName(), column_positions);
+    this->scan = NULL;
+}
+
+void ScanOperator::open() {
+    close();
+    scan = table->scan();
+}
+
+bool ScanOperator::next(Tuple & tuple) {
+    if (scan == NULL) return false;
+    while (scan->next()) {
+        if (conjunction.evaluate(scan)) {
+            readTuple(scan, columns, column_positions, tuple);
+            rows_decoded++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ScanOperator::close() {
+    if (scan != NULL) {
+        bytes_read += scan->getBytesRead();
+        useMemory(scan->getBufferSize());
+        delete scan;
+    }
+    scan = NULL;
+}
+
+string ScanOperator::describe() {
+    return "Scan " + describeTable(table, alias) + describeWhere(table, conjunction.getPredicates());
+}
+
+void ScanOperator::bind(const vector<TypedKey> & parameters) {
+    conjunction.compile(table, bindPredicates(predicates, parameters));
+}
+
+/*****************************************
+ ************** INDEX SCAN ***************
+ *****************************************/
+
+IndexScanOperator::IndexScanOperator(Queryable * table, string alias, vector<int> column_positions, vector<ColumnPredicate> predicates,
+                                     vector<ColumnPredicate> id_predicates, bool dense) {
+    this->table = table;
+    this->alias = alias;
+    this->column_positions = column_positions;
+    this->predicates = predicates;
+    this->id_predicates = id_predicates;
+    this->dense = dense;
+    setRange(predicates, id_predicates);
+    this->columns = getTableColumns(table, alias, column_positions);
+    this->scan = NULL;
+}
+
+IndexScanOperator::~IndexScanOperator() {
+    close();
+}
+
+void IndexScanOperator::setRange(const vector<ColumnPredicate> & predicates, const vector<ColumnPredicate> & id_predicates) {
+    // A bound given a real number by a parameter is no longer an integer bound
+    vector<ColumnPredicate> bounds;
+    vector<ColumnPredicate> rest = predicates;
+    getIdRange(id_predicates, min_id, max_id, bounds, rest);
+    conjunction.compile(table, rest);
+}
+
+void IndexScanOperator::bind(const vector<TypedKey> & parameters) {
+    setRange(bindPredicates(predicates, parameters), bindPredicates(id_predicates, parameters));
+}
+
+void IndexScanOperator::open() {
+    close();
+    header_t * header = table->getHeader();
+    long long first;
+    if (dense && hasDenseIds(header)) {
+        // min_id may be below the first id or past the last one
+        long long offset = min_id - header->front().first;
+        first = offset < 0 ? 0 : min(offset, (long long) header->size());
+    } else {
+        first = lower_bound(header->begin(), header->end(), make_pair(min_id, numeric_limits<long long>::min())) - header->begin();
+    }
+    scan = table->scan();
+    scan->seek(first);
+}
+
+bool IndexScanOperator::next(Tuple & tuple) {
+    if (scan == NULL) return false;
+    while (scan->next()) {
+        if (scan->getId() > max_id) {
+            close();
+            return false;
+        }
+        if (conjunction.evaluate(scan)) {
+            readTuple(scan, columns, column_positions, tuple);
+            rows_decoded++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void IndexScanOperator::close() {
+    if (scan != NULL) {
+        bytes_read += scan->getBytesRead();
+        useMemory(scan->getBufferSize());
+        delete scan;
+    }
+    scan = NULL;
+}
+
+string IndexScanOperator::describe() {
+    return "IndexScan " + describeTable(table, alias) + " ON " + describeIdRange(min_id, max_id)
+         + (dense ? " by dense lookup" : " by binary search") + describeWhere(table, conjunction.getPredicates());
+}
+
+/*****************************************
+ ************* INDEX LOOKUP **************
+ *****************************************/
+
+IndexLookupOperator::IndexLookupOperator(Queryable * table, string alias, vector<int> column_positions, vector<ColumnPredicate> predicates,
+                                         int index_column, vector<ColumnPredicate> range_predicates) {
+    this->table = table;
+    this->alias = alias;
+    this->column_positions = column_positions;
+    this->predicates = predicates;
+    this->range_predicates = range_predicates;
+    this->index_column = index_column;
+    setRange(predicates, range_predicates);
+    this->columns = getTableColumns(table, alias, column_positions);
+    this->position = 0;
+    this->scan = NULL;
+}
+
+IndexLookupOperator::~IndexLookupOperator() {
+    close();
+}
+
+void IndexLookupOperator::setRange(const vector<ColumnPredicate> & predicates, const vector<ColumnPredicate> & range_predicates) {
+    KeyKind index_kind = getKeyKind(table->getSchema().getCols()->at(index_column).type);
+    vector<ColumnPredicate> rest = predicates;
+    range = KeyRange();
+    for (size_t i = 0; i < range_predicates.size(); i++) {
+        // A parameter of another kind than the index is tested on each registry
+        if (range_predicates[i].value.kind != index_kind || !range.add(range_predicates[i])) {
+            rest.push_back(range_predicates[i]);
+        }
+    }
+    conjunction.compile(table, rest);
+}
+
+void IndexLookupOperator::bind(const vector<TypedKey> & parameters) {
+    setRange(bindPredicates(predicates, parameters), bindPredicates(range_predicates, parameters));
+}
+
+void IndexLookupOperator::open() {
+    close();
+    SecondaryIndex * index = table->getIndex(index_column);
+    if (index != NULL) {
+        pair<long long, long long> entries = index->find(range);
+        for (long long entry = entries.first; entry < entries.second; entry++) {
+            registry_positions.push_back(index->getRegistryPosition(entry));
+        }
+        sort(registry_positions.begin(), registry_positions.end());
+    }
+    position = 0;
+    scan = table->scan();
+}
+
+bool IndexLookupOperator::next(Tuple & tuple) {
+    if (scan == NULL) return false;
+    while (position < registry_positions.size()) {
+        if (!scan->fetch(registry_positions[position++])) {
+            break;
+        }
+        if (conjunction.evaluate(scan)) {
+            readTuple(scan, columns, column_positions, tuple);
+            rows_decoded++;
+            return true;
+        }
+    }
+    close();
+    return false;
+}
+
+void IndexLookupOperator::close() {
+    if (scan != NULL) {
+        bytes_read += scan->getBytesRead();
+        useMemory(scan->getBufferSize() + registry_positions.size() * sizeof(long long));
+        delete scan;
+    }
+    scan = NULL;
+    vector<long long>().swap(registry_positions);
+    position = 0;
+}
+
+string IndexLookupOperator::describe() {
+    string column_name = table->getSchema().getCols()->at(index_column).key;
+    return "IndexLookup " + describeTable(table, alias) + " ON " + range.toString(column_name)
+         + describeWhere(table, conjunction.getPredicates());
+}
+
+/*****************************************
+ **************** VALUES *****************
+ *****************************************/
+
+ValuesOperator::ValuesOperator(vector<OperatorColumn> columns, vector<Tuple> tuples) {
+    this->columns = columns;
+    this->tuples = tuples;
+    this->position = 0;
+}
+
+void ValuesOperator::open() {
+    position = 0;
+}
+
+bool ValuesOperator::next(Tuple & tuple) {
+    if (position >= tuples.size()) {
+        return false;
+    }
+    tuple = tuples[position++];
+    return true;
+}
+
+void ValuesOperator::close() {
+}
+
+string ValuesOperator::describe() {
+    ostringstream description;
+    description << "Values " << tuples.size() << " rows";
+    return description.str();
+}
+
+/*****************************************
+ *************** HASH JOIN ***************
+ *****************************************/
+
+HashJoinOperator::HashJoinOperator(Operator * probe, Operator * build, int probe_key, int build_key, KeyKind key_kind) {
+    this->probe = probe;
+    this->build = build;
+    this->probe_key = probe_key;
+    this->build_key = build_key;
+    this->key_kind = key_kind;
+
+    columns = probe->getColumns();
+    columns.insert(columns.end(), build->getColumns().begin(), build->getColumns().end());
+    match = match_end = hash_table.end();
+}
+
+HashJoinOperator::~HashJoinOperator() {
+    delete probe;
+    delete build;
+}
+
+void HashJoinOperator::open() {
+    hash_table.clear();
+    long long bytes = 0;
+    Tuple tuple;
+    build->open();
+    while (build->next(tuple)) {
+        // The key and tuple, and the node's link and hash
+        bytes += sizeof(TypedKey) + getTupleBytes(tuple) + 2 * sizeof(void *);
+        hash_table.insert(make_pair(convertKey(tuple[build_key], key_kind), tuple));
+    }
+    build->close();
+    useMemory(bytes + hash_table.bucket_count() * sizeof(void *));
+
+    probe->open();
+    match = match_end = hash_table.end();
+}
+
+bool HashJoinOperator::next(Tuple & tuple) {
+    while (match == match_end) {
+        if (!probe->next(probe_tuple)) {
+            return false;
+        }
+        pair<hash_table_t::iterator, hash_table_t::iterator> matches = hash_table.equal_range(convertKey(probe_tuple[probe_key], key_kind));
+        match = matches.first;
+        match_end = matches.second;
+    }
+    tuple = probe_tuple;
+    tuple.insert(tuple.end(), match->second.begin(), match->second.end());
+    ++match;
+    return true;
+}
+
+void HashJoinOperator::close() {
+    probe->close();
+    hash_table_t().swap(hash_table);
+    match = match_end = hash_table.end();
+}
+
+string HashJoinOperator::describe() {
+    return "HashJoin ON " + describeColumn(probe->getColumns()[probe_key]) + " = " + describeColumn(build->getColumns()[build_key]);
+}
+
+vector<Operator*> HashJoinOperator::getChildren() {
+    vector<Operator*> children;
+    children.push_back(probe);
+    children.push_back(build);
+    return children;
+}
+
+void HashJoinOperator::setChildren(const vector<Operator*> & children) {
+    probe = children[0];
+    build = children[1];
+}
+
+/*****************************************
+ **************** PROJECT ****************
+ *****************************************/
+
+ProjectOperator::ProjectOperator(Operator * child, vector<int> indexes) {
+    this->child = child;
+    this->indexes = indexes;
+    for (size_t i = 0; i < indexes.size(); i++) {
+        columns.push_back(child->getColumns()[indexes[i]]);
+    }
+}
+
+ProjectOperator::~ProjectOperator() {
+    delete child;
+}
+
+void ProjectOperator::open() {
+    child->open();
+}
+
+bool ProjectOperator::next(Tuple & tuple) {
+    if (!child->next(child_tuple)) {
+        return false;
+    }
+    tuple.resize(indexes.size());
+    for (size_t i = 0; i < indexes.size(); i++) {
+        tuple[i] = child_tuple[indexes[i]];
+    }
+    return true;
+}
+
+void ProjectOperator::close() {
+    child->close();
+}
+
+string ProjectOperator::describe() {
+    string description = "Project";
+    for (size_t i = 0; i < columns.size(); i++) {
+        description += (i == 0 ? " " : ", ") + describeColumn(columns[i]);
+    }
+    return description;
+}
+
+vector<Operator*> ProjectOperator::getChildren() {
+    return vector<Operator*>(1, child);
+}
+
+void ProjectOperator::setChildren(const vector<Operator*> & children) {
+    child = children[0];
+}
+
+/*****************************************
+ ***************** LIMIT *****************
+ *****************************************/
+
+LimitOperator::LimitOperator(Operator * child, long long limit) {
+    this->child = child;
+    this->limit = limit;
+    this->produced = 0;
+    this->columns = child->getColumns();
+}
+
+LimitOperator::~LimitOperator() {
+    delete child;
+}
+
+void LimitOperator::open() {
+    produced = 0;
+    child->open();
+}
+
+bool LimitOperator::next(Tuple & tuple) {
+    if (produced >= limit || !child->next(tuple)) {
+        return false;
+    }
+    produced++;
+    return true;
+}
+
+void LimitOperator::close() {
+    child->close();
+}
+
+string LimitOperator::describe() {
+    ostringstream description;
+    description << "Limit " << limit;
+    return description.str();
+}
+
+vector<Operator*> LimitOperator::getChildren() {
+    return vector<Operator*>(1, child);
+}
+
+void LimitOperator::setChildren(const vector<Operator*> & children) {
+    child = children[0];
+}
+
+/*****************************************
+ **************** FILTER *****************
+ *****************************************/
+
+FilterOperator::FilterOperator(Operator * child, vector<ColumnPredicate> predicates) {
+    this->child = child;
+    this->planned_predicates = predicates;
+    this->predicates = predicates;
+    this->columns = child->getColumns();
+}
+
+FilterOperator::~FilterOperator() {
+    delete child;
+}
+
+void FilterOperator::open() {
+    child->open();
+}
+
+bool FilterOperator::next(Tuple & tuple) {
+    while (child->next(tuple)) {
+        bool passes = true;
+        for (size_t i = 0; i < predicates.size() && passes; i++) {
+            ColumnPredicate & predicate = predicates[i];
+            TypedKey & value = tuple[predicate.column];
+            passes = value.kind == predicate.value.kind ? predicate.evaluate(value)
+                                                        : predicate.evaluate(convertKey(value, predicate.value.kind));
+        }
+        if (passes) return true;
+    }
+    return false;
+}
+
+void FilterOperator::close() {
+    child->close();
+}
+
+string FilterOperator::describe() {
+    string description = "Filter";
+    for (size_t i = 0; i < predicates.size(); i++) {
+        description += (i == 0 ? " " : " AND ") + describePredicate(describeColumn(columns[predicates[i].column]), predicates[i]);
+    }
+    return description;
+}
+
+vector<Operator*> FilterOperator::getChildren() {
+    return vector<Operator*>(1, child);
+}
+
+void FilterOperator::setChildren(const vector<Operator*> & children) {
+    child = children[0];
+}
+
+void FilterOperator::bind(const vector<TypedKey> & parameters) {
+    predicates = bindPredicates(planned_predicates, parameters);
+    child->bind(parameters);
+}
+
+/*****************************************
+ ************** MERGE JOIN ***************
+ *****************************************/
+
+MergeJoinOperator::MergeJoinOperator(Operator * left, Operator * right, int left_key, int right_key, KeyKind key_kind) {
+    this->left = left;
+    this->right = right;
+    this->left_key = left_key;
+    this->right_key = right_key;
+    this->key_kind = key_kind;
+
+    columns = left->getColumns();
+    columns.insert(columns.end(), right->getColumns().begin(), right->getColumns().end());
+    has_right = false;
+    group_index = 0;
+}
+
+MergeJoinOperator::~MergeJoinOperator() {
+    delete left;
+    delete right;
+}
+
+void MergeJoinOperator::open() {
+    left->open();
+    right->open();
+    has_right = right->next(right_tuple);
+    group.clear();
+    group_index = 0;
+}
+
+bool MergeJoinOperator::next(Tuple & tuple) {
+    while (group_index >= group.size()) {
+        if (!left->next(left_tuple)) {
+            return false;
+        }
+        TypedKey key = convertKey(left_tuple[left_key], key_kind);
+
+        // A repeated left key joins the same right tuples again
+        if (!group.empty() && group_key == key) {
+            group_index = 0;
+            continue;
+        }
+
+        group.clear();
+        group_index = 0;
+        while (has_right && convertKey(right_tuple[right_key], key_kind) < key) {
+            has_right = right->next(right_tuple);
+        }
+        long long bytes = 0;
+        while (has_right && convertKey(right_tuple[right_key], key_kind) == key) {
+            bytes += getTupleBytes(right_tuple);
+            group.push_back(right_tuple);
+            has_right = right->next(right_tuple);
+        }
+        useMemory(bytes);
+        group_key = key;
+    }
+
+    tuple = left_tuple;
+    tuple.insert(tuple.end(), group[group_index].begin(), group[group_index].end());
+    group_index++;
+    return true;
+}
+
+void MergeJoinOperator::close() {
+    left->close();
+    right->close();
+    vector<Tuple>().swap(group);
+    group_index = 0;
+}
+
+string MergeJoinOperator::describe() {
+    return "MergeJoin ON " + describeColumn(left->getColumns()[left_key]) + " = " + describeColumn(right->getColumns()[right_key]);
+}
+
+vector<Operator*> MergeJoinOperator::getChildren() {
+    vector<Operator*> children;
+    children.push_back(left);
+    children.push_back(right);
+    return children;
+}
+
+void MergeJoinOperator::setChildren(const vector<Operator*> & children) {
+    left = children[0];
+    right = children[1];
+}
+
+/*****************************************
+ ********** INDEX NESTED LOOP ************
+ *****************************************/
+
+IndexNestedLoopOperator::IndexNestedLoopOperator(Operator * outer, int outer_key, Queryable * table, string alias,
+                                                 vector<int> column_positions, vector<ColumnPredicate> predicates) {
+    this->outer = outer;
+    this->outer_key = outer_key;
+    this->table = table;
+    this->alias = alias;
+    this->column_positions = column_positions;
+    this->predicates = predicates;
+    this->conjunction.compile(table, predicates);
+
+    this->table_columns = getTableColumns(table, alias, column_positions);
+    columns = outer->getColumns();
+    columns.insert(columns.end(), table_columns.begin(), table_columns.end());
+    this->header = table->getHeader();
+    this->dense = hasDenseIds(header);
+    this->scan = NULL;
+    this->match = this->match_end = 0;
+}
+
+IndexNestedLoopOperator::~IndexNestedLoopOperator() {
+    close();
+    delete outer;
+}
+
+void IndexNestedLoopOperator::open() {
+    close();
+    header = table->getHeader();
+    dense = hasDenseIds(header);
+    scan = table->scan();
+    match = match_end = 0;
+    outer->open();
+}
+
+bool IndexNestedLoopOperator::next(Tuple & tuple) {
+    if (scan == NULL) return false;
+    while (true) {
+        while (match < match_end) {
+            if (!scan->fetch(header->at(match++).second) || !conjunction.evaluate(scan)) {
+                continue;
+            }
+            readTuple(scan, table_columns, column_positions, table_tuple);
+            rows_decoded++;
+            tuple = outer_tuple;
+            tuple.insert(tuple.end(), table_tuple.begin(), table_tuple.end());
+            return true;
+        }
+
+        if (!outer->next(outer_tuple)) {
+            return false;
+        }
+        long long key = outer_tuple[outer_key].integer_value;
+        if (dense) {
+            long long offset = key - header->front().first;
+            bool found = offset >= 0 && offset < (long long) header->size();
+            match = found ? offset : 0;
+            match_end = found ? offset + 1 : 0;
+        } else {
+            match = lower_bound(header->begin(), header->end(), make_pair(key, numeric_limits<long long>::min())) - header->begin();
+            match_end = upper_bound(header->begin(), header->end(), make_pair(key, numeric_limits<long long>::max())) - header->begin();
+        }
+    }
+}
+
+void IndexNestedLoopOperator::close() {
+    if (scan != NULL) {
+        outer->close();
+        bytes_read += scan->getBytesRead();
+        useMemory(scan->getBufferSize());
+        delete scan;
+    }
+    scan = NULL;
+    match = match_end = 0;
+}
+
+string IndexNestedLoopOperator::describe() {
+    return "IndexNestedLoop " + describeTable(table, alias) + " ON " + describeColumn(outer->getColumns()[outer_key]) + " = "
+         + (alias.empty() ? "_id" : alias + "._id") + (dense ? " by dense lookup" : " by binary search")
+         + describeWhere(table, conjunction.getPredicates());
+}
+
+vector<Operator*> IndexNestedLoopOperator::getChildren() {
+    return vector<Operator*>(1, outer);
+}
+
+void IndexNestedLoopOperator::setChildren(const vector<Operator*> & children) {
+    outer = children[0];
+}
+
+void IndexNestedLoopOperator::bind(const vector<TypedKey> & parameters) {
+    conjunction.compile(table, bindPredicates(predicates, parameters));
+    outer->bind(parameters);
+}
+
+/*****************************************
+ ***************** SORT ******************
+ *****************************************/
+
+bool TupleLess::operator()(const Tuple & a, const Tuple & b) const {
+    for (size_t i = 0; i < keys->size(); i++) {
+        const SortKey & key = keys->at(i);
+        const TypedKey & x = a[key.column];
+        const TypedKey & y = b[key.column];
+        if (x < y) return !key.descending;
+        if (y < x) return key.descending;
+    }
+    return false;
+}
+
+bool TupleEntryLess::operator()(const pair<Tuple, long long> & a, const pair<Tuple, long long> & b) const {
+    if (less(a.first, b.first)) return true;
+    if (less(b.first, a.first)) return false;
+    return a.second < b.second;
+}
+
+template <>
+long long entryBytes<Tuple>(const Tuple & key) {
+    return sizeof(pair<Tuple, long long>) + getTupleBytes(key);
+}
+
+template <>
+void RunFile<Tuple>::writeKey(const Tuple & key) {
+    unsigned size = key.size();
+    out.write(reinterpret_cast<const char *> (&size), sizeof(size));
+    for (size_t i = 0; i < key.size(); i++) {
+        writeTypedKey(out, key[i]);
+    }
+}
+
+template <>
+bool RunFile<Tuple>::readKey(Tuple & key) {
+    unsigned size;
+    if (!in.read(reinterpret_cast<char *> (&size), sizeof(size))) {
+        return false;
+    }
+    key.resize(size);
+    for (size_t i = 0; i < key.size(); i++) {
+        if (!::readTypedKey(in, key[i])) return false;
+    }
+    return true;
+}
+
+SortOperator::SortOperator(Operator * child, vector<SortKey> keys, long long memory_budget) {
+    this->child = child;
+    this->keys = keys;
+    this->memory_budget = memory_budget;
+    this->columns = child->getColumns();
+    this->sorter = NULL;
+}
+
+SortOperator::~SortOperator() {
+    close();
+    delete child;
+}
+
+void SortOperator::open() {
+    close();
+
+    // The position in the input breaks ties, which keeps the sort stable
+    TupleEntryLess less;
+    less.less.keys = &keys;
+    sorter = new ExternalSort<Tuple, TupleEntryLess>(memory_budget, "sort", 0, less);
+
+    long long bytes = 0;
+    long long position = 0;
+    Tuple tuple;
+    child->open();
+    while (child->next(tuple)) {
+        // Same count as the sorter's, which spills a run at the budget
+        bytes += entryBytes(tuple);
+        if (bytes >= memory_budget) {
+            useMemory(bytes);
+            bytes = 0;
+        }
+        sorter->add(tuple, position++);
+    }
+    child->close();
+    useMemory(bytes);
+    sorter->sort();
+}
+
+bool SortOperator::next(Tuple & tuple) {
+    long long position;
+    return sorter != NULL && sorter->next(tuple, position);
+}
+
+void SortOperator::close() {
+    delete sorter;
+    sorter = NULL;
+}
+
+int SortOperator::getNumberOfRuns() {
+    return sorter == NULL ? 0 : sorter->getNumberOfRuns();
+}
+
+string SortOperator::describe() {
+    string description = "Sort BY";
+    for (size_t i = 0; i < keys.size(); i++) {
+        description += (i == 0 ? " " : ", ") + describeColumn(columns[keys[i].column]) + (keys[i].descending ? " DESC" : "");
+    }
+    return description;
+}
+
+vector<Operator*> SortOperator::getChildren() {
+    return vector<Operator*>(1, child);
+}
+
+void SortOperator::setChildren(const vector<Operator*> & children) {
+    child = children[0];
+}
+
+/*****************************************
+ ***************** TOP N *****************
+ *****************************************/
+
+bool TopNOperator::EntryLess::operator()(const Entry & a, const Entry & b) const {
+    if (less(a.tuple, b.tuple)) return true;
+    if (less(b.tuple, a.tuple)) return false;
+    return a.sequence < b.sequence;
+}
+
+TopNOperator::TopNOperator(Operator * child, vector<SortKey> keys, long long limit) {
+    this->child = child;
+    this->keys = keys;
+    this->limit = limit;
+    this->columns = child->getColumns();
+    this->position = 0;
+}
+
+TopNOperator::~TopNOperator() {
+    delete child;
+}
+
+void TopNOperator::open() {
+    close();
+    if (limit <= 0) {
+        return;
+    }
+
+    EntryLess less;
+    less.less.keys = &keys;
+    Entry entry;
+    entry.sequence = 0;
+    child->open();
+    while (child->next(entry.tuple)) {
+        if ((long long) heap.size() < limit) {
+            heap.push_back(entry);
+            push_heap(heap.begin(), heap.end(), less);
+        } else if (less(entry, heap.front())) {
+            // The top leaves the first limit tuples, the new one takes its place
+            pop_heap(heap.begin(), heap.end(), less);
+            heap.back().tuple.swap(entry.tuple);
+            heap.back().sequence = entry.sequence;
+            push_heap(heap.begin(), heap.end(), less);
+        }
+        entry.sequence++;
+    }
+    child->close();
+    sort_heap(heap.begin(), heap.end(), less);
+
+    long long bytes = 0;
+    for (size_t i = 0; i < heap.size(); i++) {
+        bytes += sizeof(Entry) - sizeof(Tuple) + getTupleBytes(heap[i].tuple);
+    }
+    useMemory(bytes);
+}
+
+bool TopNOperator::next(Tuple & tuple) {
+    if (position >= heap.size()) {
+        return false;
+    }
+    tuple = heap[position++].tuple;
+    return true;
+}
+
+void TopNOperator::close() {
+    vector<Entry>().swap(heap);
+    position = 0;
+}
+
+string TopNOperator::describe() {
+    ostringstream description;
+    description << "TopN " << limit << " BY";
+    for (size_t i = 0; i < keys.size(); i++) {
+        description << (i == 0 ? " " : ", ") << describeColumn(columns[keys[i].column]) << (keys[i].descending ? " DESC" : "");
+    }
+    return description.str();
+}
+
+vector<Operator*> TopNOperator::getChildren() {
+    return vector<Operator*>(1, child);
+}
+
+void TopNOperator::setChildren(const vector<Operator*> & children) {
+    child = children[0];
+}
+
+/*****************************************
+ *************** AGGREGATE ***************
+ *****************************************/
+
+AggregateOperator::AggregateOperator(Operator * child, vector<int> group_columns, vector<AggregateColumn> aggregates) {
+    this->child = child;
+    this->group_columns = group_columns;
+    this->aggregates = aggregates;
+
+    vector<OperatorColumn> & child_columns = child->getColumns();
+    for (size_t i = 0; i < group_columns.size(); i++) {
+        columns.push_back(child_columns[group_columns[i]]);
+    }
+    for (size_t a = 0; a < aggregates.size(); a++) {
+        OperatorColumn column;
+        int index = aggregates[a].column;
+        KeyKind column_kind = index < 0 ? INTEGER_KEY : child_columns[index].key_kind;
+        column.name = getAggregateFunctionName(aggregates[a].function) + "("
+                    + (index < 0 ? string("*") : child_columns[index].table + "." + child_columns[index].name) + ")";
+        AggregateState empty;
+        column.key_kind = getAggregateResult(empty, aggregates[a].function, column_kind).kind;
+        columns.push_back(column);
+    }
+    current = groups.end();
+}
+
+AggregateOperator::~AggregateOperator() {
+    delete child;
+}
+
+void AggregateOperator::open() {
+    groups.clear();
+    long long bytes = 0;
+    GroupKey key;
+    Tuple tuple;
+    child->open();
+    while (child->next(tuple)) {
+        key.values.resize(group_columns.size());
+        for (size_t i = 0; i < group_columns.size(); i++) {
+            key.values[i] = tuple[group_columns[i]];
+        }
+        group_table_t::iterator group = groups.find(key);
+        if (group == groups.end()) {
+            group = groups.insert(make_pair(key, vector<AggregateState>(aggregates.size()))).first;
+            bytes += getTupleBytes(key.values) + sizeof(vector<AggregateState>) + aggregates.size() * sizeof(AggregateState);
+        }
+        for (size_t a = 0; a < aggregates.size(); a++) {
+            int column = aggregates[a].column;
+            updateAggregateState(group->second[a], aggregates[a].function, column < 0 ? NULL : &tuple[column]);
+        }
+    }
+    child->close();
+    useMemory(bytes + groups.bucket_count() * sizeof(void *));
+
+    if (groups.empty() && group_columns.empty()) {
+        groups.insert(make_pair(GroupKey(), vector<AggregateState>(aggregates.size())));
+    }
+    current = groups.begin();
+}
+
+bool AggregateOperator::next(Tuple & tuple) {
+    if (current == groups.end()) {
+        return false;
+    }
+    tuple = current->first.values;
+    for (size_t a = 0; a < aggregates.size(); a++) {
+        int column = aggregates[a].column;
+        KeyKind column_kind = column < 0 ? INTEGER_KEY : child->getColumns()[column].key_kind;
+        tuple.push_back(getAggregateResult(current->second[a], aggregates[a].function, column_kind));
+    }
+    ++current;
+    return true;
+}
+
+void AggregateOperator::close() {
+    group_table_t().swap(groups);
+    current = groups.end();
+}
+
+string AggregateOperator::describe() {
+    string description = "Aggregate";
+    for (size_t a = 0; a < aggregates.size(); a++) {
+        description += (a == 0 ? " " : ", ") + columns[group_columns.size() + a].name;
+    }
+    for (size_t i = 0; i < group_columns.size(); i++) {
+        description += (i == 0 ? " GROUP BY " : ", ") + describeColumn(columns[i]);
+    }
+    return description;
+}
+
+vector<Operator*> AggregateOperator::getChildren() {
+    return vector<Operator*>(1, child);
+}
+
+void AggregateOperator::setChildren(const vector<Operator*> & children) {
+    child = children[0];
+}
+
+/*****************************************
+ **************** ANALYZE ****************
+ *****************************************/
+
+AnalyzeOperator::AnalyzeOperator(Operator * analyzed) {
+    this->analyzed = analyzed;
+    this->columns = analyzed->getColumns();
+    this->estimated_rows = analyzed->getEstimatedRows();
+    this->actual_rows = 0;
+    this->time = 0;
+}
+
+AnalyzeOperator::~AnalyzeOperator() {
+    delete analyzed;
+}
+
+void AnalyzeOperator::open() {
+    timer.start();
+    analyzed->open();
+    time += timer.getElapsedTime();
+}
+
+bool AnalyzeOperator::next(Tuple & tuple) {
+    timer.start();
+    bool has_next = analyzed->next(tuple);
+    time += timer.getElapsedTime();
+    actual_rows += has_next;
+    return has_next;
+}
+
+void AnalyzeOperator::close() {
+    timer.start();
+    analyzed->close();
+    time += timer.getElapsedTime();
+}
+
+string AnalyzeOperator::describe() {
+    return analyzed->describe();
+}
+
+vector<Operator*> AnalyzeOperator::getChildren() {
+    return analyzed->getChildren();
+}
+
+void AnalyzeOperator::setChildren(const vector<Operator*> & children) {
+    analyzed->setChildren(children);
+}
+
+void AnalyzeOperator::bind(const vector<TypedKey> & parameters) {
+    analyzed->bind(parameters);
+}
+
+double AnalyzeOperator::getTime() {
+    return time;
+}
+
+void AnalyzeOperator::explain(vector<string> & lines, int depth) {
+    size_t line = lines.size();
+    analyzed->explain(lines, depth);
+
+    // The children's time is part of the operator's, as they run inside its calls
+    double children_time = 0;
+    vector<Operator*> children = getChildren();
+    for (size_t i = 0; i < children.size(); i++) {
+        AnalyzeOperator * child = dynamic_cast<AnalyzeOperator*>(children[i]);
+        if (child != NULL) children_time += child->getTime();
+    }
+
+    ostringstream actual;
+    actual << fixed << setprecision(3) << "  (actual " << actual_rows << " rows, " << time * 1e3 << " ms, self "
+           << max(0.0, time - children_time) * 1e3 << " ms";
+    if (analyzed->getBytesRead() > 0) {
+        actual << ", read " << describeBytes(analyzed->getBytesRead());
+    }
+    if (analyzed->getRowsDecoded() > 0) {
+        actual << ", decoded " << analyzed->getRowsDecoded() << " rows";
+    }
+    if (analyzed->getPeakMemory() > 0) {
+        actual << ", memory " << describeBytes(analyzed->getPeakMemory());
+    }
+    actual << ")";
+    lines[line] += actual.str();
+}
+
+Operator * analyze(Operator * root) {
+    vector<Operator*> children = root->getChildren();
+    for (size_t i = 0; i < children.size(); i++) {
+        children[i] = analyze(children[i]);
+    }
+    root->setChildren(children);
+    return new AnalyzeOperator(root);
+}
+
+#endif //OPERATOR_H
@@ -0,0 +1,189 @@
+#ifndef PARALLELSORT_H
+#define PARALLELSORT_H
+
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <string.h>
+
+#include "util.h"
+
+/**
+ * Sort kernel for (key, registry position) entries, shared by the joins and
+ * anything else that sorts keys (ORDER BY, index bulk builds).
+ *
+ * Integer and floating keys go through a parallel LSD radix sort, which is
+ * stable: entries with equal keys keep their input order. String keys go
+ * through a parallel merge sort ordered by (key, registry position).
+ */
+
+// Below this, threads cost more than they save
+const size_t PARALLEL_SORT_MIN_SIZE = 1 << 14;
+
+unsigned getDefaultSortThreads() {
+    unsigned threads = thread::hardware_concurrency();
+    return threads == 0 ? 1 : threads;
+}
+
+/**
+ * Runs task(0) .. task(threads - 1), one per thread, and waits for them.
+ */
+void runParallel(unsigned threads, const function<void(unsigned)> & task) {
+    vector<thread> workers;
+    for (unsigned t = 1; t < threads; t++) {
+        workers.push_back(thread(task, t));
+    }
+    task(0);
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+/**
+ * Unsigned image of a key with the same order, for the radix passes.
+ */
+unsigned long long getRadixKey(long long key) {
+    return (unsigned long long) key ^ (1ULL << 63);
+}
+
+unsigned long long getRadixKey(double key) {
+    unsigned long long bits;
+    memcpy(&bits, &key, sizeof(bits));
+    return (bits >> 63) ? ~bits : bits | (1ULL << 63);
+}
+
+template <typename T>
+void radixSort(vector<pair<T, long long> > & entries, unsigned threads) {
+    size_t n = entries.size();
+    bool sorted = true;
+    for (size_t i = 1; i < n && sorted; i++) {
+        sorted = !(entries[i].first < entries[i - 1].first);
+    }
+    if (sorted) return;
+
+    vector<pair<T, long long> > scratch(n);
+    pair<T, long long> * source = entries.data();
+    pair<T, long long> * destination = scratch.data();
+
+    vector<size_t> bounds(threads + 1);
+    for (unsigned t = 0; t <= threads; t++) {
+        bounds[t] = n * t / threads;
+    }
+    vector<vector<size_t> > counts(threads, vector<size_t>(256));
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        runParallel(threads, [&](unsigned t) {
+            size_t * count = counts[t].data();
+            fill(count, count + 256, 0);
+            for (size_t i = bounds[t]; i < bounds[t + 1]; i++) {
+                count[(getRadixKey(source[i].first) >> shift) & 0xFF]++;
+            }
+        });
+
+        // A digit every key shares moves nothing
+        bool trivial = false;
+        for (int digit = 0; digit < 256 && !trivial; digit++) {
+            size_t total = 0;
+            for (unsigned t = 0; t < threads; t++) {
+                total += counts[t][digit];
+            }
+            trivial = total == n;
+        }
+        if (trivial) continue;
+
+        // counts become the first destination of each (thread, digit)
+        size_t offset = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            for (unsigned t = 0; t < threads; t++) {
+                size_t count = counts[t][digit];
+                counts[t][digit] = offset;
+                offset += count;
+            }
+        }
+
+        runParallel(threads, [&](unsigned t) {
+            size_t * next = counts[t].data();
+            for (size_t i = bounds[t]; i < bounds[t + 1]; i++) {
+                destination[next[(getRadixKey(source[i].first) >> shift) & 0xFF]++] = source[i];
+            }
+        });
+        swap(source, destination);
+    }
+
+    if (source != entries.data()) {
+        entries.swap(scratch);
+    }
+}
+
+template <typename T, typename Less>
+void mergeSort(vector<pair<T, long long> > & entries, unsigned threads, Less less) {
+    size_t n = entries.size();
+    vector<size_t> bounds(threads + 1);
+    for (unsigned t = 0; t <= threads; t++) {
+        bounds[t] = n * t / threads;
+    }
+
+    runParallel(threads, [&](unsigned t) {
+        sort(entries.begin() + bounds[t], entries.begin() + bounds[t + 1], less);
+    });
+
+    // Merges neighbour chunks two by two until one is left
+    for (unsigned width = 1; width < threads; width *= 2) {
+        unsigned merges = (threads + 2 * width - 1) / (2 * width);
+        runParallel(merges, [&](unsigned m) {
+            unsigned first = 2 * width * m;
+            unsigned middle = min(first + width, threads);
+            unsigned last = min(first + 2 * width, threads);
+            inplace_merge(entries.begin() + bounds[first], entries.begin() + bounds[middle], entries.begin() + bounds[last], less);
+        });
+    }
+}
+
+/**
+ * Sorts entries by key.
+ * @param threads number of threads, 0 for one per core
+ */
+template <typename T>
+void parallelSort(vector<pair<T, long long> > & entries, unsigned threads = 0);
+
+template <typename T>
+unsigned getSortThreads(vector<pair<T, long long> > & entries, unsigned threads) {
+    if (threads == 0) {
+        threads = getDefaultSortThreads();
+    }
+    if (entries.size() < PARALLEL_SORT_MIN_SIZE) {
+        return 1;
+    }
+    return min((size_t) threads, entries.size() / PARALLEL_SORT_MIN_SIZE);
+}
+
+template <>
+void parallelSort<long long>(vector<pair<long long, long long> > & entries, unsigned threads) {
+    radixSort(entries, getSortThreads(entries, threads));
+}
+
+template <>
+void parallelSort<double>(vector<pair<double, long long> > & entries, unsigned threads) {
+    radixSort(entries, getSortThreads(entries, threads));
+}
+
+template <>
+void parallelSort<string>(vector<pair<string, long long> > & entries, unsigned threads) {
+    mergeSort(entries, getSortThreads(entries, threads), less<pair<string, long long> >());
+}
+
+/**
+ * Sorts entries in the order of less: the plain order of the pairs goes to
+ * parallelSort above, any other to a parallel merge sort.
+ */
+template <typename T>
+void parallelSort(vector<pair<T, long long> > & entries, unsigned threads, less<pair<T, long long> >) {
+    parallelSort(entries, threads);
+}
+
+template <typename T, typename Less>
+void parallelSort(vector<pair<T, long long> > & entries, unsigned threads, Less less) {
+    mergeSort(entries, getSortThreads(entries, threads), less);
+}
+
+#endif //PARALLELSORT_H
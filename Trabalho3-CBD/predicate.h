@@ -0,0 +1,412 @@
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include <algorithm>
+#include <functional>
+#include <string.h>
+
+#include "util.h"
+#include "schema.h"
+#include "queryable.h"
+#include "scanner.h"
+#include "typedkey.h"
+#include "statistics.h"
+#include "joinstream.h"
+
+/**
+ * column comparator value, the value being of the kind the column is
+ * compared as. The value of a predicate on a ? parameter is only known once
+ * the parameter is bound.
+ */
+struct ColumnPredicate {
+    int column;
+    JoinComparator comparator;
+    TypedKey value;
+    // Index of the ? parameter that gives the value, -1 for a constant
+    int parameter;
+
+    ColumnPredicate() : column(-1), comparator(EQUAL), parameter(-1) {}
+
+    bool evaluate(const TypedKey & key) const;
+};
+
+/**
+ * @return left comparator right, both keys being of the same kind
+ */
+bool compareKeys(const TypedKey & left, JoinComparator comparator, const TypedKey & right);
+
+/**
+ * @return the comparator as written in SQL
+ */
+string getComparatorSymbol(JoinComparator comparator);
+
+/**
+ * @return the value as written in SQL, strings quoted
+ */
+string describeValue(const TypedKey & value);
+
+/**
+ * @return "column comparator value", for EXPLAIN
+ */
+string describePredicate(const string & column_name, const ColumnPredicate & predicate);
+
+/**
+ * @param predicates as planned, those on a parameter compared as the kind
+ *        of their column
+ * @return the predicates with the values of their parameters: a number is
+ *         compared as the wider of its kind and the column's, a string as
+ *         the column's kind, as the planner does with the values written in
+ *         the query
+ */
+vector<ColumnPredicate> bindPredicates(const vector<ColumnPredicate> & predicates, const vector<TypedKey> & parameters);
+
+/**
+ * @return whether the scanner's registry passes every predicate, decoding
+ *         and comparing each value through a TypedKey
+ */
+bool passesPredicates(Scanner * scan, vector<ColumnPredicate> & predicates);
+
+/**
+ * A ColumnPredicate turned into code for one column type and comparator:
+ * the value is read from the registry bytes as stored and compared with a
+ * constant of the same type, with no decoding or switch per row.
+ */
+class CompiledPredicate {
+public:
+    virtual ~CompiledPredicate() {}
+
+    virtual bool evaluate(Scanner * scan) =0;
+};
+
+/**
+ * Stored is the type the column is written as, T the type it is compared as.
+ */
+template <typename Stored, typename T, typename Compare>
+class NumericPredicate : public CompiledPredicate {
+private:
+    int column;
+    T value;
+
+public:
+    NumericPredicate(int column, T value) : column(column), value(value) {}
+
+    bool evaluate(Scanner * scan) {
+        Stored stored;
+        memcpy(&stored, scan->getData(column), sizeof(stored));
+        return Compare()((T) stored, value);
+    }
+};
+
+/**
+ * CHAR column compared as a string, in place: the same order as
+ * string::compare, without building a string per row.
+ */
+template <typename Compare>
+class CharPredicate : public CompiledPredicate {
+private:
+    int column;
+    unsigned size;
+    string value;
+
+public:
+    CharPredicate(int column, unsigned size, string value) : column(column), size(size), value(value) {}
+
+    bool evaluate(Scanner * scan) {
+        const char * data = scan->getData(column);
+        size_t length = strnlen(data, size);
+        int order = memcmp(data, value.data(), min(length, value.size()));
+        if (order == 0) {
+            order = length < value.size() ? -1 : (length > value.size() ? 1 : 0);
+        }
+        return Compare()(order, 0);
+    }
+};
+
+/**
+ * Any other pair of column type and kind, such as a CHAR column compared
+ * as a number: decodes through the Scanner conversions.
+ */
+class ConvertingPredicate : public CompiledPredicate {
+private:
+    ColumnPredicate predicate;
+
+public:
+    ConvertingPredicate(const ColumnPredicate & predicate) : predicate(predicate) {}
+
+    bool evaluate(Scanner * scan) {
+        return predicate.evaluate(readTypedKey(scan, predicate.column, predicate.value.kind));
+    }
+};
+
+/**
+ * @return the predicate compiled for a column of schema_col's type, to be
+ *         deleted by the caller
+ */
+CompiledPredicate * compilePredicate(SchemaCol & schema_col, const ColumnPredicate & predicate);
+
+/**
+ * AND of compiled predicates over the registries of one table, the one
+ * most likely to reject a row for its cost tested first.
+ */
+class Conjunction {
+private:
+    struct Term {
+        ColumnPredicate predicate;
+        CompiledPredicate * compiled;
+        double selectivity;
+        double cost;
+    };
+
+    vector<Term> terms;
+
+    static bool isCheaperFilter(const Term & a, const Term & b);
+
+    void clear();
+
+public:
+    Conjunction();
+    ~Conjunction();
+    Conjunction(const Conjunction & other) = delete;
+    Conjunction & operator=(const Conjunction & other) = delete;
+
+    /**
+     * Compiles the predicates for the columns of table. With more than one,
+     * their order comes from the statistics of their columns, gathered once
+     * per column by the table.
+     *
+     * @param predicates on table column positions
+     */
+    void compile(Queryable * table, const vector<ColumnPredicate> & predicates);
+
+    bool evaluate(Scanner * scan);
+
+    /**
+     * @return the predicates in the order they are tested
+     */
+    vector<ColumnPredicate> getPredicates();
+};
+
+/**
+ * @return the estimated fraction of the rows of the column that pass the
+ *         predicate: 1 / distinct for EQUAL, the covered part of the range
+ *         for an integer range, a third for other ranges
+ */
+double estimateSelectivity(const ColumnStatistics & statistics, const ColumnPredicate & predicate);
+
+bool compareKeys(const TypedKey & left, JoinComparator comparator, const TypedKey & right) {
+    switch (comparator) {
+        case EQUAL         : return left == right;
+        case NOT_EQUAL     : return !(left == right);
+        case LESS          : return left < right;
+        case LESS_EQUAL    : return !(right < left);
+        case GREATER       : return right < left;
+        case GREATER_EQUAL : return !(left < right);
+        default            : return false;
+    }
+}
+
+bool ColumnPredicate::evaluate(const TypedKey & key) const {
+    return compareKeys(key, comparator, value);
+}
+
+string getComparatorSymbol(JoinComparator comparator) {
+    switch (comparator) {
+        case EQUAL         : return "=";
+        case NOT_EQUAL     : return "!=";
+        case LESS          : return "<";
+        case LESS_EQUAL    : return "<=";
+        case GREATER       : return ">";
+        case GREATER_EQUAL : return ">=";
+        default            : return "BAND";
+    }
+}
+
+string describeValue(const TypedKey & value) {
+    return value.kind == STRING_KEY ? "'" + value.string_value + "'" : toString(value);
+}
+
+string describePredicate(const string & column_name, const ColumnPredicate & predicate) {
+    return column_name + " " + getComparatorSymbol(predicate.comparator) + " " + describeValue(predicate.value);
+}
+
+vector<ColumnPredicate> bindPredicates(const vector<ColumnPredicate> & predicates, const vector<TypedKey> & parameters) {
+    vector<ColumnPredicate> bound = predicates;
+    for (size_t i = 0; i < bound.size(); i++) {
+        ColumnPredicate & predicate = bound[i];
+        if (predicate.parameter < 0 || (size_t) predicate.parameter >= parameters.size()) {
+            continue;
+        }
+        const TypedKey & value = parameters[predicate.parameter];
+        KeyKind column_kind = predicate.value.kind;
+        predicate.value = convertKey(value, value.kind == STRING_KEY ? column_kind : max(column_kind, value.kind));
+    }
+    return bound;
+}
+
+bool passesPredicates(Scanner * scan, vector<ColumnPredicate> & predicates) {
+    for (size_t i = 0; i < predicates.size(); i++) {
+        ColumnPredicate & predicate = predicates[i];
+        if (!predicate.evaluate(readTypedKey(scan, predicate.column, predicate.value.kind))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*****************************************
+ *************** COMPILING ***************
+ *****************************************/
+
+template <typename Stored, typename T>
+CompiledPredicate * compileNumeric(int column, JoinComparator comparator, T value) {
+    switch (comparator) {
+        case EQUAL         : return new NumericPredicate<Stored, T, equal_to<T> >(column, value);
+        case NOT_EQUAL     : return new NumericPredicate<Stored, T, not_equal_to<T> >(column, value);
+        case LESS          : return new NumericPredicate<Stored, T, less<T> >(column, value);
+        case LESS_EQUAL    : return new NumericPredicate<Stored, T, less_equal<T> >(column, value);
+        case GREATER       : return new NumericPredicate<Stored, T, greater<T> >(column, value);
+        case GREATER_EQUAL : return new NumericPredicate<Stored, T, greater_equal<T> >(column, value);
+        default            : return NULL;
+    }
+}
+
+CompiledPredicate * compileChar(int column, unsigned size, JoinComparator comparator, string value) {
+    switch (comparator) {
+        case EQUAL         : return new CharPredicate<equal_to<int> >(column, size, value);
+        case NOT_EQUAL     : return new CharPredicate<not_equal_to<int> >(column, size, value);
+        case LESS          : return new CharPredicate<less<int> >(column, size, value);
+        case LESS_EQUAL    : return new CharPredicate<less_equal<int> >(column, size, value);
+        case GREATER       : return new CharPredicate<greater<int> >(column, size, value);
+        case GREATER_EQUAL : return new CharPredicate<greater_equal<int> >(column, size, value);
+        default            : return NULL;
+    }
+}
+
+CompiledPredicate * compilePredicate(SchemaCol & schema_col, const ColumnPredicate & predicate) {
+    CompiledPredicate * compiled = NULL;
+    int column = predicate.column;
+    JoinComparator comparator = predicate.comparator;
+    long long integer_value = predicate.value.integer_value;
+    double real_value = predicate.value.real_value;
+
+    // The casts are the ones Scanner::getInt and getDouble make
+    switch (predicate.value.kind) {
+        case INTEGER_KEY :
+            switch (schema_col.type) {
+                case INT32       : compiled = compileNumeric<int, long long>(column, comparator, integer_value); break;
+                case INT64       :
+                case FOREIGN_KEY : compiled = compileNumeric<long long, long long>(column, comparator, integer_value); break;
+                case FLOAT       : compiled = compileNumeric<float, long long>(column, comparator, integer_value); break;
+                case DOUBLE      : compiled = compileNumeric<double, long long>(column, comparator, integer_value); break;
+                default          : break;
+            }
+            break;
+        case REAL_KEY :
+            switch (schema_col.type) {
+                case INT32       : compiled = compileNumeric<int, double>(column, comparator, real_value); break;
+                case INT64       :
+                case FOREIGN_KEY : compiled = compileNumeric<long long, double>(column, comparator, real_value); break;
+                case FLOAT       : compiled = compileNumeric<float, double>(column, comparator, real_value); break;
+                case DOUBLE      : compiled = compileNumeric<double, double>(column, comparator, real_value); break;
+                default          : break;
+            }
+            break;
+        case STRING_KEY :
+            if (schema_col.type == CHAR) {
+                compiled = compileChar(column, schema_col.getSize(), comparator, predicate.value.string_value);
+            }
+            break;
+    }
+    return compiled != NULL ? compiled : new ConvertingPredicate(predicate);
+}
+
+double estimateSelectivity(const ColumnStatistics & statistics, const ColumnPredicate & predicate) {
+    double distinct = max(statistics.distinct_keys, 1LL);
+    switch (predicate.comparator) {
+        case EQUAL     : return 1 / distinct;
+        case NOT_EQUAL : return 1 - 1 / distinct;
+        default        : break;
+    }
+
+    // The value of a parameter is not known yet
+    if (!statistics.has_integer_range || predicate.value.kind == STRING_KEY || predicate.parameter >= 0) {
+        return 1.0 / 3;
+    }
+    double value = predicate.value.kind == INTEGER_KEY ? predicate.value.integer_value : predicate.value.real_value;
+    double low = statistics.min_integer;
+    double high = statistics.max_integer;
+    // Share of [low, high] below value, a single value counting as a range of 1
+    double below = (value - low) / max(high - low, 1.0);
+    below = max(0.0, min(1.0, below));
+
+    bool keeps_below = predicate.comparator == LESS || predicate.comparator == LESS_EQUAL;
+    return keeps_below ? below : 1 - below;
+}
+
+/*****************************************
+ ************** CONJUNCTION **************
+ *****************************************/
+
+Conjunction::Conjunction() {
+}
+
+Conjunction::~Conjunction() {
+    clear();
+}
+
+void Conjunction::clear() {
+    for (size_t i = 0; i < terms.size(); i++) {
+        delete terms[i].compiled;
+    }
+    terms.clear();
+}
+
+/**
+ * Predicates that reject the most rows per unit of cost go first: a ranks
+ * before b when (selectivity - 1) / cost is lower.
+ */
+bool Conjunction::isCheaperFilter(const Term & a, const Term & b) {
+    return (a.selectivity - 1) / a.cost < (b.selectivity - 1) / b.cost;
+}
+
+void Conjunction::compile(Queryable * table, const vector<ColumnPredicate> & predicates) {
+    clear();
+    Schema schema = table->getSchema();
+    for (size_t i = 0; i < predicates.size(); i++) {
+        SchemaCol & schema_col = schema.getCols()->at(predicates[i].column);
+        Term term;
+        term.predicate = predicates[i];
+        term.compiled = compilePredicate(schema_col, predicates[i]);
+        term.selectivity = 1;
+        // Comparing strings or converting is slower than comparing numbers
+        bool numeric = schema_col.type != CHAR && predicates[i].value.kind != STRING_KEY;
+        term.cost = numeric ? 1 : 4;
+        terms.push_back(term);
+    }
+
+    if (terms.size() > 1) {
+        for (size_t i = 0; i < terms.size(); i++) {
+            terms[i].selectivity = estimateSelectivity(table->getStatistics(terms[i].predicate.column), terms[i].predicate);
+        }
+        stable_sort(terms.begin(), terms.end(), isCheaperFilter);
+    }
+}
+
+bool Conjunction::evaluate(Scanner * scan) {
+    for (size_t i = 0; i < terms.size(); i++) {
+        if (!terms[i].compiled->evaluate(scan)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+vector<ColumnPredicate> Conjunction::getPredicates() {
+    vector<ColumnPredicate> predicates;
+    for (size_t i = 0; i < terms.size(); i++) {
+        predicates.push_back(terms[i].predicate);
+    }
+    return predicates;
+}
+
+#endif //PREDICATE_H
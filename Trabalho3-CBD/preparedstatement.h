@@ -0,0 +1,363 @@
+#ifndef PREPAREDSTATEMENT_H
+#define PREPAREDSTATEMENT_H
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "util.h"
+#include "schema.h"
+#include "queryable.h"
+#include "catalog.h"
+#include "cursor.h"
+#include "sql.h"
+#include "query.h"
+
+/**
+ * A query parsed and planned once, and what it was planned against.
+ */
+struct CachedPlan {
+    SelectStatement statement;
+    Catalog * catalog;
+    Queryable * default_table;
+    string fingerprint;
+    vector<string> column_names;
+    // Operator trees of the query, each taken by one cursor at a time: a
+    // second tree is only planned while a cursor holds the first
+    vector<shared_ptr<Operator> > roots;
+};
+
+/**
+ * @return what the plans of the statement depend on: which table each name
+ *         it reads is, the table's columns, their types and sizes, which of
+ *         them are indexed, and the table's version, bumped by inserts and
+ *         by changes to its sort order or indexes
+ */
+string getSchemaFingerprint(SelectStatement & statement, Catalog * catalog, Queryable * default_table);
+
+/**
+ * @return a tree of the plan no cursor holds, planned again first if the
+ *         fingerprint of the tables changed, or NULL with the error set
+ */
+shared_ptr<Operator> takePlan(CachedPlan & plan, string & error);
+
+/**
+ * A SELECT parsed and planned once, run many times with the values of its
+ * ? parameters bound:
+ *
+ *     PreparedStatement statement = person_table.prepare("SELECT nome FROM person WHERE _id = ?");
+ *     statement.bindInt(0, 13);
+ *     Cursor cursor = statement.execute();
+ *
+ * Binding and executing skip the parser and planner. The tables queried
+ * must outlive the statement.
+ */
+class PreparedStatement {
+private:
+    shared_ptr<CachedPlan> plan;
+    vector<TypedKey> parameters;
+    vector<bool> bound;
+    string error;
+
+    bool bind(int index, const TypedKey & value);
+
+public:
+    /**
+     * A statement that failed to prepare, with no plan.
+     */
+    explicit PreparedStatement(string error = "statement not prepared");
+
+    PreparedStatement(shared_ptr<CachedPlan> plan);
+
+    int getNumberOfParameters();
+
+    /**
+     * Sets a parameter for the next executions.
+     * @param index of the ?, from 0, in the order they appear in the query
+     * @return false if the query has no such parameter
+     */
+    bool bindInt(int index, long long value);
+    bool bindDouble(int index, double value);
+    bool bindString(int index, string value);
+
+    void clearBindings();
+
+    /**
+     * Runs the plan with the parameters bound. The plan is made again if
+     * the schema of a table it reads changed since it was made.
+     * @return the rows, or an empty Cursor with its error set
+     */
+    Cursor execute();
+
+    /**
+     * @return empty unless the query failed to prepare
+     */
+    string getError();
+};
+
+/**
+ * Plans of the queries prepared, by their normalized text, so preparing a
+ * query again skips the parser and the planner. The plans used least
+ * recently are dropped past the capacity.
+ */
+class PlanCache {
+private:
+    typedef list<pair<string, shared_ptr<CachedPlan> > > plan_list_t;
+
+    Catalog * catalog;
+    size_t capacity;
+    // Most recently used first
+    plan_list_t plans;
+    unordered_map<string, plan_list_t::iterator> positions;
+    long long hits;
+    long long misses;
+
+public:
+    PlanCache(Catalog * catalog, size_t capacity = 256);
+
+    /**
+     * Over the default Catalog.
+     */
+    static PlanCache & getDefault();
+
+    /**
+     * @param default_table read when the query has no FROM
+     * @return the statement, with its error set if the query is not valid
+     */
+    PreparedStatement prepare(string sql, Queryable * default_table = NULL);
+
+    void clear();
+
+    long long getNumberOfPlans();
+    long long getHits();
+    long long getMisses();
+};
+
+/**
+ * @return the statement with the values of its parameters written in
+ *         place of each ?
+ */
+SelectStatement bindStatement(const SelectStatement & statement, const vector<TypedKey> & parameters);
+
+/*****************************************
+ ************** CACHED PLAN **************
+ *****************************************/
+
+string getSchemaFingerprint(SelectStatement & statement, Catalog * catalog, Queryable * default_table) {
+    vector<string> names(1, statement.table);
+    for (size_t i = 0; i < statement.joins.size(); i++) {
+        names.push_back(statement.joins[i].table);
+    }
+
+    ostringstream fingerprint;
+    for (size_t i = 0; i < names.size(); i++) {
+        Queryable * table = names[i].empty() ? default_table : catalog->get(names[i]);
+        fingerprint << names[i] << "@" << (void *) table << "(";
+        if (table != NULL) {
+            fingerprint << "v" << table->getVersion() << ":";
+            Schema schema = table->getSchema();
+            vector<SchemaCol> * cols = schema.getCols();
+            for (size_t c = 0; c < cols->size(); c++) {
+                SchemaCol & col = cols->at(c);
+                fingerprint << col.key << ":" << col.type << ":" << col.array_size << (table->hasIndex(c) ? "*" : "") << ",";
+            }
+        }
+        fingerprint << ")";
+    }
+    return fingerprint.str();
+}
+
+shared_ptr<Operator> takePlan(CachedPlan & plan, string & error) {
+    string fingerprint = getSchemaFingerprint(plan.statement, plan.catalog, plan.default_table);
+    if (fingerprint != plan.fingerprint) {
+        // Cursors still running a stale tree keep it until they are deleted
+        plan.roots.clear();
+        plan.fingerprint = fingerprint;
+    }
+
+    for (size_t i = 0; i < plan.roots.size(); i++) {
+        if (plan.roots[i].use_count() == 1) {
+            return plan.roots[i];
+        }
+    }
+
+    QueryPlanner planner(plan.catalog, plan.default_table);
+    Operator * root = planner.plan(plan.statement);
+    if (root == NULL) {
+        error = planner.getError();
+        return shared_ptr<Operator>();
+    }
+    plan.column_names = getColumnNames(plan.statement, root);
+    plan.roots.push_back(shared_ptr<Operator>(root));
+    return plan.roots.back();
+}
+
+SelectStatement bindStatement(const SelectStatement & statement, const vector<TypedKey> & parameters) {
+    SelectStatement bound = statement;
+    for (size_t i = 0; i < bound.conditions.size(); i++) {
+        Condition & condition = bound.conditions[i];
+        if (condition.parameter >= 0) {
+            condition.value = parameters[condition.parameter];
+            condition.parameter = -1;
+        }
+    }
+    bound.number_of_parameters = 0;
+    return bound;
+}
+
+/*****************************************
+ ********** PREPARED STATEMENT ***********
+ *****************************************/
+
+PreparedStatement::PreparedStatement(string error) {
+    this->error = error;
+}
+
+PreparedStatement::PreparedStatement(shared_ptr<CachedPlan> plan) {
+    this->plan = plan;
+    this->parameters.resize(plan->statement.number_of_parameters);
+    this->bound.assign(plan->statement.number_of_parameters, false);
+}
+
+int PreparedStatement::getNumberOfParameters() {
+    return parameters.size();
+}
+
+bool PreparedStatement::bind(int index, const TypedKey & value) {
+    if (index < 0 || (size_t) index >= parameters.size()) {
+        return false;
+    }
+    parameters[index] = value;
+    bound[index] = true;
+    return true;
+}
+
+bool PreparedStatement::bindInt(int index, long long value) {
+    TypedKey key;
+    key.kind = INTEGER_KEY;
+    key.integer_value = value;
+    return bind(index, key);
+}
+
+bool PreparedStatement::bindDouble(int index, double value) {
+    TypedKey key;
+    key.kind = REAL_KEY;
+    key.real_value = value;
+    return bind(index, key);
+}
+
+bool PreparedStatement::bindString(int index, string value) {
+    TypedKey key;
+    key.kind = STRING_KEY;
+    key.string_value = value;
+    return bind(index, key);
+}
+
+void PreparedStatement::clearBindings() {
+    bound.assign(bound.size(), false);
+}
+
+Cursor PreparedStatement::execute() {
+    if (plan == NULL) {
+        return Cursor(error);
+    }
+    for (size_t i = 0; i < bound.size(); i++) {
+        if (!bound[i]) {
+            return Cursor("parameter " + to_string(i) + " is not bound");
+        }
+    }
+
+    // The plan shown has the values bound, so it is made for this run
+    if (plan->statement.explain) {
+        SelectStatement statement = bindStatement(plan->statement, parameters);
+        return executeQuery(statement, plan->catalog, plan->default_table);
+    }
+
+    string failure;
+    shared_ptr<Operator> root = takePlan(*plan, failure);
+    if (root == NULL) {
+        return Cursor(failure);
+    }
+    if (!parameters.empty()) {
+        root->bind(parameters);
+    }
+    return Cursor(root, plan->column_names);
+}
+
+string PreparedStatement::getError() {
+    return error;
+}
+
+/*****************************************
+ ************** PLAN CACHE ***************
+ *****************************************/
+
+PlanCache::PlanCache(Catalog * catalog, size_t capacity) {
+    this->catalog = catalog;
+    this->capacity = capacity;
+    this->hits = 0;
+    this->misses = 0;
+}
+
+PlanCache & PlanCache::getDefault() {
+    static PlanCache cache(&Catalog::getDefault());
+    return cache;
+}
+
+PreparedStatement PlanCache::prepare(string sql, Queryable * default_table) {
+    Parser parser;
+    string normalized;
+    if (!parser.normalize(sql, normalized)) {
+        return PreparedStatement(parser.getError());
+    }
+    ostringstream key;
+    key << normalized << "\n" << (void *) default_table;
+
+    unordered_map<string, plan_list_t::iterator>::iterator position = positions.find(key.str());
+    if (position != positions.end()) {
+        hits++;
+        plans.splice(plans.begin(), plans, position->second);
+        return PreparedStatement(plans.front().second);
+    }
+
+    misses++;
+    shared_ptr<CachedPlan> plan(new CachedPlan());
+    if (!parser.parse(sql, plan->statement)) {
+        return PreparedStatement(parser.getError());
+    }
+    plan->catalog = catalog;
+    plan->default_table = default_table;
+
+    // Planned now so an invalid query fails here rather than on execute
+    string error;
+    if (!plan->statement.explain && takePlan(*plan, error) == NULL) {
+        return PreparedStatement(error);
+    }
+
+    plans.push_front(make_pair(key.str(), plan));
+    positions[key.str()] = plans.begin();
+    if (plans.size() > capacity) {
+        positions.erase(plans.back().first);
+        plans.pop_back();
+    }
+    return PreparedStatement(plan);
+}
+
+void PlanCache::clear() {
+    plans.clear();
+    positions.clear();
+}
+
+long long PlanCache::getNumberOfPlans() {
+    return plans.size();
+}
+
+long long PlanCache::getHits() {
+    return hits;
+}
+
+long long PlanCache::getMisses() {
+    return misses;
+}
+
+#endif //PREPAREDSTATEMENT_H
@@ -0,0 +1,811 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <limits>
+#include <math.h>
+
+#include "util.h"
+#include "schema.h"
+#include "queryable.h"
+#include "catalog.h"
+#include "cursor.h"
+#include "sql.h"
+#include "operator.h"
+#include "batch.h"
+
+/**
+ * Turns a SelectStatement into a tree of operators:
+ *  - each table is read by the cheapest of a full Scan, an IndexScan of
+ *    the _id range (binary search, or dense lookup when the ids have no
+ *    gap) and an IndexLookup of a secondary index on a WHERE column, with
+ *    the WHERE conditions left tested inside the scan;
+ *  - only the columns the query uses are decoded;
+ *  - tables are joined left to right, each one hashed and probed by the
+ *    join of the ones before it, merged with the first table when both
+ *    are stored in key order, or, joined on its _id, looked up for each
+ *    row when that reads fewer registries than hashing it. With a LIMIT
+ *    and nothing that needs every row, only the rows the limit takes are
+ *    costed;
+ *  - GROUP BY and aggregates become an Aggregate over the joined tuples;
+ *  - ORDER BY becomes a Sort, or with a LIMIT a TopN that keeps only the
+ *    first rows; a Project puts the columns in SELECT order and a Limit
+ *    stops the pipeline once it has its rows.
+ * Vectorized, the scans, WHERE conditions and joins run on batches, handed
+ * to the tuple operators after the last join.
+ */
+class QueryPlanner {
+private:
+
+    struct PlannedTable {
+        Queryable * table;
+        string alias;
+        vector<ColumnPredicate> predicates;
+        vector<bool> used_columns;
+        // Registries the access picked reads
+        double access_cost;
+    };
+
+    // Cost of a registry read through a secondary index, against 1 for a
+    // registry of a sequential scan: the positions are read in file order,
+    // so no block is read twice, but they are gathered and sorted first
+    static const int LOOKUP_COST = 2;
+
+    // Largest LIMIT kept by a TopN, which holds its rows in memory; past
+    // it a Sort, which can spill, runs under the Limit
+    static const long long MAX_TOP_N = 1 << 16;
+
+    Catalog * catalog;
+    Queryable * default_table;
+    bool vectorized;
+    // Rows the query stops after, -1 if it reads every row
+    long long row_goal;
+    vector<PlannedTable> tables;
+    // The access paths costed for each table, for EXPLAIN
+    vector<string> access_paths;
+    string error;
+
+    bool fail(const string & message);
+    bool addTable(string name, string alias);
+    bool resolve(const ColumnReference & column, int & table_index, int & column_position);
+    bool addCondition(const Condition & condition);
+    bool use(const ColumnReference & column, pair<int, int> & resolved);
+    int findColumn(Operator * root, const pair<int, int> & resolved);
+    double estimateRows(PlannedTable & planned, double rows, const vector<ColumnPredicate> & predicates);
+    double estimateJoin(double left_rows, double right_rows, const pair<int, int> & left_key, const pair<int, int> & right_key);
+    Operator * createAccess(PlannedTable & planned);
+    BatchOperator * createBatchAccess(PlannedTable & planned);
+    Operator * createBatchJoins(const vector<pair<pair<int, int>, pair<int, int> > > & join_keys);
+    Operator * createJoins(const vector<pair<pair<int, int>, pair<int, int> > > & join_keys);
+    bool useTopN(SelectStatement & statement);
+    Operator * createSort(Operator * root, vector<SortKey> & keys, SelectStatement & statement);
+    Operator * planAggregate(Operator * root, SelectStatement & statement);
+    Operator * planSelect(Operator * root, SelectStatement & statement);
+
+public:
+    /**
+     * @param default_table read when the query has no FROM
+     */
+    QueryPlanner(Catalog * catalog, Queryable * default_table = NULL);
+
+    /**
+     * Plans the scans and joins as batch operators. Off by default.
+     */
+    void setVectorized(bool vectorized);
+
+    /**
+     * @return the root operator, to be deleted by the caller, or NULL with
+     *         the error set
+     */
+    Operator * plan(SelectStatement & statement);
+
+    /**
+     * @return the operator tree of the plan, then the access paths costed
+     *         for each table by the last call to plan
+     */
+    vector<string> explain(Operator * root);
+
+    string getError();
+};
+
+/**
+ * Parses and plans the query, which runs as the Cursor moves. A query that
+ * fails gives an empty Cursor with its error set. EXPLAIN SELECT gives the
+ * plan instead of running it, a line per row in the column plan. EXPLAIN
+ * ANALYZE SELECT runs the query to the end first, and gives with each
+ * operator the rows it output, its time, and the bytes read, registries
+ * decoded and peak memory it counted.
+ */
+Cursor executeQuery(string sql, Catalog * catalog, Queryable * default_table = NULL);
+
+Cursor executeQuery(SelectStatement & statement, Catalog * catalog, Queryable * default_table = NULL);
+
+/**
+ * @return the names of the columns of the plan's rows: table.column when
+ *         the query joins tables, column otherwise
+ */
+vector<string> getColumnNames(SelectStatement & statement, Operator * root);
+
+QueryPlanner::QueryPlanner(Catalog * catalog, Queryable * default_table) {
+    this->row_goal = -1;
+    this->catalog = catalog;
+    this->default_table = default_table;
+    this->vectorized = false;
+}
+
+void QueryPlanner::setVectorized(bool vectorized) {
+    this->vectorized = vectorized;
+}
+
+bool QueryPlanner::fail(const string & message) {
+    if (error.empty()) {
+        error = message;
+    }
+    return false;
+}
+
+string QueryPlanner::getError() {
+    return error;
+}
+
+bool QueryPlanner::addTable(string name, string alias) {
+    Queryable * table = name.empty() ? default_table : catalog->get(name);
+    if (table == NULL) {
+        return fail(name.empty() ? "no table to query" : "unknown table " + name);
+    }
+    if (alias.empty()) {
+        alias = table->getName();
+    }
+    for (size_t i = 0; i < tables.size(); i++) {
+        if (tables[i].alias == alias) {
+            return fail("table " + alias + " appears twice, give it an alias");
+        }
+    }
+
+    PlannedTable planned;
+    planned.table = table;
+    planned.alias = alias;
+    planned.used_columns.assign(table->getSchema().getNumberOfCols(), false);
+    tables.push_back(planned);
+    return true;
+}
+
+bool QueryPlanner::resolve(const ColumnReference & column, int & table_index, int & column_position) {
+    table_index = -1;
+    for (size_t i = 0; i < tables.size(); i++) {
+        if (!column.table.empty() && column.table != tables[i].alias && column.table != tables[i].table->getName()) {
+            continue;
+        }
+        int position = tables[i].table->getSchema().getColPosition(column.column);
+        if (position < 0) continue;
+        if (table_index >= 0) {
+            return fail("column " + column.toString() + " is ambiguous");
+        }
+        table_index = i;
+        column_position = position;
+    }
+    if (table_index < 0) {
+        return fail("unknown column " + column.toString());
+    }
+    return true;
+}
+
+/**
+ * @return whether the whole text reads as a number of key_kind
+ */
+bool isNumber(const string & text, KeyKind key_kind) {
+    if (text.empty()) return false;
+    char * end;
+    if (key_kind == INTEGER_KEY) {
+        strtoll(text.c_str(), &end, 10);
+    } else {
+        strtod(text.c_str(), &end);
+    }
+    return *end == '\0';
+}
+
+bool QueryPlanner::addCondition(const Condition & condition) {
+    int table_index, column_position;
+    if (!resolve(condition.column, table_index, column_position)) {
+        return false;
+    }
+    PlannedTable & planned = tables[table_index];
+    KeyKind column_kind = getKeyKind(planned.table->getSchema().getCols()->at(column_position).type);
+
+    // A quoted number is read as the column type: dre = '13' is dre = 13
+    KeyKind key_kind = condition.value.kind == STRING_KEY ? column_kind : max(column_kind, condition.value.kind);
+    if (condition.parameter < 0 && condition.value.kind == STRING_KEY && column_kind != STRING_KEY &&
+        !isNumber(condition.value.string_value, column_kind)) {
+        return fail("'" + condition.value.string_value + "' is not a number, as column " + condition.column.toString() + " is");
+    }
+
+    ColumnPredicate predicate;
+    predicate.column = column_position;
+    predicate.comparator = condition.comparator;
+    // A parameter is compared as the column until it is bound
+    predicate.parameter = condition.parameter;
+    if (condition.parameter >= 0) {
+        predicate.value.kind = column_kind;
+    } else {
+        predicate.value = convertKey(condition.value, key_kind);
+    }
+    planned.predicates.push_back(predicate);
+    return true;
+}
+
+/**
+ * @return whether a predicate is on a ? parameter, whose value is unknown
+ *         while planning
+ */
+bool hasParameter(const vector<ColumnPredicate> & predicates) {
+    for (size_t i = 0; i < predicates.size(); i++) {
+        if (predicates[i].parameter >= 0) return true;
+    }
+    return false;
+}
+
+/**
+ * @return the rows of the table that pass the predicates, rows of them
+ *         passing the ones already used to find them
+ */
+double QueryPlanner::estimateRows(PlannedTable & planned, double rows, const vector<ColumnPredicate> & predicates) {
+    for (size_t i = 0; i < predicates.size(); i++) {
+        rows *= estimateSelectivity(planned.table->getStatistics(predicates[i].column), predicates[i]);
+    }
+    return rows;
+}
+
+/**
+ * Each left row meets right rows / distinct keys, the side with more
+ * distinct keys bounding the matches.
+ */
+double QueryPlanner::estimateJoin(double left_rows, double right_rows, const pair<int, int> & left_key, const pair<int, int> & right_key) {
+    long long left_distinct = tables[left_key.first].table->getStatistics(left_key.second).distinct_keys;
+    long long right_distinct = tables[right_key.first].table->getStatistics(right_key.second).distinct_keys;
+    return left_rows * right_rows / max(max(left_distinct, right_distinct), 1LL);
+}
+
+/**
+ * Costs, in registries read, each way to find the rows of the table:
+ *  - a full scan reads them all;
+ *  - an _id range reads the registries in it, after a binary search in the
+ *    header, or a single step when the ids are dense;
+ *  - a secondary index on a column with range predicates reads the
+ *    registries in the range, after a binary search in the index.
+ * The rows in a range are counted in the header or the index, not guessed.
+ */
+Operator * QueryPlanner::createAccess(PlannedTable & planned) {
+    vector<int> column_positions;
+    for (size_t i = 0; i < planned.used_columns.size(); i++) {
+        if (planned.used_columns[i]) column_positions.push_back(i);
+    }
+
+    header_t * header = planned.table->getHeader();
+    double number_of_rows = header->size();
+    double search_cost = log2(number_of_rows + 1);
+    ostringstream paths;
+    paths << describeTable(planned.table, planned.alias) << ": full scan " << number_of_rows;
+
+    // The full scan to beat
+    double best_cost = number_of_rows;
+    double best_rows = number_of_rows;
+    vector<ColumnPredicate> best_predicates = planned.predicates;
+    string best_path = "full scan";
+
+    long long min_id, max_id;
+    vector<ColumnPredicate> id_bounds;
+    vector<ColumnPredicate> id_rest;
+    bool dense = false;
+    bool by_id = false;
+    if (getIdRange(planned.predicates, min_id, max_id, id_bounds, id_rest)) {
+        double matched;
+        if (hasParameter(id_bounds)) {
+            matched = estimateRows(planned, number_of_rows, id_bounds);
+        } else {
+            header_t::iterator first = lower_bound(header->begin(), header->end(), make_pair(min_id, numeric_limits<long long>::min()));
+            header_t::iterator last = upper_bound(header->begin(), header->end(), make_pair(max_id, numeric_limits<long long>::max()));
+            matched = max(last - first, (ptrdiff_t) 0);
+        }
+        dense = hasDenseIds(header);
+        double cost = (dense ? 1 : search_cost) + matched;
+        paths << ", _id " << (dense ? "dense lookup " : "binary search ") << (long long) ceil(cost);
+        if (cost < best_cost) {
+            by_id = true;
+            best_cost = cost;
+            best_rows = matched;
+            best_predicates = id_rest;
+            best_path = "_id";
+        }
+    }
+
+    int index_column = -1;
+    vector<ColumnPredicate> index_predicates;
+    for (size_t i = 0; i < planned.predicates.size(); i++) {
+        int column = planned.predicates[i].column;
+        bool seen = false;
+        for (size_t j = 0; j < i; j++) {
+            seen = seen || planned.predicates[j].column == column;
+        }
+        SecondaryIndex * index = column == 0 || seen ? NULL : planned.table->getIndex(column);
+        if (index == NULL) continue;
+
+        // The predicates the index can answer become its range, the others stay
+        KeyRange range;
+        vector<ColumnPredicate> range_predicates;
+        vector<ColumnPredicate> rest;
+        for (size_t j = 0; j < planned.predicates.size(); j++) {
+            ColumnPredicate & predicate = planned.predicates[j];
+            if (predicate.column == column && predicate.value.kind == index->getKeyKind() && range.add(predicate)) {
+                range_predicates.push_back(predicate);
+            } else {
+                rest.push_back(predicate);
+            }
+        }
+        if (range_predicates.empty()) continue;
+
+        double matched;
+        if (hasParameter(range_predicates)) {
+            matched = estimateRows(planned, index->getNumberOfEntries(), range_predicates);
+        } else {
+            pair<long long, long long> entries = index->find(range);
+            matched = entries.second - entries.first;
+        }
+        double cost = log2(index->getNumberOfEntries() + 1) + matched * LOOKUP_COST;
+        string column_name = planned.table->getSchema().getCols()->at(column).key;
+        paths << ", index on " << column_name << " " << (long long) ceil(cost);
+        if (cost < best_cost) {
+            by_id = false;
+            index_column = column;
+            index_predicates = range_predicates;
+            best_cost = cost;
+            best_rows = matched;
+            best_predicates = rest;
+            best_path = "index on " + column_name;
+        }
+    }
+    paths << " -> " << best_path;
+    access_paths.push_back(paths.str());
+    planned.access_cost = best_cost;
+
+    Operator * access;
+    if (index_column >= 0) {
+        access = new IndexLookupOperator(planned.table, planned.alias, column_positions, best_predicates, index_column, index_predicates);
+    } else if (by_id) {
+        access = new IndexScanOperator(planned.table, planned.alias, column_positions, best_predicates, id_bounds, dense);
+    } else {
+        access = new ScanOperator(planned.table, planned.alias, column_positions, best_predicates);
+    }
+    access->setEstimatedRows(estimateRows(planned, best_rows, best_predicates));
+    return access;
+}
+
+BatchOperator * QueryPlanner::createBatchAccess(PlannedTable & planned) {
+    long long min_id, max_id;
+    vector<ColumnPredicate> id_bounds;
+    vector<ColumnPredicate> predicates;
+    getIdRange(planned.predicates, min_id, max_id, id_bounds, predicates);
+
+    // The filter needs the columns of the predicates in the batch
+    vector<bool> read_columns = planned.used_columns;
+    for (size_t i = 0; i < predicates.size(); i++) {
+        read_columns[predicates[i].column] = true;
+    }
+    vector<int> column_positions;
+    vector<int> indexes(read_columns.size(), -1);
+    for (size_t i = 0; i < read_columns.size(); i++) {
+        if (!read_columns[i]) continue;
+        indexes[i] = column_positions.size();
+        column_positions.push_back(i);
+    }
+
+    header_t * header = planned.table->getHeader();
+    header_t::iterator first = lower_bound(header->begin(), header->end(), make_pair(min_id, numeric_limits<long long>::min()));
+    header_t::iterator last = upper_bound(header->begin(), header->end(), make_pair(max_id, numeric_limits<long long>::max()));
+    double matched = max(last - first, (ptrdiff_t) 0);
+
+    BatchOperator * access = new BatchScanOperator(planned.table, planned.alias, column_positions, min_id, max_id);
+    access->setEstimatedRows(matched);
+    if (predicates.empty()) {
+        return access;
+    }
+    double estimated_rows = estimateRows(planned, matched, predicates);
+    for (size_t i = 0; i < predicates.size(); i++) {
+        predicates[i].column = indexes[predicates[i].column];
+    }
+    access = new BatchFilterOperator(access, predicates);
+    access->setEstimatedRows(estimated_rows);
+    return access;
+}
+
+Operator * QueryPlanner::createBatchJoins(const vector<pair<pair<int, int>, pair<int, int> > > & join_keys) {
+    BatchOperator * root = createBatchAccess(tables[0]);
+    double estimated_rows = root->getEstimatedRows();
+    for (size_t i = 0; i < join_keys.size(); i++) {
+        BatchOperator * build = createBatchAccess(tables[join_keys[i].second.first]);
+        PlannedTable & left_table = tables[join_keys[i].first.first];
+        PlannedTable & right_table = tables[join_keys[i].second.first];
+        int probe_key = root->findColumn(left_table.alias, left_table.table->getSchema().getCols()->at(join_keys[i].first.second).key);
+        int build_key = build->findColumn(right_table.alias, right_table.table->getSchema().getCols()->at(join_keys[i].second.second).key);
+        KeyKind key_kind = max(root->getColumns()[probe_key].key_kind, build->getColumns()[build_key].key_kind);
+        estimated_rows = estimateJoin(estimated_rows, build->getEstimatedRows(), join_keys[i].first, join_keys[i].second);
+        root = new BatchHashJoinOperator(root, build, probe_key, build_key, key_kind);
+        root->setEstimatedRows(estimated_rows);
+    }
+    Operator * tuples = new BatchToTupleOperator(root);
+    tuples->setEstimatedRows(estimated_rows);
+    return tuples;
+}
+
+bool QueryPlanner::use(const ColumnReference & column, pair<int, int> & resolved) {
+    if (!resolve(column, resolved.first, resolved.second)) {
+        return false;
+    }
+    tables[resolved.first].used_columns[resolved.second] = true;
+    return true;
+}
+
+int QueryPlanner::findColumn(Operator * root, const pair<int, int> & resolved) {
+    PlannedTable & planned = tables[resolved.first];
+    return root->findColumn(planned.alias, planned.table->getSchema().getCols()->at(resolved.second).key);
+}
+
+Operator * QueryPlanner::createJoins(const vector<pair<pair<int, int>, pair<int, int> > > & join_keys) {
+    Operator * root = createAccess(tables[0]);
+    for (size_t i = 0; i < join_keys.size(); i++) {
+        PlannedTable & left_table = tables[join_keys[i].first.first];
+        PlannedTable & right_table = tables[join_keys[i].second.first];
+
+        Operator * build = createAccess(right_table);
+        int probe_key = findColumn(root, join_keys[i].first);
+        int build_key = findColumn(build, join_keys[i].second);
+        KeyKind left_kind = root->getColumns()[probe_key].key_kind;
+        KeyKind right_kind = build->getColumns()[build_key].key_kind;
+        KeyKind key_kind = max(left_kind, right_kind);
+
+        // Only the first join reads its left side straight from a table
+        bool sorted = i == 0 && left_kind == right_kind &&
+                      left_table.table->isSortedOn(join_keys[i].first.second) &&
+                      right_table.table->isSortedOn(join_keys[i].second.second);
+        double estimated_rows = estimateJoin(root->getEstimatedRows(), build->getEstimatedRows(), join_keys[i].first, join_keys[i].second);
+
+        // A lookup per outer row needed against reading the table once to hash
+        // it. Joins after this one give at least a row per row, so the goal
+        // bounds the rows needed from this one too
+        bool lookup = false;
+        if (!sorted && join_keys[i].second.second == 0 && left_kind == INTEGER_KEY && right_kind == INTEGER_KEY) {
+            double outer_rows = root->getEstimatedRows();
+            if (row_goal >= 0 && estimated_rows > 0) {
+                outer_rows = min(outer_rows, ceil(row_goal * outer_rows / estimated_rows));
+            }
+            double lookup_cost = outer_rows * LOOKUP_COST;
+            ostringstream paths;
+            paths << describeTable(right_table.table, right_table.alias) << ": hash join " << (long long) ceil(right_table.access_cost)
+                  << ", _id lookup per row " << (long long) ceil(lookup_cost);
+            lookup = lookup_cost < right_table.access_cost;
+            paths << " -> " << (lookup ? "_id lookup" : "hash join");
+            access_paths.push_back(paths.str());
+        }
+
+        if (sorted) {
+            root = new MergeJoinOperator(root, build, probe_key, build_key, key_kind);
+        } else if (lookup) {
+            vector<int> column_positions;
+            for (size_t c = 0; c < right_table.used_columns.size(); c++) {
+                if (right_table.used_columns[c]) column_positions.push_back(c);
+            }
+            delete build;
+            root = new IndexNestedLoopOperator(root, probe_key, right_table.table, right_table.alias, column_positions, right_table.predicates);
+        } else {
+            root = new HashJoinOperator(root, build, probe_key, build_key, key_kind);
+        }
+        root->setEstimatedRows(estimated_rows);
+    }
+    return root;
+}
+
+bool QueryPlanner::useTopN(SelectStatement & statement) {
+    return !statement.order_by.empty() && statement.limit >= 0 && statement.limit <= MAX_TOP_N;
+}
+
+Operator * QueryPlanner::createSort(Operator * root, vector<SortKey> & keys, SelectStatement & statement) {
+    double estimated_rows = root->getEstimatedRows();
+    if (useTopN(statement)) {
+        root = new TopNOperator(root, keys, statement.limit);
+        root->setEstimatedRows(estimated_rows < 0 ? statement.limit : min(estimated_rows, (double) statement.limit));
+    } else {
+        root = new SortOperator(root, keys);
+        root->setEstimatedRows(estimated_rows);
+    }
+    return root;
+}
+
+Operator * QueryPlanner::planAggregate(Operator * root, SelectStatement & statement) {
+    if (statement.columns.empty()) {
+        fail("SELECT * cannot be grouped, name the columns");
+        delete root;
+        return NULL;
+    }
+
+    vector<pair<int, int> > groups;
+    vector<int> group_columns;
+    for (size_t i = 0; i < statement.group_by.size(); i++) {
+        pair<int, int> resolved;
+        resolve(statement.group_by[i], resolved.first, resolved.second);
+        groups.push_back(resolved);
+        group_columns.push_back(findColumn(root, resolved));
+    }
+
+    // Select and order items become indexes of the Aggregate tuple
+    vector<AggregateColumn> aggregates;
+    vector<SelectItem> items;
+    for (size_t i = 0; i < statement.columns.size(); i++) {
+        items.push_back(statement.columns[i]);
+    }
+    for (size_t i = 0; i < statement.order_by.size(); i++) {
+        items.push_back(statement.order_by[i].item);
+    }
+
+    vector<int> indexes;
+    for (size_t i = 0; i < items.size() && error.empty(); i++) {
+        pair<int, int> resolved(-1, -1);
+        if (!items[i].column.column.empty()) {
+            resolve(items[i].column, resolved.first, resolved.second);
+        }
+        if (!items[i].aggregate) {
+            int group = find(groups.begin(), groups.end(), resolved) - groups.begin();
+            if (group == (int) groups.size()) {
+                fail("column " + items[i].toString() + " must be in GROUP BY or inside an aggregate");
+            }
+            indexes.push_back(group);
+            continue;
+        }
+
+        AggregateColumn aggregate;
+        aggregate.function = items[i].function;
+        aggregate.column = resolved.first < 0 ? -1 : findColumn(root, resolved);
+        size_t a = 0;
+        while (a < aggregates.size() &&
+               (aggregates[a].function != aggregate.function || aggregates[a].column != aggregate.column)) {
+            a++;
+        }
+        if (a == aggregates.size()) {
+            aggregates.push_back(aggregate);
+        }
+        indexes.push_back(groups.size() + a);
+    }
+    if (!error.empty()) {
+        delete root;
+        return NULL;
+    }
+
+    // A group per combination of the group columns' keys, at most a group per row
+    double estimated_rows = 1;
+    for (size_t i = 0; i < groups.size(); i++) {
+        estimated_rows *= max(tables[groups[i].first].table->getStatistics(groups[i].second).distinct_keys, 1LL);
+    }
+    if (!groups.empty() && root->getEstimatedRows() >= 0) {
+        estimated_rows = min(estimated_rows, root->getEstimatedRows());
+    }
+    root = new AggregateOperator(root, group_columns, aggregates);
+    root->setEstimatedRows(estimated_rows);
+
+    if (!statement.order_by.empty()) {
+        vector<SortKey> keys;
+        for (size_t i = 0; i < statement.order_by.size(); i++) {
+            SortKey key;
+            key.column = indexes[statement.columns.size() + i];
+            key.descending = statement.order_by[i].descending;
+            keys.push_back(key);
+        }
+        root = createSort(root, keys, statement);
+    }
+
+    indexes.resize(statement.columns.size());
+    estimated_rows = root->getEstimatedRows();
+    root = new ProjectOperator(root, indexes);
+    root->setEstimatedRows(estimated_rows);
+
+    // Aggregates are named as written in the query
+    vector<OperatorColumn> & columns = root->getColumns();
+    for (size_t i = 0; i < statement.columns.size(); i++) {
+        if (statement.columns[i].aggregate) {
+            columns[i].table = "";
+            columns[i].name = statement.columns[i].toString();
+        }
+    }
+    return root;
+}
+
+Operator * QueryPlanner::planSelect(Operator * root, SelectStatement & statement) {
+    if (!statement.order_by.empty()) {
+        vector<SortKey> keys;
+        for (size_t i = 0; i < statement.order_by.size(); i++) {
+            pair<int, int> resolved;
+            resolve(statement.order_by[i].item.column, resolved.first, resolved.second);
+            SortKey key;
+            key.column = findColumn(root, resolved);
+            key.descending = statement.order_by[i].descending;
+            keys.push_back(key);
+        }
+        root = createSort(root, keys, statement);
+    }
+
+    vector<int> indexes;
+    if (statement.columns.empty()) {
+        for (size_t t = 0; t < tables.size(); t++) {
+            for (size_t c = 0; c < tables[t].used_columns.size(); c++) {
+                indexes.push_back(findColumn(root, make_pair((int) t, (int) c)));
+            }
+        }
+    }
+    for (size_t i = 0; i < statement.columns.size(); i++) {
+        pair<int, int> resolved;
+        resolve(statement.columns[i].column, resolved.first, resolved.second);
+        indexes.push_back(findColumn(root, resolved));
+    }
+    double estimated_rows = root->getEstimatedRows();
+    root = new ProjectOperator(root, indexes);
+    root->setEstimatedRows(estimated_rows);
+    return root;
+}
+
+Operator * QueryPlanner::plan(SelectStatement & statement) {
+    tables.clear();
+    access_paths.clear();
+    error.clear();
+
+    if (!addTable(statement.table, statement.alias)) return NULL;
+    for (size_t i = 0; i < statement.joins.size(); i++) {
+        if (!addTable(statement.joins[i].table, statement.joins[i].alias)) return NULL;
+    }
+
+    for (size_t i = 0; i < statement.conditions.size(); i++) {
+        if (!addCondition(statement.conditions[i])) return NULL;
+    }
+
+    // Columns each table has to decode
+    bool aggregate = !statement.group_by.empty();
+    pair<int, int> resolved;
+    if (statement.columns.empty()) {
+        for (size_t t = 0; t < tables.size(); t++) {
+            tables[t].used_columns.assign(tables[t].used_columns.size(), true);
+        }
+    }
+    for (size_t i = 0; i < statement.columns.size(); i++) {
+        aggregate = aggregate || statement.columns[i].aggregate;
+        if (!statement.columns[i].column.column.empty() && !use(statement.columns[i].column, resolved)) return NULL;
+    }
+    for (size_t i = 0; i < statement.group_by.size(); i++) {
+        if (!use(statement.group_by[i], resolved)) return NULL;
+    }
+    for (size_t i = 0; i < statement.order_by.size(); i++) {
+        SelectItem & item = statement.order_by[i].item;
+        if (item.aggregate && !aggregate) {
+            fail("ORDER BY " + item.toString() + " needs GROUP BY or an aggregate in SELECT");
+            return NULL;
+        }
+        if (!item.column.column.empty() && !use(item.column, resolved)) return NULL;
+    }
+
+    // Each JOIN links its table to one of the tables before it
+    vector<pair<pair<int, int>, pair<int, int> > > join_keys;
+    for (size_t i = 0; i < statement.joins.size(); i++) {
+        int joined = i + 1;
+        pair<int, int> left, right;
+        if (!use(statement.joins[i].left, left) || !use(statement.joins[i].right, right)) {
+            return NULL;
+        }
+        if (left.first == joined) {
+            swap(left, right);
+        }
+        if (right.first != joined || left.first >= joined) {
+            fail("JOIN " + tables[joined].alias + " must be ON one of its columns and one of a table before it");
+            return NULL;
+        }
+        join_keys.push_back(make_pair(left, right));
+    }
+
+    // Sorts and aggregates read every row before giving the first
+    row_goal = aggregate || !statement.order_by.empty() ? -1 : statement.limit;
+
+    // Batch operators take no parameters
+    if (vectorized && statement.number_of_parameters > 0) {
+        fail("a query with ? parameters cannot be vectorized");
+        return NULL;
+    }
+    Operator * root = vectorized ? createBatchJoins(join_keys) : createJoins(join_keys);
+    root = aggregate ? planAggregate(root, statement) : planSelect(root, statement);
+    if (root == NULL) {
+        return NULL;
+    }
+
+    // A TopN already stops at the limit
+    if (statement.limit >= 0 && !useTopN(statement)) {
+        double estimated_rows = root->getEstimatedRows();
+        root = new LimitOperator(root, statement.limit);
+        root->setEstimatedRows(estimated_rows < 0 ? statement.limit : min(estimated_rows, (double) statement.limit));
+    }
+    return root;
+}
+
+vector<string> QueryPlanner::explain(Operator * root) {
+    vector<string> lines;
+    root->explain(lines);
+    if (!vectorized) {
+        lines.push_back("Access paths (cost in registries read):");
+        for (size_t i = 0; i < access_paths.size(); i++) {
+            lines.push_back("  " + access_paths[i]);
+        }
+    }
+    return lines;
+}
+
+Cursor executeQuery(string sql, Catalog * catalog, Queryable * default_table) {
+    Parser parser;
+    SelectStatement statement;
+    if (!parser.parse(sql, statement)) {
+        return Cursor(parser.getError());
+    }
+    return executeQuery(statement, catalog, default_table);
+}
+
+Cursor executeQuery(SelectStatement & statement, Catalog * catalog, Queryable * default_table) {
+    if (statement.number_of_parameters > 0) {
+        return Cursor("the query has ? parameters, prepare it to bind them");
+    }
+    QueryPlanner planner(catalog, default_table);
+    Operator * root = planner.plan(statement);
+    if (root == NULL) {
+        return Cursor(planner.getError());
+    }
+
+    if (statement.explain) {
+        vector<string> lines;
+        if (statement.analyze) {
+            root = analyze(root);
+            long long number_of_rows = 0;
+            Tuple tuple;
+            Timer timer;
+            timer.start();
+            root->open();
+            while (root->next(tuple)) {
+                number_of_rows++;
+            }
+            root->close();
+            double time = timer.getElapsedTime();
+
+            lines = planner.explain(root);
+            ostringstream total;
+            total << fixed << setprecision(3) << "Execution: " << number_of_rows << " rows in " << time * 1e3 << " ms";
+            lines.push_back(total.str());
+        } else {
+            lines = planner.explain(root);
+        }
+        delete root;
+
+        OperatorColumn column;
+        column.name = "plan";
+        column.key_kind = STRING_KEY;
+        vector<Tuple> tuples;
+        for (size_t i = 0; i < lines.size(); i++) {
+            TypedKey line;
+            line.kind = STRING_KEY;
+            line.string_value = lines[i];
+            tuples.push_back(Tuple(1, line));
+        }
+        return Cursor(new ValuesOperator(vector<OperatorColumn>(1, column), tuples), vector<string>(1, column.name));
+    }
+
+    return Cursor(root, getColumnNames(statement, root));
+}
+
+vector<string> getColumnNames(SelectStatement & statement, Operator * root) {
+    vector<string> column_names;
+    vector<OperatorColumn> & columns = root->getColumns();
+    for (size_t i = 0; i < columns.size(); i++) {
+        bool qualified = !statement.joins.empty() && !columns[i].table.empty();
+        column_names.push_back(qualified ? columns[i].table + "." + columns[i].name : columns[i].name);
+    }
+    return column_names;
+}
+
+#endif //QUERY_H
@@ -3,6 +3,10 @@
 
 #include "schema.h"
 
+class Scanner;
+struct ColumnStatistics;
+class SecondaryIndex;
+
 
 struct RegistryHeader {
     char table_name[255];
@@ -20,6 +24,7 @@ typedef vector<pair<decltype(HeaderFile::_id), decltype(HeaderFile::registry_pos
 
 class Queryable {
 public:
+  virtual string getName() =0;
   virtual vector<string> getRow(long long registry_position) =0;
   virtual vector<string> getRowById(long long _id) =0;
   virtual Schema getSchema() =0;
@@ -28,6 +33,12 @@ public:
   virtual vector<pair<string, long long>> *getColumn(int column_position) =0;
   virtual string getValue(long long _id, int column_position) =0;
   virtual int getNumberOfRows() =0;
+  virtual Scanner* scan() =0;
+  virtual bool isSortedOn(int column_position) =0;
+  virtual ColumnStatistics getStatistics(int column_position) =0;
+  virtual SecondaryIndex* getIndex(int column_position) =0;
+  virtual bool hasIndex(int column_position) =0;
+  virtual long long getVersion() =0;
 };
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,348 @@
+#ifndef QUERYBENCHMARK_H
+#define QUERYBENCHMARK_H
+
+#include "operator.h"
+#include "batch.h"
+#include "timer.h"
+#include "query.h"
+#include "preparedstatement.h"
+
+class QueryBenchmark {
+
+public:
+
+    Queryable * person_table;
+    Queryable * worked_table;
+
+    QueryBenchmark(Queryable * person_table, Queryable * worked_table);
+
+    void runBenchmark();
+
+private:
+
+    // Times each plan is run, the tables being small
+    static const int REPETITIONS = 50;
+
+    ColumnPredicate getDrePredicate(int column);
+
+    long long runTuples(Operator * root);
+    long long runBatches(BatchOperator * root);
+
+    /**
+     * worked JOIN person ON person_id = _id WHERE dre > 100, a tuple at a
+     * time and a batch at a time, next to the time of only reading both
+     * tables, which neither can beat.
+     */
+    void vectorizedJoin();
+
+    /**
+     * person WHERE nome != 'Willie' AND dre > 100 AND dre < 900, tested
+     * through TypedKeys and compiled, in nanoseconds per row past the scan.
+     */
+    void compiledPredicates();
+
+    /**
+     * person WHERE _id = 500 and WHERE dre BETWEEN 100 AND 110, read by a
+     * full scan and by the access path the planner picks, with an index on
+     * dre when the table has one.
+     */
+    void accessPaths();
+
+    /**
+     * person WHERE _id = i for 1000 ids, parsed and planned each time and
+     * prepared once, next to reading the registry straight from a Scanner.
+     */
+    void preparedStatements();
+
+    /**
+     * person ORDER BY nome LIMIT 20 through a full Sort and through a TopN,
+     * and worked JOIN person ON person_id = _id LIMIT 20 through a Hash
+     * Join and through the plan the row goal gives.
+     */
+    void limits();
+};
+
+QueryBenchmark::QueryBenchmark(Queryable * person_table, Queryable * worked_table) {
+    this->person_table = person_table;
+    this->worked_table = worked_table;
+}
+
+void QueryBenchmark::runBenchmark() {
+    vectorizedJoin();
+    compiledPredicates();
+    accessPaths();
+    preparedStatements();
+    limits();
+}
+
+ColumnPredicate QueryBenchmark::getDrePredicate(int column) {
+    ColumnPredicate predicate;
+    predicate.column = column;
+    predicate.comparator = GREATER;
+    predicate.value.kind = INTEGER_KEY;
+    predicate.value.integer_value = 100;
+    return predicate;
+}
+
+long long QueryBenchmark::runTuples(Operator * root) {
+    long long number_of_rows = 0;
+    Tuple tuple;
+    root->open();
+    while (root->next(tuple)) {
+        number_of_rows++;
+    }
+    root->close();
+    delete root;
+    return number_of_rows;
+}
+
+long long QueryBenchmark::runBatches(BatchOperator * root) {
+    long long number_of_rows = 0;
+    Batch batch;
+    root->open();
+    while (root->next(batch)) {
+        number_of_rows += batch.selected;
+    }
+    root->close();
+    delete root;
+    return number_of_rows;
+}
+
+void QueryBenchmark::vectorizedJoin() {
+    cout << "\nFilter + Hash Join, row at a time vs vectorized" << endl;
+
+    int id_position = 0;
+    int dre_position = person_table->getSchema().getColPosition("dre");
+    int person_id_position = worked_table->getSchema().getColPosition("person_id");
+    int company_id_position = worked_table->getSchema().getColPosition("company_id");
+
+    vector<int> person_columns;
+    person_columns.push_back(id_position);
+    person_columns.push_back(dre_position);
+    vector<int> worked_columns;
+    worked_columns.push_back(company_id_position);
+    worked_columns.push_back(person_id_position);
+
+    Timer timer;
+    timer.start();
+    long long tuple_rows = 0;
+    for (int i = 0; i < REPETITIONS; i++) {
+        Operator * probe = new ScanOperator(worked_table, "w", worked_columns, vector<ColumnPredicate>());
+        Operator * build = new ScanOperator(person_table, "p", person_columns,
+                                            vector<ColumnPredicate>(1, getDrePredicate(dre_position)));
+        tuple_rows = runTuples(new HashJoinOperator(probe, build, 1, 0, INTEGER_KEY));
+    }
+    double tuple_time = timer.getElapsedTime() / REPETITIONS;
+
+    timer.start();
+    long long batch_rows = 0;
+    for (int i = 0; i < REPETITIONS; i++) {
+        BatchOperator * probe = new BatchScanOperator(worked_table, "w", worked_columns);
+        BatchOperator * build = new BatchFilterOperator(new BatchScanOperator(person_table, "p", person_columns),
+                                                        vector<ColumnPredicate>(1, getDrePredicate(1)));
+        batch_rows = runBatches(new BatchHashJoinOperator(probe, build, 1, 0, INTEGER_KEY));
+    }
+    double batch_time = timer.getElapsedTime() / REPETITIONS;
+
+    timer.start();
+    for (int i = 0; i < REPETITIONS; i++) {
+        runBatches(new BatchScanOperator(worked_table, "w", worked_columns));
+        runBatches(new BatchScanOperator(person_table, "p", person_columns));
+    }
+    double scan_time = timer.getElapsedTime() / REPETITIONS;
+
+    cout << "\tRow at a time: " << tuple_time << " s (" << tuple_rows << " rows)" << endl;
+    cout << "\tVectorized:    " << batch_time << " s (" << batch_rows << " rows)" << endl;
+    cout << "\tReading the tables alone: " << scan_time << " s" << endl;
+    cout << "\tSpeedup: " << tuple_time / batch_time << "x overall";
+    if (tuple_time > scan_time && batch_time > scan_time) {
+        cout << ", " << (tuple_time - scan_time) / (batch_time - scan_time) << "x past the scans";
+    }
+    cout << endl;
+}
+
+void QueryBenchmark::compiledPredicates() {
+    cout << "\nWHERE, interpreted vs compiled predicates" << endl;
+
+    int dre_position = person_table->getSchema().getColPosition("dre");
+    vector<ColumnPredicate> predicates;
+    ColumnPredicate predicate;
+    predicate.column = person_table->getSchema().getColPosition("nome");
+    predicate.comparator = NOT_EQUAL;
+    predicate.value.kind = STRING_KEY;
+    predicate.value.string_value = "Willie";
+    predicates.push_back(predicate);
+    predicates.push_back(getDrePredicate(dre_position));
+    predicate = getDrePredicate(dre_position);
+    predicate.comparator = LESS;
+    predicate.value.integer_value = 900;
+    predicates.push_back(predicate);
+
+    Conjunction conjunction;
+    conjunction.compile(person_table, predicates);
+
+    // 0 only scans, 1 interprets, 2 runs the compiled predicates
+    double times[3];
+    long long passed[3] = {0, 0, 0};
+    long long number_of_rows = 0;
+    for (int mode = 0; mode < 3; mode++) {
+        Timer timer;
+        timer.start();
+        for (int i = 0; i < REPETITIONS; i++) {
+            Scanner * scan = person_table->scan();
+            while (scan->next()) {
+                bool passes = mode == 0 || (mode == 1 ? passesPredicates(scan, predicates) : conjunction.evaluate(scan));
+                passed[mode] += passes;
+                number_of_rows += mode == 0;
+            }
+            delete scan;
+        }
+        times[mode] = timer.getElapsedTime();
+    }
+
+    cout << "\tInterpreted: " << max(0.0, times[1] - times[0]) * 1e9 / number_of_rows << " ns/row (" << passed[1] / REPETITIONS << " rows)" << endl;
+    cout << "\tCompiled:    " << max(0.0, times[2] - times[0]) * 1e9 / number_of_rows << " ns/row (" << passed[2] / REPETITIONS << " rows)" << endl;
+    cout << "\tTested in the order:";
+    vector<ColumnPredicate> order = conjunction.getPredicates();
+    for (size_t i = 0; i < order.size(); i++) {
+        cout << " " << person_table->getSchema().getCols()->at(order[i].column).key;
+    }
+    cout << endl;
+}
+
+void QueryBenchmark::accessPaths() {
+    cout << "\nAccess paths, full scan vs planned" << endl;
+
+    vector<int> column_positions;
+    for (int i = 0; i < person_table->getSchema().getNumberOfCols(); i++) {
+        column_positions.push_back(i);
+    }
+    int dre_position = person_table->getSchema().getColPosition("dre");
+
+    ColumnPredicate id_predicate = getDrePredicate(0);
+    id_predicate.comparator = EQUAL;
+    id_predicate.value.integer_value = 500;
+    vector<ColumnPredicate> range_predicates;
+    ColumnPredicate predicate = getDrePredicate(dre_position);
+    predicate.comparator = GREATER_EQUAL;
+    range_predicates.push_back(predicate);
+    predicate.comparator = LESS_EQUAL;
+    predicate.value.integer_value = 110;
+    range_predicates.push_back(predicate);
+
+    string queries[2] = {"SELECT * FROM person WHERE _id = 500", "SELECT * FROM person WHERE dre BETWEEN 100 AND 110"};
+    vector<ColumnPredicate> predicates[2] = {vector<ColumnPredicate>(1, id_predicate), range_predicates};
+
+    for (int q = 0; q < 2; q++) {
+        Timer timer;
+        timer.start();
+        long long scan_rows = 0;
+        for (int i = 0; i < REPETITIONS; i++) {
+            scan_rows = runTuples(new ScanOperator(person_table, person_table->getName(), column_positions, predicates[q]));
+        }
+        double scan_time = timer.getElapsedTime() / REPETITIONS;
+
+        timer.start();
+        long long planned_rows = 0;
+        for (int i = 0; i < REPETITIONS; i++) {
+            planned_rows = executeQuery(queries[q], &Catalog::getDefault(), person_table).getCount();
+        }
+        double planned_time = timer.getElapsedTime() / REPETITIONS;
+
+        // The second line of the plan is the access, under the Project
+        Cursor plan = executeQuery("EXPLAIN " + queries[q], &Catalog::getDefault(), person_table);
+        plan.moveToNext();
+        plan.moveToNext();
+        cout << "\t" << queries[q] << endl;
+        cout << "\t\tFull scan: " << scan_time << " s (" << scan_rows << " rows)" << endl;
+        cout << "\t\tPlanned:   " << planned_time << " s (" << planned_rows << " rows)" << endl;
+        cout << "\t\t" << plan.getString(0) << endl;
+    }
+}
+
+void QueryBenchmark::preparedStatements() {
+    cout << "\nPoint lookups, query vs prepared statement" << endl;
+    const int LOOKUPS = 1000;
+    long long number_of_rows = person_table->getHeader()->size();
+
+    Timer timer;
+    timer.start();
+    long long query_rows = 0;
+    for (int i = 0; i < LOOKUPS; i++) {
+        ostringstream sql;
+        sql << "SELECT * FROM person WHERE _id = " << i % number_of_rows;
+        query_rows += executeQuery(sql.str(), &Catalog::getDefault(), person_table).getCount();
+    }
+    double query_time = timer.getElapsedTime() / LOOKUPS;
+
+    timer.start();
+    long long prepared_rows = 0;
+    PreparedStatement statement = PlanCache::getDefault().prepare("SELECT * FROM person WHERE _id = ?", person_table);
+    for (int i = 0; i < LOOKUPS; i++) {
+        statement.bindInt(0, i % number_of_rows);
+        prepared_rows += statement.execute().getCount();
+    }
+    double prepared_time = timer.getElapsedTime() / LOOKUPS;
+
+    timer.start();
+    for (int i = 0; i < LOOKUPS; i++) {
+        Scanner * scan = person_table->scan();
+        scan->seek(i % number_of_rows);
+        scan->next();
+        delete scan;
+    }
+    double read_time = timer.getElapsedTime() / LOOKUPS;
+
+    cout << "\tQuery:    " << query_time * 1e6 << " us per lookup (" << query_rows << " rows)" << endl;
+    cout << "\tPrepared: " << prepared_time * 1e6 << " us per lookup (" << prepared_rows << " rows)" << endl;
+    cout << "\tReading the registry alone: " << read_time * 1e6 << " us" << endl;
+    cout << "\tOverhead past the read: " << max(0.0, query_time - read_time) * 1e6 << " us vs "
+         << max(0.0, prepared_time - read_time) * 1e6 << " us" << endl;
+}
+
+void QueryBenchmark::limits() {
+    cout << "\nFirst 20 rows, full pipeline vs LIMIT pushed down" << endl;
+    const long long LIMIT = 20;
+
+    vector<SortKey> keys(1);
+    keys[0].column = person_table->getSchema().getColPosition("nome");
+    keys[0].descending = false;
+
+    Timer timer;
+    timer.start();
+    long long sort_rows = 0;
+    for (int i = 0; i < REPETITIONS; i++) {
+        sort_rows = runTuples(new LimitOperator(new SortOperator(new ScanOperator(person_table), keys), LIMIT));
+    }
+    double sort_time = timer.getElapsedTime() / REPETITIONS;
+
+    timer.start();
+    long long top_rows = 0;
+    for (int i = 0; i < REPETITIONS; i++) {
+        top_rows = runTuples(new TopNOperator(new ScanOperator(person_table), keys, LIMIT));
+    }
+    double top_time = timer.getElapsedTime() / REPETITIONS;
+
+    int person_id_position = worked_table->getSchema().getColPosition("person_id");
+    timer.start();
+    long long hash_rows = 0;
+    for (int i = 0; i < REPETITIONS; i++) {
+        Operator * join = new HashJoinOperator(new ScanOperator(worked_table), new ScanOperator(person_table), person_id_position, 0, INTEGER_KEY);
+        hash_rows = runTuples(new LimitOperator(join, LIMIT));
+    }
+    double hash_time = timer.getElapsedTime() / REPETITIONS;
+
+    timer.start();
+    long long planned_rows = 0;
+    for (int i = 0; i < REPETITIONS; i++) {
+        planned_rows = executeQuery("SELECT * FROM worked w JOIN person p ON w.person_id = p._id LIMIT 20", &Catalog::getDefault()).getCount();
+    }
+    double planned_time = timer.getElapsedTime() / REPETITIONS;
+
+    cout << "\tORDER BY nome LIMIT 20, Sort: " << sort_time << " s (" << sort_rows << " rows)" << endl;
+    cout << "\tORDER BY nome LIMIT 20, TopN: " << top_time << " s (" << top_rows << " rows)" << endl;
+    cout << "\tJOIN LIMIT 20, Hash Join:     " << hash_time << " s (" << hash_rows << " rows)" << endl;
+    cout << "\tJOIN LIMIT 20, planned:       " << planned_time << " s (" << planned_rows << " rows)" << endl;
+}
+
+#endif //QUERYBENCHMARK_H
@@ -0,0 +1,361 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <fstream>
+#include <atomic>
+#include <string.h>
+#include <stdlib.h>
+
+#include "schema.h"
+#include "queryable.h"
+#include "bloomfilter.h"
+
+/**
+ * Sequential reader over the registries of a table, in header order.
+ * Registries are fetched in large blocks instead of one open/seek/read per
+ * row, and columns are decoded straight from the block, typed. The first
+ * block is small, and each block read on from the end of the last one is
+ * twice as large, up to the buffer size: a reader that stops after a few
+ * registries, or fetches scattered ones, reads a few kilobytes at a time,
+ * and a full scan still reads in large blocks.
+ */
+class Scanner {
+private:
+    // Bytes of the first block read, before it doubles
+    static const unsigned FIRST_BLOCK_SIZE = 4096;
+
+    ifstream file;
+    Schema schema;
+    header_t * header;
+
+    unsigned registry_size;
+    vector<unsigned> offsets;
+
+    vector<char> buffer;
+    unsigned buffer_size;
+    long long buffer_start;
+    long long buffer_end;
+    long long bytes_read;
+    // Of every scanner of the process, which may read from several threads
+    static atomic<long long> total_bytes_read;
+
+    long long index;
+    const char * current;
+
+    BloomFilter * filter;
+    int filter_column_position;
+    KeyKind filter_key_kind;
+    long long filtered_rows;
+
+    bool fill(long long registry_position);
+    bool passesFilter();
+
+public:
+    /**
+     * @constructor
+     * @param header_size bytes of the RegistryHeader written before the columns
+     * @param buffer_size most bytes read from the file at once
+     */
+    Scanner(string path, Schema schema, header_t * header, unsigned header_size, unsigned buffer_size = 1 << 20);
+
+    /**
+     * @destructor
+     */
+    ~Scanner();
+
+    /**
+     * Moves to the next registry that passes the filter, if one is set.
+     * @return false when there are no registries left
+     */
+    bool next();
+
+    /**
+     * Skips registries whose key, compared as key_kind, is not in the filter.
+     */
+    void setFilter(BloomFilter * filter, int column_position, KeyKind key_kind);
+
+    /**
+     * @return how many registries the filter skipped
+     */
+    long long getFilteredRows();
+
+    /**
+     * @return how many bytes were read from the file so far
+     */
+    long long getBytesRead();
+
+    /**
+     * @return how many bytes every scanner of the process read so far
+     */
+    static long long getTotalBytesRead();
+
+    /**
+     * @return bytes of the block the registries are read into, which grows
+     *         as the file is read
+     */
+    long long getBufferSize();
+
+    /**
+     * Moves back to before the first registry.
+     */
+    void rewind();
+
+    /**
+     * Moves to before the registry at the given header index.
+     */
+    void seek(long long header_index);
+
+    /**
+     * Moves to the registry at registry_position, reading the file only if
+     * it is not in the current block: fetching positions in increasing order
+     * reads the file sequentially. getIndex/getId/getRegistryPosition refer
+     * to the last registry reached by next, not by fetch.
+     * @return false if the position is past the end of the file
+     */
+    bool fetch(long long registry_position);
+
+    long long getIndex();
+    long long getId();
+    long long getRegistryPosition();
+
+    long long getInt(int column_position);
+    double getDouble(int column_position);
+    string getString(int column_position);
+
+    /**
+     * @return the bytes of the column in the registry, as stored, for
+     *         callers that already know the column type
+     */
+    const char * getData(int column_position);
+
+    template <typename T>
+    T getKey(int column_position);
+
+    vector<string> getRow();
+};
+
+atomic<long long> Scanner::total_bytes_read(0);
+
+Scanner::Scanner(string path, Schema schema, header_t * header, unsigned header_size, unsigned buffer_size) {
+    this->schema = schema;
+    this->header = header;
+    this->filter = NULL;
+    this->filtered_rows = 0;
+    this->bytes_read = 0;
+
+    unsigned offset = header_size;
+    vector<SchemaCol>* schema_cols = this->schema.getCols();
+    for (vector<SchemaCol>::iterator it = schema_cols->begin(); it != schema_cols->end(); it++) {
+        offsets.push_back(offset);
+        offset += it->getSize();
+    }
+    this->registry_size = offset;
+
+    if (buffer_size < registry_size) {
+        buffer_size = registry_size;
+    }
+    this->buffer_size = buffer_size - buffer_size % registry_size;
+    unsigned first_block = FIRST_BLOCK_SIZE < registry_size ? registry_size : FIRST_BLOCK_SIZE;
+    first_block = min(first_block - first_block % registry_size, this->buffer_size);
+    // Reserved whole, so growing the block never copies it
+    buffer.reserve(this->buffer_size);
+    buffer.resize(first_block);
+
+    file.open(path.c_str(), ios::binary);
+    rewind();
+}
+
+Scanner::~Scanner() {
+    file.close();
+}
+
+bool Scanner::fill(long long registry_position) {
+    // Grows only for a read that goes on forward, past at most a block
+    bool forward = registry_position >= buffer_end && registry_position - buffer_end < (long long) buffer.size();
+    if (bytes_read > 0 && forward && buffer.size() < buffer_size) {
+        size_t block = min((size_t) buffer_size, 2 * buffer.size());
+        buffer.resize(block - block % registry_size);
+    }
+    file.clear();
+    file.seekg(registry_position);
+    file.read(&buffer[0], buffer.size());
+
+    buffer_start = registry_position;
+    buffer_end = registry_position + file.gcount();
+    bytes_read += file.gcount();
+    total_bytes_read += file.gcount();
+
+    return buffer_end - buffer_start >= registry_size;
+}
+
+bool Scanner::next() {
+    while (true) {
+        index++;
+        current = NULL;
+        if (index >= (long long) header->size()) {
+            return false;
+        }
+
+        long long registry_position = header->at(index).second;
+        if (registry_position < buffer_start || registry_position + registry_size > buffer_end) {
+            if (!fill(registry_position)) {
+                return false;
+            }
+        }
+
+        current = &buffer[registry_position - buffer_start];
+        if (filter == NULL || passesFilter()) {
+            return true;
+        }
+        filtered_rows++;
+    }
+}
+
+void Scanner::setFilter(BloomFilter * filter, int column_position, KeyKind key_kind) {
+    this->filter = filter;
+    this->filter_column_position = column_position;
+    this->filter_key_kind = key_kind;
+}
+
+long long Scanner::getFilteredRows() {
+    return filtered_rows;
+}
+
+long long Scanner::getBytesRead() {
+    return bytes_read;
+}
+
+long long Scanner::getTotalBytesRead() {
+    return total_bytes_read;
+}
+
+long long Scanner::getBufferSize() {
+    return buffer.size();
+}
+
+bool Scanner::passesFilter() {
+    switch (filter_key_kind) {
+        case INTEGER_KEY : return filter->mayContain(hashKey(getInt(filter_column_position)));
+        case REAL_KEY    : return filter->mayContain(hashKey(getDouble(filter_column_position)));
+        default          : return filter->mayContain(hashKey(getString(filter_column_position)));
+    }
+}
+
+void Scanner::rewind() {
+    seek(0);
+}
+
+void Scanner::seek(long long header_index) {
+    index = header_index - 1;
+    current = NULL;
+    buffer_start = 0;
+    buffer_end = 0;
+}
+
+bool Scanner::fetch(long long registry_position) {
+    if (registry_position < buffer_start || registry_position + registry_size > buffer_end) {
+        if (!fill(registry_position)) {
+            current = NULL;
+            return false;
+        }
+    }
+    current = &buffer[registry_position - buffer_start];
+    return true;
+}
+
+long long Scanner::getIndex() {
+    return index;
+}
+
+long long Scanner::getId() {
+    return header->at(index).first;
+}
+
+long long Scanner::getRegistryPosition() {
+    return header->at(index).second;
+}
+
+long long Scanner::getInt(int column_position) {
+    SchemaCol & schema_col = schema.getCols()->at(column_position);
+    const char * data = current + offsets[column_position];
+
+    if (schema_col.type == INT32) {
+        int value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    } else if (schema_col.type == INT64 || schema_col.type == FOREIGN_KEY) {
+        long long value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    } else if (schema_col.type == FLOAT || schema_col.type == DOUBLE) {
+        return (long long) getDouble(column_position);
+    }
+    return atoll(getString(column_position).c_str());
+}
+
+double Scanner::getDouble(int column_position) {
+    SchemaCol & schema_col = schema.getCols()->at(column_position);
+    const char * data = current + offsets[column_position];
+
+    if (schema_col.type == FLOAT) {
+        float value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    } else if (schema_col.type == DOUBLE) {
+        double value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    } else if (schema_col.type == CHAR) {
+        return atof(getString(column_position).c_str());
+    }
+    return (double) getInt(column_position);
+}
+
+string Scanner::getString(int column_position) {
+    SchemaCol & schema_col = schema.getCols()->at(column_position);
+    const char * data = current + offsets[column_position];
+
+    if (schema_col.type == CHAR) {
+        return string(data, strnlen(data, schema_col.getSize()));
+    }
+
+    // Same formatting as Table::getRow
+    ostringstream stream;
+    if (schema_col.type == FLOAT) {
+        stream << (float) getDouble(column_position);
+    } else if (schema_col.type == DOUBLE) {
+        stream << getDouble(column_position);
+    } else {
+        stream << getInt(column_position);
+    }
+    return stream.str();
+}
+
+const char * Scanner::getData(int column_position) {
+    return current + offsets[column_position];
+}
+
+template <>
+long long Scanner::getKey<long long>(int column_position) {
+    return getInt(column_position);
+}
+
+template <>
+double Scanner::getKey<double>(int column_position) {
+    return getDouble(column_position);
+}
+
+template <>
+string Scanner::getKey<string>(int column_position) {
+    return getString(column_position);
+}
+
+vector<string> Scanner::getRow() {
+    vector<string> row;
+    for (size_t i = 0; i < offsets.size(); i++) {
+        row.push_back(getString(i));
+    }
+    return row;
+}
+
+#endif //SCANNER_H
@@ -19,6 +19,23 @@ enum SchemaType {
     
 };
 
+/**
+ * How values of a column are compared: integer types compare as long long,
+ * floating types as double and CHAR as string.
+ */
+enum KeyKind {
+    INTEGER_KEY,
+    REAL_KEY,
+    STRING_KEY
+};
+
+KeyKind getKeyKind(SchemaType type);
+
+/**
+ * @return the kind both columns can be compared as
+ */
+KeyKind getKeyKind(SchemaType left, SchemaType right);
+
 struct SchemaCol {
     string key;
     SchemaType type;
@@ -174,5 +191,21 @@ unsigned Schema::getSize() {
 int Schema::getNumberOfCols() {
     return cols.size();
 }
+
+KeyKind getKeyKind(SchemaType type) {
+    switch (type) {
+        case FLOAT:
+        case DOUBLE:
+            return REAL_KEY;
+        case CHAR:
+            return STRING_KEY;
+        default:
+            return INTEGER_KEY;
+    }
+}
+
+KeyKind getKeyKind(SchemaType left, SchemaType right) {
+    return max(getKeyKind(left), getKeyKind(right));
+}
  
  #endif //Schema_H
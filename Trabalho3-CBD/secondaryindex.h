@@ -0,0 +1,169 @@
+#ifndef SECONDARYINDEX_H
+#define SECONDARYINDEX_H
+
+#include <algorithm>
+
+#include "util.h"
+#include "schema.h"
+#include "queryable.h"
+#include "scanner.h"
+#include "typedkey.h"
+#include "predicate.h"
+
+/**
+ * Range of keys, each end open, inclusive or exclusive. Built from the
+ * predicates on one column, all of the column's kind.
+ */
+struct KeyRange {
+    bool has_lower;
+    bool lower_inclusive;
+    TypedKey lower;
+    bool has_upper;
+    bool upper_inclusive;
+    TypedKey upper;
+
+    KeyRange();
+
+    /**
+     * Narrows the range to the keys that pass the predicate.
+     * @return false for NOT_EQUAL, which is not a range
+     */
+    bool add(const ColumnPredicate & predicate);
+
+    /**
+     * @return the range as a condition on the column, for EXPLAIN
+     */
+    string toString(const string & column_name) const;
+};
+
+/**
+ * Ordered index of a column: the (key, registry position) pairs of the
+ * table sorted by key, searched by binary search. It plays the part of the
+ * leaves of a B+ tree built in one go, in memory.
+ */
+class SecondaryIndex {
+private:
+    int column_position;
+    KeyKind key_kind;
+    vector<pair<TypedKey, long long> > entries;
+
+public:
+    /**
+     * Scans the table once to build the index.
+     */
+    SecondaryIndex(Queryable * table, int column_position);
+
+    int getColumnPosition();
+    KeyKind getKeyKind();
+    long long getNumberOfEntries();
+
+    /**
+     * @return [first, last) of the entries whose key is in the range
+     */
+    pair<long long, long long> find(const KeyRange & range);
+
+    long long getRegistryPosition(long long entry);
+};
+
+KeyRange::KeyRange() {
+    has_lower = false;
+    lower_inclusive = false;
+    has_upper = false;
+    upper_inclusive = false;
+}
+
+bool KeyRange::add(const ColumnPredicate & predicate) {
+    const TypedKey & value = predicate.value;
+    bool raises_lower = predicate.comparator == EQUAL || predicate.comparator == GREATER || predicate.comparator == GREATER_EQUAL;
+    bool lowers_upper = predicate.comparator == EQUAL || predicate.comparator == LESS || predicate.comparator == LESS_EQUAL;
+    bool inclusive = predicate.comparator == EQUAL || predicate.comparator == GREATER_EQUAL || predicate.comparator == LESS_EQUAL;
+
+    if (raises_lower && (!has_lower || lower < value || (lower == value && !inclusive))) {
+        has_lower = true;
+        lower = value;
+        lower_inclusive = inclusive;
+    }
+    if (lowers_upper && (!has_upper || value < upper || (upper == value && !inclusive))) {
+        has_upper = true;
+        upper = value;
+        upper_inclusive = inclusive;
+    }
+    return raises_lower || lowers_upper;
+}
+
+string KeyRange::toString(const string & column_name) const {
+    if (has_lower && has_upper && lower_inclusive && upper_inclusive) {
+        if (lower == upper) {
+            return column_name + " = " + describeValue(lower);
+        }
+        return column_name + " BETWEEN " + describeValue(lower) + " AND " + describeValue(upper);
+    }
+
+    string text;
+    if (has_lower) {
+        text = column_name + (lower_inclusive ? " >= " : " > ") + describeValue(lower);
+    }
+    if (has_upper) {
+        text += (text.empty() ? "" : " AND ") + column_name + (upper_inclusive ? " <= " : " < ") + describeValue(upper);
+    }
+    return text.empty() ? column_name : text;
+}
+
+SecondaryIndex::SecondaryIndex(Queryable * table, int column_position) {
+    this->column_position = column_position;
+    this->key_kind = ::getKeyKind(table->getSchema().getCols()->at(column_position).type);
+
+    Scanner * scan = table->scan();
+    while (scan->next()) {
+        entries.push_back(make_pair(readTypedKey(scan, column_position, key_kind), scan->getRegistryPosition()));
+    }
+    delete scan;
+    sort(entries.begin(), entries.end());
+}
+
+int SecondaryIndex::getColumnPosition() {
+    return column_position;
+}
+
+KeyKind SecondaryIndex::getKeyKind() {
+    return key_kind;
+}
+
+long long SecondaryIndex::getNumberOfEntries() {
+    return entries.size();
+}
+
+/**
+ * Orders an entry against a bare key, for the binary searches.
+ */
+struct EntryKeyLess {
+    bool operator()(const pair<TypedKey, long long> & entry, const TypedKey & key) const {
+        return entry.first < key;
+    }
+    bool operator()(const TypedKey & key, const pair<TypedKey, long long> & entry) const {
+        return key < entry.first;
+    }
+};
+
+pair<long long, long long> SecondaryIndex::find(const KeyRange & range) {
+    vector<pair<TypedKey, long long> >::iterator first = entries.begin();
+    vector<pair<TypedKey, long long> >::iterator last = entries.end();
+    if (range.has_lower) {
+        first = range.lower_inclusive ? lower_bound(entries.begin(), entries.end(), range.lower, EntryKeyLess())
+                                      : upper_bound(entries.begin(), entries.end(), range.lower, EntryKeyLess());
+    }
+    if (range.has_upper) {
+        last = range.upper_inclusive ? upper_bound(entries.begin(), entries.end(), range.upper, EntryKeyLess())
+                                     : lower_bound(entries.begin(), entries.end(), range.upper, EntryKeyLess());
+    }
+    if (last < first) {
+        last = first;
+    }
+    return make_pair(first - entries.begin(), last - entries.begin());
+}
+
+long long SecondaryIndex::getRegistryPosition(long long entry) {
+    return entries[entry].second;
+}
+
+#endif //SECONDARYINDEX_H
@@ -0,0 +1,406 @@
+#ifndef SEMIJOIN_H
+#define SEMIJOIN_H
+
+#include "util.h"
+#include "schema.h"
+#include "queryable.h"
+#include "scanner.h"
+#include "joinstream.h"
+#include "materializer.h"
+
+/**
+ * SEMI_JOIN keeps the this_table rows with a match in other_table,
+ * ANTI_JOIN those without one.
+ */
+enum SemiJoinType { SEMI_JOIN, ANTI_JOIN };
+
+/**
+ * A batch of this_table registry positions.
+ */
+struct RowBatch {
+    vector<long long> positions;
+    size_t capacity;
+
+    RowBatch(size_t capacity = 1024);
+
+    size_t size();
+    bool isFull();
+    void clear();
+    void add(long long position);
+};
+
+/**
+ * Open addressing hash set of keys, and nothing else: no registry
+ * positions, no node per key.
+ */
+template <typename T>
+class KeySet {
+private:
+    // 0 marks an empty slot, so stored hashes have their lowest bit set
+    vector<unsigned long long> hashes;
+    vector<T> keys;
+    size_t mask;
+    size_t size;
+
+    void grow();
+
+public:
+    KeySet(size_t expected_keys = 16);
+
+    void add(const T & key);
+    bool contains(const T & key);
+
+    long long getSizeInBytes();
+};
+
+class SemiJoinStream {
+public:
+    virtual ~SemiJoinStream() {}
+
+    /**
+     * Clears the batch and fills it with up to batch.capacity rows.
+     * @return false when the join is over and the batch is empty
+     */
+    virtual bool next(RowBatch & batch) =0;
+};
+
+/**
+ * Builds a KeySet of other_table and streams this_table through it.
+ */
+template <typename T>
+class HashSemiJoinStream : public SemiJoinStream {
+private:
+    KeySet<T> key_set;
+    Scanner *scan;
+    int column_position;
+    bool anti;
+
+public:
+    HashSemiJoinStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                       SemiJoinType semi_join_type);
+    ~HashSemiJoinStream();
+
+    bool next(RowBatch & batch);
+};
+
+/**
+ * Reads both tables in key order, and keeps each this_table row by whether
+ * other_table has reached its key.
+ */
+template <typename T>
+class MergeSemiJoinStream : public SemiJoinStream {
+private:
+    SortedColumn<T> *table_a;
+    SortedColumn<T> *table_b;
+    T key_a, key_b;
+    long long position_a, position_b;
+    bool has_b;
+    bool anti;
+
+public:
+    MergeSemiJoinStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                        SemiJoinType semi_join_type, JoinOptions & options);
+    ~MergeSemiJoinStream();
+
+    bool next(RowBatch & batch);
+};
+
+/**
+ * Semi-join or anti-join of this_table with other_table: each this_table
+ * row comes out at most once, whatever the number of matches, and no pair
+ * is ever built.
+ *
+ *     SemiJoin no_job(&person_table, "_id", &worked_table, "person_id", ANTI_JOIN);
+ *     no_job.print();
+ */
+class SemiJoin {
+private:
+    Queryable *this_table;
+    Queryable *other_table;
+    int this_column_position;
+    int other_column_position;
+    SemiJoinType semi_join_type;
+    JoinType join_type;
+    JoinOptions options;
+    SemiJoinStream *stream;
+
+    template <typename T>
+    SemiJoinStream * createStream();
+
+public:
+    /**
+     * @param join_type HASH or MERGE; AUTO merges when neither side needs
+     *        a sort, anything else hashes
+     */
+    SemiJoin(Queryable *this_table, string this_column_name, Queryable *other_table, string other_column_name,
+             SemiJoinType semi_join_type, JoinType join_type = HASH, JoinOptions options = JoinOptions());
+    ~SemiJoin();
+
+    void open();
+    bool next(RowBatch & batch);
+    void close();
+
+    /**
+     * @return the number of this_table rows kept
+     */
+    long long count();
+
+    JoinType getJoinType();
+
+    void print(int number_of_values = -1);
+};
+
+RowBatch::RowBatch(size_t capacity) {
+    this->capacity = capacity;
+    positions.reserve(capacity);
+}
+
+size_t RowBatch::size() {
+    return positions.size();
+}
+
+bool RowBatch::isFull() {
+    return positions.size() >= capacity;
+}
+
+void RowBatch::clear() {
+    positions.clear();
+}
+
+void RowBatch::add(long long position) {
+    positions.push_back(position);
+}
+
+/*****************************************
+ **************** KEY SET ****************
+ *****************************************/
+
+template <typename T>
+KeySet<T>::KeySet(size_t expected_keys) {
+    size_t slots = 16;
+    while (slots < expected_keys * 2) {
+        slots <<= 1;
+    }
+    hashes.assign(slots, 0);
+    keys.resize(slots);
+    mask = slots - 1;
+    size = 0;
+}
+
+template <typename T>
+void KeySet<T>::grow() {
+    vector<unsigned long long> old_hashes(hashes.size() * 2, 0);
+    vector<T> old_keys(hashes.size() * 2);
+    old_hashes.swap(hashes);
+    old_keys.swap(keys);
+    mask = hashes.size() - 1;
+
+    for (size_t i = 0; i < old_hashes.size(); i++) {
+        if (old_hashes[i] == 0) continue;
+        size_t slot = (old_hashes[i] >> 1) & mask;
+        while (hashes[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        hashes[slot] = old_hashes[i];
+        keys[slot] = old_keys[i];
+    }
+}
+
+template <typename T>
+void KeySet<T>::add(const T & key) {
+    unsigned long long hash = hashKey(key) | 1;
+    size_t slot = (hash >> 1) & mask;
+    while (hashes[slot] != 0) {
+        if (hashes[slot] == hash && keys[slot] == key) return;
+        slot = (slot + 1) & mask;
+    }
+    hashes[slot] = hash;
+    keys[slot] = key;
+    size++;
+
+    // At most half full, so probes stay short
+    if (size * 2 > hashes.size()) {
+        grow();
+    }
+}
+
+template <typename T>
+bool KeySet<T>::contains(const T & key) {
+    unsigned long long hash = hashKey(key) | 1;
+    size_t slot = (hash >> 1) & mask;
+    while (hashes[slot] != 0) {
+        if (hashes[slot] == hash && keys[slot] == key) return true;
+        slot = (slot + 1) & mask;
+    }
+    return false;
+}
+
+template <typename T>
+long long KeySet<T>::getSizeInBytes() {
+    return hashes.size() * (sizeof(unsigned long long) + sizeof(T));
+}
+
+/*****************************************
+ ************ HASH SEMI JOIN *************
+ *****************************************/
+
+template <typename T>
+HashSemiJoinStream<T>::HashSemiJoinStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                                          SemiJoinType semi_join_type) : key_set(other_table->getNumberOfRows()) {
+    this->column_position = this_column_position;
+    this->anti = semi_join_type == ANTI_JOIN;
+
+    Scanner *build_scan = other_table->scan();
+    while (build_scan->next()) {
+        key_set.add(build_scan->getKey<T>(other_column_position));
+    }
+    delete build_scan;
+
+    scan = this_table->scan();
+}
+
+template <typename T>
+HashSemiJoinStream<T>::~HashSemiJoinStream() {
+    delete scan;
+}
+
+template <typename T>
+bool HashSemiJoinStream<T>::next(RowBatch & batch) {
+    batch.clear();
+    while (!batch.isFull() && scan->next()) {
+        if (key_set.contains(scan->getKey<T>(column_position)) != anti) {
+            batch.add(scan->getRegistryPosition());
+        }
+    }
+    return batch.size() > 0;
+}
+
+/*****************************************
+ ************ MERGE SEMI JOIN ************
+ *****************************************/
+
+template <typename T>
+MergeSemiJoinStream<T>::MergeSemiJoinStream(Queryable *this_table, int this_column_position, Queryable *other_table, int other_column_position,
+                                            SemiJoinType semi_join_type, JoinOptions & options) {
+    this->anti = semi_join_type == ANTI_JOIN;
+
+    KeyKind key_kind = getKeyKind(this_table->getSchema().getCols()->at(this_column_position).type,
+                                  other_table->getSchema().getCols()->at(other_column_position).type);
+    table_a = new SortedColumn<T>(this_table, this_column_position, key_kind, options.memory_budget / 2, options.threads);
+    table_b = new SortedColumn<T>(other_table, other_column_position, key_kind, options.memory_budget / 2, options.threads);
+    has_b = table_b->next(key_b, position_b);
+}
+
+template <typename T>
+MergeSemiJoinStream<T>::~MergeSemiJoinStream() {
+    delete table_a;
+    delete table_b;
+}
+
+template <typename T>
+bool MergeSemiJoinStream<T>::next(RowBatch & batch) {
+    batch.clear();
+    while (!batch.isFull() && table_a->next(key_a, position_a)) {
+        while (has_b && key_b < key_a) {
+            has_b = table_b->next(key_b, position_b);
+        }
+        bool matches = has_b && !(key_a < key_b);
+        if (matches != anti) {
+            batch.add(position_a);
+        }
+    }
+    return batch.size() > 0;
+}
+
+/*****************************************
+ *************** SEMI JOIN ***************
+ *****************************************/
+
+SemiJoin::SemiJoin(Queryable *this_table, string this_column_name, Queryable *other_table, string other_column_name,
+                   SemiJoinType semi_join_type, JoinType join_type, JoinOptions options) {
+    this->this_table = this_table;
+    this->other_table = other_table;
+    this->this_column_position = this_table->getSchema().getColPosition(this_column_name);
+    this->other_column_position = other_table->getSchema().getColPosition(other_column_name);
+    this->semi_join_type = semi_join_type;
+    this->options = options;
+    this->stream = NULL;
+
+    if (join_type == AUTO) {
+        KeyKind key_kind = getKeyKind(this_table->getSchema().getCols()->at(this_column_position).type,
+                                      other_table->getSchema().getCols()->at(other_column_position).type);
+        bool sorted = SortedColumn<long long>::canElideSort(this_table, this_column_position, key_kind) &&
+                      SortedColumn<long long>::canElideSort(other_table, other_column_position, key_kind);
+        join_type = sorted ? MERGE : HASH;
+    }
+    this->join_type = join_type == MERGE ? MERGE : HASH;
+}
+
+SemiJoin::~SemiJoin() {
+    close();
+}
+
+template <typename T>
+SemiJoinStream * SemiJoin::createStream() {
+    if (join_type == MERGE) {
+        return new MergeSemiJoinStream<T>(this_table, this_column_position, other_table, other_column_position, semi_join_type, options);
+    }
+    return new HashSemiJoinStream<T>(this_table, this_column_position, other_table, other_column_position, semi_join_type);
+}
+
+void SemiJoin::open() {
+    close();
+    SchemaType this_type = this_table->getSchema().getCols()->at(this_column_position).type;
+    SchemaType other_type = other_table->getSchema().getCols()->at(other_column_position).type;
+
+    switch (getKeyKind(this_type, other_type)) {
+        case INTEGER_KEY : stream = createStream<long long>(); break;
+        case REAL_KEY    : stream = createStream<double>(); break;
+        default          : stream = createStream<string>(); break;
+    }
+}
+
+bool SemiJoin::next(RowBatch & batch) {
+    if (stream == NULL) {
+        batch.clear();
+        return false;
+    }
+    return stream->next(batch);
+}
+
+void SemiJoin::close() {
+    delete stream;
+    stream = NULL;
+}
+
+long long SemiJoin::count() {
+    open();
+    RowBatch batch;
+    long long number_of_rows = 0;
+    while (next(batch)) {
+        number_of_rows += batch.size();
+    }
+    close();
+    return number_of_rows;
+}
+
+JoinType SemiJoin::getJoinType() {
+    return join_type;
+}
+
+void SemiJoin::print(int number_of_values) {
+    open();
+    RowBatch batch;
+    LateMaterializer materializer(vector<Queryable*>(1, this_table), cout);
+    int line = 0;
+
+    while (line != number_of_values && next(batch)) {
+        for (size_t i = 0; i < batch.size() && line != number_of_values; i++, line++) {
+            materializer.add(&batch.positions[i]);
+        }
+    }
+    materializer.flush();
+    close();
+}
+
+#endif //SEMIJOIN_H
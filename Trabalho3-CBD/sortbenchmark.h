@@ -0,0 +1,146 @@
+#ifndef SORTBENCHMARK_H
+#define SORTBENCHMARK_H
+
+#include <random>
+
+#include "parallelsort.h"
+#include "timer.h"
+
+class SortBenchmark {
+
+public:
+
+    size_t size;
+
+    SortBenchmark(size_t size = 1000000);
+
+    void runBenchmark();
+
+private:
+
+    mt19937_64 generator;
+
+    vector<unsigned> getThreadCounts();
+
+    template <typename T>
+    void sweepThreads(string distribution, vector<pair<T, long long> > & input);
+
+    vector<pair<long long, long long> > uniformKeys();
+    vector<pair<long long, long long> > sortedKeys();
+    vector<pair<long long, long long> > reversedKeys();
+    vector<pair<long long, long long> > duplicateKeys();
+    vector<pair<double, long long> > doubleKeys();
+    vector<pair<string, long long> > stringKeys();
+};
+
+SortBenchmark::SortBenchmark(size_t size) : generator(42) {
+    this->size = size;
+}
+
+void SortBenchmark::runBenchmark() {
+    vector<pair<long long, long long> > uniform = uniformKeys();
+    sweepThreads("Integer keys, uniform", uniform);
+
+    vector<pair<long long, long long> > sorted = sortedKeys();
+    sweepThreads("Integer keys, sorted", sorted);
+
+    vector<pair<long long, long long> > reversed = reversedKeys();
+    sweepThreads("Integer keys, reversed", reversed);
+
+    vector<pair<long long, long long> > duplicates = duplicateKeys();
+    sweepThreads("Integer keys, 100 distinct", duplicates);
+
+    vector<pair<double, long long> > doubles = doubleKeys();
+    sweepThreads("Double keys, uniform", doubles);
+
+    vector<pair<string, long long> > strings = stringKeys();
+    sweepThreads("String keys, uniform", strings);
+}
+
+vector<unsigned> SortBenchmark::getThreadCounts() {
+    vector<unsigned> thread_counts;
+    unsigned max_threads = getDefaultSortThreads();
+    for (unsigned threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+    return thread_counts;
+}
+
+template <typename T>
+void SortBenchmark::sweepThreads(string distribution, vector<pair<T, long long> > & input) {
+    cout << "\n" << distribution << " (" << input.size() << " entries)" << endl;
+
+    Timer timer;
+    vector<pair<T, long long> > entries = input;
+    timer.start();
+    sort(entries.begin(), entries.end());
+    cout << "\tstd::sort: " << timer.getElapsedTime() << " s" << endl;
+
+    vector<unsigned> thread_counts = getThreadCounts();
+    for (size_t i = 0; i < thread_counts.size(); i++) {
+        entries = input;
+        timer.start();
+        parallelSort(entries, thread_counts[i]);
+        double time = timer.getElapsedTime();
+
+        bool sorted = is_sorted(entries.begin(), entries.end(),
+            [](const pair<T, long long> &left, const pair<T, long long> &right) {
+                return left.first < right.first;
+            });
+        cout << "\t" << thread_counts[i] << " threads: " << time << " s" << (sorted ? "" : " (NOT SORTED)") << endl;
+    }
+}
+
+vector<pair<long long, long long> > SortBenchmark::uniformKeys() {
+    vector<pair<long long, long long> > entries;
+    for (size_t i = 0; i < size; i++) {
+        entries.push_back(make_pair((long long) generator(), (long long) i));
+    }
+    return entries;
+}
+
+vector<pair<long long, long long> > SortBenchmark::sortedKeys() {
+    vector<pair<long long, long long> > entries;
+    for (size_t i = 0; i < size; i++) {
+        entries.push_back(make_pair((long long) i, (long long) i));
+    }
+    return entries;
+}
+
+vector<pair<long long, long long> > SortBenchmark::reversedKeys() {
+    vector<pair<long long, long long> > entries;
+    for (size_t i = 0; i < size; i++) {
+        entries.push_back(make_pair((long long) (size - i), (long long) i));
+    }
+    return entries;
+}
+
+vector<pair<long long, long long> > SortBenchmark::duplicateKeys() {
+    vector<pair<long long, long long> > entries;
+    for (size_t i = 0; i < size; i++) {
+        entries.push_back(make_pair((long long) (generator() % 100), (long long) i));
+    }
+    return entries;
+}
+
+vector<pair<double, long long> > SortBenchmark::doubleKeys() {
+    uniform_real_distribution<double> distribution(-1e6, 1e6);
+    vector<pair<double, long long> > entries;
+    for (size_t i = 0; i < size; i++) {
+        entries.push_back(make_pair(distribution(generator), (long long) i));
+    }
+    return entries;
+}
+
+vector<pair<string, long long> > SortBenchmark::stringKeys() {
+    vector<pair<string, long long> > entries;
+    for (size_t i = 0; i < size; i++) {
+        ostringstream stream;
+        stream << generator();
+        entries.push_back(make_pair(stream.str(), (long long) i));
+    }
+    return entries;
+}
+
+#endif //SORTBENCHMARK_H
@@ -0,0 +1,589 @@
+#ifndef SQL_H
+#define SQL_H
+
+#include <ctype.h>
+#include <stdlib.h>
+
+#include "util.h"
+#include "typedkey.h"
+#include "joinstream.h"
+#include "aggregatestate.h"
+
+/*****************************************
+ *************** TOKENIZER ***************
+ *****************************************/
+
+enum TokenType { IDENTIFIER_TOKEN, NUMBER_TOKEN, STRING_TOKEN, SYMBOL_TOKEN, END_TOKEN };
+
+struct Token {
+    TokenType type;
+    string text;
+    // Offset in the query, for error messages
+    size_t position;
+
+    /**
+     * @return whether the token is the keyword (any case) or the symbol
+     */
+    bool is(const string & word) const;
+};
+
+/**
+ * Splits a query into identifiers, numbers, 'quoted strings' ('' is a
+ * quote) and symbols. The last token is always an END_TOKEN.
+ * @return false, with the error set, on an unterminated string or an
+ *         unknown character
+ */
+bool tokenize(const string & sql, vector<Token> & tokens, string & error);
+
+/*****************************************
+ ****************** AST ******************
+ *****************************************/
+
+/**
+ * column, or table.column where table is a name or an alias.
+ */
+struct ColumnReference {
+    string table;
+    string column;
+
+    string toString() const;
+};
+
+/**
+ * A column, or function(column) when aggregate is set. COUNT(*) has an
+ * empty column.
+ */
+struct SelectItem {
+    ColumnReference column;
+    bool aggregate;
+    AggregateFunction function;
+
+    SelectItem() : aggregate(false), function(COUNT_AGGREGATE) {}
+
+    string toString() const;
+};
+
+struct OrderItem {
+    SelectItem item;
+    bool descending;
+};
+
+/**
+ * column comparator value. BETWEEN is parsed into >= and <=. The value may
+ * be a ? parameter, bound when the statement is executed.
+ */
+struct Condition {
+    ColumnReference column;
+    JoinComparator comparator;
+    TypedKey value;
+    // Index of the ? parameter that gives the value, -1 for a literal
+    int parameter;
+
+    Condition() : comparator(EQUAL), parameter(-1) {}
+};
+
+/**
+ * JOIN table [alias] ON left = right
+ */
+struct JoinClause {
+    string table;
+    string alias;
+    ColumnReference left;
+    ColumnReference right;
+};
+
+/**
+ * [EXPLAIN [ANALYZE]] SELECT items [FROM table [alias]] {JOIN ...} [WHERE condition {AND condition}]
+ * [GROUP BY columns] [ORDER BY items [ASC | DESC]] [LIMIT n]
+ */
+struct SelectStatement {
+    // Empty for SELECT *
+    vector<SelectItem> columns;
+    // Empty when there is no FROM: the table queried
+    string table;
+    string alias;
+    vector<JoinClause> joins;
+    vector<Condition> conditions;
+    vector<ColumnReference> group_by;
+    vector<OrderItem> order_by;
+    // -1 without LIMIT
+    long long limit;
+    // The query gives its plan, one line per row, instead of its rows
+    bool explain;
+    // With explain: the query runs, and its plan gives what each operator did
+    bool analyze;
+    // Number of ? in the conditions
+    int number_of_parameters;
+
+    SelectStatement() : limit(-1), explain(false), analyze(false), number_of_parameters(0) {}
+};
+
+/*****************************************
+ **************** PARSER *****************
+ *****************************************/
+
+/**
+ * Recursive descent parser of SelectStatements.
+ */
+class Parser {
+private:
+    vector<Token> tokens;
+    size_t position;
+    string error;
+
+    Token & peek();
+    Token & advance();
+    bool accept(const string & word);
+    bool expect(const string & word);
+    bool fail(const string & message);
+
+    bool isKeyword(const Token & token);
+    bool parseIdentifier(string & identifier);
+    bool parseColumnReference(ColumnReference & column);
+    bool parseSelectItem(SelectItem & item);
+    bool parseLiteral(TypedKey & value);
+    bool parseValue(Condition & condition, SelectStatement & statement);
+    bool parseComparator(JoinComparator & comparator);
+    bool parseTable(string & table, string & alias);
+    bool parseJoin(SelectStatement & statement);
+    bool parseCondition(SelectStatement & statement);
+
+public:
+    /**
+     * @return false, with the error set, if the query is not a valid SELECT
+     */
+    bool parse(const string & sql, SelectStatement & statement);
+
+    /**
+     * Rewrites the query with a single space between tokens and keywords in
+     * upper case, so the same query written differently gives the same text.
+     * @return false, with the error set, if the query cannot be tokenized
+     */
+    bool normalize(const string & sql, string & normalized);
+
+    string getError();
+};
+
+/**
+ * Parses a comparator as written in a query (=, ==, !=, <>, <, <=, >, >=).
+ * @return false if it is none of those
+ */
+bool parseComparator(const string & text, JoinComparator & comparator);
+
+/**
+ * @return a number as an INTEGER_KEY or REAL_KEY, anything else as a STRING_KEY
+ */
+TypedKey parseLiteral(const string & text);
+
+bool Token::is(const string & word) const {
+    if (type == SYMBOL_TOKEN) {
+        return text == word;
+    }
+    if (type != IDENTIFIER_TOKEN || text.size() != word.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < text.size(); i++) {
+        if (tolower(text[i]) != tolower(word[i])) return false;
+    }
+    return true;
+}
+
+bool tokenize(const string & sql, vector<Token> & tokens, string & error) {
+    tokens.clear();
+    size_t i = 0;
+    while (i < sql.size()) {
+        char character = sql[i];
+        if (isspace(character)) {
+            i++;
+            continue;
+        }
+
+        Token token;
+        token.position = i;
+        if (isalpha(character) || character == '_') {
+            token.type = IDENTIFIER_TOKEN;
+            while (i < sql.size() && (isalnum(sql[i]) || sql[i] == '_')) {
+                token.text += sql[i++];
+            }
+        } else if (isdigit(character) || (character == '.' && i + 1 < sql.size() && isdigit(sql[i + 1]))) {
+            token.type = NUMBER_TOKEN;
+            while (i < sql.size() && (isdigit(sql[i]) || sql[i] == '.')) {
+                token.text += sql[i++];
+            }
+            if (i < sql.size() && (sql[i] == 'e' || sql[i] == 'E')) {
+                token.text += sql[i++];
+                if (i < sql.size() && (sql[i] == '+' || sql[i] == '-')) {
+                    token.text += sql[i++];
+                }
+                while (i < sql.size() && isdigit(sql[i])) {
+                    token.text += sql[i++];
+                }
+            }
+        } else if (character == '\'') {
+            token.type = STRING_TOKEN;
+            i++;
+            while (true) {
+                if (i >= sql.size()) {
+                    error = "unterminated string at " + to_string(token.position);
+                    return false;
+                }
+                if (sql[i] == '\'') {
+                    if (i + 1 < sql.size() && sql[i + 1] == '\'') {
+                        token.text += '\'';
+                        i += 2;
+                        continue;
+                    }
+                    i++;
+                    break;
+                }
+                token.text += sql[i++];
+            }
+        } else {
+            token.type = SYMBOL_TOKEN;
+            string two = sql.substr(i, 2);
+            if (two == "<=" || two == ">=" || two == "!=" || two == "<>" || two == "==") {
+                token.text = two;
+                i += 2;
+            } else if (string("*,.=<>();-?").find(character) != string::npos) {
+                token.text = string(1, character);
+                i++;
+            } else {
+                error = string("unexpected '") + character + "' at " + to_string(i);
+                return false;
+            }
+        }
+        tokens.push_back(token);
+    }
+
+    Token end;
+    end.type = END_TOKEN;
+    end.position = sql.size();
+    tokens.push_back(end);
+    return true;
+}
+
+string ColumnReference::toString() const {
+    return table.empty() ? column : table + "." + column;
+}
+
+string SelectItem::toString() const {
+    if (!aggregate) {
+        return column.toString();
+    }
+    return getAggregateFunctionName(function) + "(" + (column.column.empty() ? "*" : column.toString()) + ")";
+}
+
+bool parseComparator(const string & text, JoinComparator & comparator) {
+    if (text == "=" || text == "==")      comparator = EQUAL;
+    else if (text == "!=" || text == "<>") comparator = NOT_EQUAL;
+    else if (text == "<")                  comparator = LESS;
+    else if (text == "<=")                 comparator = LESS_EQUAL;
+    else if (text == ">")                  comparator = GREATER;
+    else if (text == ">=")                 comparator = GREATER_EQUAL;
+    else return false;
+    return true;
+}
+
+TypedKey parseLiteral(const string & text) {
+    TypedKey value;
+    char * end = NULL;
+    const char * begin = text.c_str();
+
+    long long integer_value = strtoll(begin, &end, 10);
+    if (!text.empty() && *end == '\0') {
+        value.kind = INTEGER_KEY;
+        value.integer_value = integer_value;
+        return value;
+    }
+    double real_value = strtod(begin, &end);
+    if (!text.empty() && *end == '\0') {
+        value.kind = REAL_KEY;
+        value.real_value = real_value;
+        return value;
+    }
+    value.kind = STRING_KEY;
+    value.string_value = text;
+    return value;
+}
+
+/*****************************************
+ **************** PARSER *****************
+ *****************************************/
+
+Token & Parser::peek() {
+    return tokens[position];
+}
+
+Token & Parser::advance() {
+    Token & token = tokens[position];
+    if (token.type != END_TOKEN) {
+        position++;
+    }
+    return token;
+}
+
+bool Parser::accept(const string & word) {
+    if (peek().is(word)) {
+        advance();
+        return true;
+    }
+    return false;
+}
+
+bool Parser::expect(const string & word) {
+    if (accept(word)) {
+        return true;
+    }
+    return fail("expected " + word);
+}
+
+bool Parser::fail(const string & message) {
+    if (error.empty()) {
+        Token & token = peek();
+        error = message + " at " + to_string(token.position)
+              + (token.type == END_TOKEN ? " (end of query)" : " ('" + token.text + "')");
+    }
+    return false;
+}
+
+bool Parser::isKeyword(const Token & token) {
+    static const char * keywords[] = {"SELECT", "FROM", "JOIN", "INNER", "ON", "WHERE", "AND", "BETWEEN", "GROUP", "ORDER",
+                                      "BY", "ASC", "DESC", "LIMIT", "EXPLAIN", "ANALYZE"};
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        if (token.is(keywords[i])) return true;
+    }
+    return false;
+}
+
+bool Parser::parseIdentifier(string & identifier) {
+    if (peek().type != IDENTIFIER_TOKEN || isKeyword(peek())) {
+        return fail("expected a name");
+    }
+    identifier = advance().text;
+    return true;
+}
+
+bool Parser::parseColumnReference(ColumnReference & column) {
+    string first;
+    if (!parseIdentifier(first)) return false;
+    if (accept(".")) {
+        column.table = first;
+        return parseIdentifier(column.column);
+    }
+    column.table.clear();
+    column.column = first;
+    return true;
+}
+
+bool Parser::parseSelectItem(SelectItem & item) {
+    static const AggregateFunction functions[] = {COUNT_AGGREGATE, SUM_AGGREGATE, MIN_AGGREGATE, MAX_AGGREGATE, AVG_AGGREGATE};
+
+    item = SelectItem();
+    if (peek().type == IDENTIFIER_TOKEN && tokens[position + 1].is("(")) {
+        for (int f = 0; f < 5 && !item.aggregate; f++) {
+            if (peek().is(getAggregateFunctionName(functions[f]))) {
+                item.aggregate = true;
+                item.function = functions[f];
+            }
+        }
+        if (!item.aggregate) {
+            return fail("unknown function");
+        }
+        advance();
+        advance();
+        if (item.function == COUNT_AGGREGATE && accept("*")) {
+            return expect(")");
+        }
+        return parseColumnReference(item.column) && expect(")");
+    }
+    return parseColumnReference(item.column);
+}
+
+bool Parser::parseLiteral(TypedKey & value) {
+    bool negative = accept("-");
+    Token & token = peek();
+    if (token.type == NUMBER_TOKEN) {
+        value = ::parseLiteral((negative ? "-" : "") + advance().text);
+        if (value.kind == STRING_KEY) {
+            return fail("invalid number");
+        }
+        return true;
+    }
+    if (token.type == STRING_TOKEN && !negative) {
+        value.kind = STRING_KEY;
+        value.string_value = advance().text;
+        return true;
+    }
+    return fail("expected a value");
+}
+
+bool Parser::parseValue(Condition & condition, SelectStatement & statement) {
+    if (accept("?")) {
+        condition.parameter = statement.number_of_parameters++;
+        return true;
+    }
+    condition.parameter = -1;
+    return parseLiteral(condition.value);
+}
+
+bool Parser::parseComparator(JoinComparator & comparator) {
+    if (peek().type == SYMBOL_TOKEN && ::parseComparator(peek().text, comparator)) {
+        advance();
+        return true;
+    }
+    return fail("expected a comparator");
+}
+
+bool Parser::parseTable(string & table, string & alias) {
+    if (!parseIdentifier(table)) return false;
+    alias = table;
+    if (peek().type == IDENTIFIER_TOKEN && !isKeyword(peek())) {
+        alias = advance().text;
+    }
+    return true;
+}
+
+bool Parser::parseJoin(SelectStatement & statement) {
+    JoinClause join;
+    if (!parseTable(join.table, join.alias) || !expect("ON") || !parseColumnReference(join.left) || !expect("=")) {
+        return false;
+    }
+    if (!parseColumnReference(join.right)) return false;
+    statement.joins.push_back(join);
+    return true;
+}
+
+bool Parser::parseCondition(SelectStatement & statement) {
+    Condition condition;
+
+    // value comparator column is read as column flip(comparator) value
+    if (peek().type != IDENTIFIER_TOKEN) {
+        if (!parseValue(condition, statement) || !parseComparator(condition.comparator) || !parseColumnReference(condition.column)) {
+            return false;
+        }
+        condition.comparator = flip(condition.comparator);
+        statement.conditions.push_back(condition);
+        return true;
+    }
+
+    if (!parseColumnReference(condition.column)) return false;
+    if (accept("BETWEEN")) {
+        Condition upper = condition;
+        condition.comparator = GREATER_EQUAL;
+        upper.comparator = LESS_EQUAL;
+        if (!parseValue(condition, statement) || !expect("AND") || !parseValue(upper, statement)) {
+            return false;
+        }
+        statement.conditions.push_back(condition);
+        statement.conditions.push_back(upper);
+        return true;
+    }
+    if (!parseComparator(condition.comparator) || !parseValue(condition, statement)) {
+        return false;
+    }
+    statement.conditions.push_back(condition);
+    return true;
+}
+
+bool Parser::parse(const string & sql, SelectStatement & statement) {
+    statement = SelectStatement();
+    error.clear();
+    position = 0;
+    if (!tokenize(sql, tokens, error)) {
+        return false;
+    }
+
+    statement.explain = accept("EXPLAIN");
+    statement.analyze = statement.explain && accept("ANALYZE");
+    if (!expect("SELECT")) return false;
+    if (!accept("*")) {
+        do {
+            SelectItem item;
+            if (!parseSelectItem(item)) return false;
+            statement.columns.push_back(item);
+        } while (accept(","));
+    }
+
+    if (accept("FROM")) {
+        if (!parseTable(statement.table, statement.alias)) return false;
+        while (accept("JOIN") || (accept("INNER") && expect("JOIN"))) {
+            if (!parseJoin(statement)) return false;
+        }
+        if (!error.empty()) return false;
+    }
+
+    if (accept("WHERE")) {
+        do {
+            if (!parseCondition(statement)) return false;
+        } while (accept("AND"));
+    }
+
+    if (accept("GROUP")) {
+        if (!expect("BY")) return false;
+        do {
+            ColumnReference column;
+            if (!parseColumnReference(column)) return false;
+            statement.group_by.push_back(column);
+        } while (accept(","));
+    }
+
+    if (accept("ORDER")) {
+        if (!expect("BY")) return false;
+        do {
+            OrderItem order;
+            if (!parseSelectItem(order.item)) return false;
+            order.descending = accept("DESC");
+            if (!order.descending) {
+                accept("ASC");
+            }
+            statement.order_by.push_back(order);
+        } while (accept(","));
+    }
+
+    if (accept("LIMIT")) {
+        if (peek().type != NUMBER_TOKEN || ::parseLiteral(peek().text).kind != INTEGER_KEY) {
+            return fail("expected a row count");
+        }
+        statement.limit = atoll(advance().text.c_str());
+    }
+
+    accept(";");
+    if (peek().type != END_TOKEN) {
+        return fail("unexpected text");
+    }
+    return true;
+}
+
+bool Parser::normalize(const string & sql, string & normalized) {
+    error.clear();
+    if (!tokenize(sql, tokens, error)) {
+        return false;
+    }
+    normalized.clear();
+    for (size_t i = 0; i + 1 < tokens.size(); i++) {
+        Token & token = tokens[i];
+        if (i > 0) {
+            normalized += ' ';
+        }
+        if (token.type == STRING_TOKEN) {
+            normalized += '\'';
+            for (size_t c = 0; c < token.text.size(); c++) {
+                normalized += token.text[c] == '\'' ? "''" : string(1, token.text[c]);
+            }
+            normalized += '\'';
+        } else if (isKeyword(token)) {
+            for (size_t c = 0; c < token.text.size(); c++) {
+                normalized += toupper(token.text[c]);
+            }
+        } else {
+            normalized += token.text;
+        }
+    }
+    return true;
+}
+
+string Parser::getError() {
+    return error;
+}
+
+#endif //SQL_H
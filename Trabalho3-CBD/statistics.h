@@ -0,0 +1,116 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <math.h>
+#include <limits>
+
+#include "schema.h"
+#include "queryable.h"
+#include "scanner.h"
+#include "bloomfilter.h"
+
+/**
+ * HyperLogLog estimate of the number of distinct hashes added, in a few KB
+ * whatever the number of rows (about 1.6% standard error).
+ */
+class DistinctCounter {
+private:
+    static const int REGISTER_BITS = 12;
+    vector<unsigned char> registers;
+
+public:
+    DistinctCounter();
+
+    void add(unsigned long long hash);
+
+    long long estimate();
+};
+
+/**
+ * What the join planner knows about a column.
+ */
+struct ColumnStatistics {
+    long long number_of_rows;
+    long long distinct_keys;
+    // Range of the column, for INTEGER_KEY columns with at least one row
+    bool has_integer_range;
+    long long min_integer;
+    long long max_integer;
+
+    ColumnStatistics() : number_of_rows(0), distinct_keys(0), has_integer_range(false), min_integer(0), max_integer(0) {}
+};
+
+/**
+ * Scans the column once and gathers its statistics.
+ */
+ColumnStatistics computeStatistics(Queryable * table, int column_position);
+
+DistinctCounter::DistinctCounter() {
+    registers.assign(1 << REGISTER_BITS, 0);
+}
+
+void DistinctCounter::add(unsigned long long hash) {
+    // The first bits choose the register, the rest give the rank
+    unsigned index = hash >> (64 - REGISTER_BITS);
+    unsigned long long rest = (hash << REGISTER_BITS) | (1ULL << (REGISTER_BITS - 1));
+    unsigned char rank = 1;
+    while (!(rest & (1ULL << 63))) {
+        rank++;
+        rest <<= 1;
+    }
+    if (rank > registers[index]) {
+        registers[index] = rank;
+    }
+}
+
+long long DistinctCounter::estimate() {
+    double m = registers.size();
+    double sum = 0;
+    int zeros = 0;
+    for (size_t i = 0; i < registers.size(); i++) {
+        sum += ldexp(1.0, -registers[i]);
+        if (registers[i] == 0) zeros++;
+    }
+    double estimate = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+
+    // Few distinct values: linear counting is more precise
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / zeros);
+    }
+    return (long long) (estimate + 0.5);
+}
+
+ColumnStatistics computeStatistics(Queryable * table, int column_position) {
+    ColumnStatistics statistics;
+    DistinctCounter distinct;
+    KeyKind key_kind = getKeyKind(table->getSchema().getCols()->at(column_position).type);
+
+    statistics.min_integer = numeric_limits<long long>::max();
+    statistics.max_integer = numeric_limits<long long>::min();
+
+    Scanner * scan = table->scan();
+    while (scan->next()) {
+        statistics.number_of_rows++;
+        if (key_kind == INTEGER_KEY) {
+            long long key = scan->getInt(column_position);
+            distinct.add(hashKey(key));
+            statistics.min_integer = min(statistics.min_integer, key);
+            statistics.max_integer = max(statistics.max_integer, key);
+        } else if (key_kind == REAL_KEY) {
+            distinct.add(hashKey(scan->getDouble(column_position)));
+        } else {
+            distinct.add(hashKey(scan->getString(column_position)));
+        }
+    }
+    delete scan;
+
+    statistics.has_integer_range = key_kind == INTEGER_KEY && statistics.number_of_rows > 0;
+    if (!statistics.has_integer_range) {
+        statistics.min_integer = statistics.max_integer = 0;
+    }
+    // The estimate can overshoot by a little on small columns
+    statistics.distinct_keys = min(distinct.estimate(), statistics.number_of_rows);
+    return statistics;
+}
+
+#endif //STATISTICS_H
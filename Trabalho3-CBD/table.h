@@ -5,8 +5,16 @@
 #include "schema.h"
 #include "cursor.h"
 #include "queryable.h"
+#include "scanner.h"
+#include "statistics.h"
+#include "secondaryindex.h"
 #include "join.h"
+#include "catalog.h"
+#include "query.h"
+#include "preparedstatement.h"
 #include <fstream>
+#include <limits>
+#include <map>
 #include <time.h>
 #include <string.h>
 #include <algorithm>
@@ -23,6 +31,11 @@ private:
     string path;
     string header_file_path;
     header_t * header;
+    vector<int> sorted_columns;
+    map<int, ColumnStatistics> statistics;
+    vector<int> indexed_columns;
+    map<int, SecondaryIndex*> indexes;
+    long long version;
     
     friend class TableBenchmark;
     
@@ -32,6 +45,11 @@ private:
     
     void loadHeader();
     
+    void clearIndexes();
+    
+    template <typename T>
+    bool isScanSorted(int column_position);
+    
 public:
     Table(string name);
 
@@ -42,6 +60,7 @@ public:
 
     void setSchema(Schema schema);
 
+    string getName();
     Schema getSchema();
     header_t * getHeader();
 
@@ -56,10 +75,24 @@ public:
     Join join(string this_column, Table* other_table, string other_column, JoinType join_type);
     
     void drop();
-     
+    
+    /**
+     * Runs a SELECT, over this table when it has no FROM, or over the
+     * tables of the default Catalog it names. The rows are read as the
+     * Cursor moves.
+     */
     Cursor query(string q);
+    
+    /**
+     * Parses and plans a SELECT once, to be run many times with the values
+     * of its ? parameters bound. Plans are shared through the default
+     * PlanCache, so preparing the same query again is cheap.
+     */
+    PreparedStatement prepare(string q);
      
-
+    /**
+     * SELECT select WHERE where_args[i] where_comparators[i] where_values[i] AND ...
+     */
     Cursor query(
             vector<string> & select,
             vector<string> & where_args,
@@ -84,6 +117,55 @@ public:
     
 
     int getNumberOfRows();
+    
+    
+    Scanner * scan();
+    
+    /**
+     * Whether scanning in header order yields the column in ascending order.
+     * Always true for _id; other columns only once declared or checked.
+     */
+    bool isSortedOn(int column_position);
+    
+    /**
+     * Declares the registries are ordered on the column. Dropped on insert.
+     */
+    void setSortedOn(string column_name);
+    
+    /**
+     * Scans the column and declares it sorted if it is.
+     */
+    bool checkSortedOn(string column_name);
+    
+    /**
+     * Gathered on first use and kept until the next insert.
+     */
+    ColumnStatistics getStatistics(int column_position);
+    
+    /**
+     * Declares an index on the column, which queries search instead of
+     * scanning the table. Built on first use and again after an insert.
+     * @return false if there is no such column
+     */
+    bool createIndex(string column_name);
+    
+    void dropIndex(string column_name);
+    
+    /**
+     * @return the index of the column, NULL if it has none
+     */
+    SecondaryIndex * getIndex(int column_position);
+    
+    /**
+     * @return whether the column has an index, without building it
+     */
+    bool hasIndex(int column_position);
+    
+    /**
+     * Bumped whenever the rows, the schema, the sort order or the indexes
+     * change, so plans made before can tell they are stale.
+     */
+    long long getVersion();
 };
 
 
@@ -92,24 +174,34 @@ Table::Table(string name) {
     this->path = name + ".dat";
     this->header_file_path = name + "_h.dat";
     this->header = new header_t();
+    this->version = 0;
     loadHeader();
     
     RegistryHeader reg_header;
     Table::HEADER_SIZE = sizeof(reg_header.table_name) + sizeof(reg_header.registry_size) + sizeof(reg_header.time_stamp);
     // cout << "HEADER_SIZE = " << HEADER_SIZE << endl;
     
+    Catalog::getDefault().add(this);
 }
 
 Table::~Table() {
+    Catalog::getDefault().remove(this);
+    clearIndexes();
     delete this->header;
 }
 
 void Table::importSchema(const string & path) {
     schema.import(path);
+    version++;
 }
 
 void Table::setSchema(Schema schema) {
     this->schema = schema;
+    version++;
+}
+
+string Table::getName() {
+    return this->name;
 }
 
 Schema Table::getSchema(){
@@ -164,6 +256,11 @@ void Table::convertAndSave(ofstream *file, string * string_value, SchemaCol *sch
 }
 
 long long Table::insert(vector<string> row) {
+    version++;
+    sorted_columns.clear();
+    statistics.clear();
+    clearIndexes();
+    
     ofstream file;
     file.open(path.c_str(), ios::binary | ios::app);
 
@@ -224,6 +321,7 @@ bool Table::insertOnHeaderFile(HeaderFile * header_file) {
             header_file->registry_position));
     
     file.close();
+    return true;
 }
 
 void Table::printHeaderFile(int number_of_values) {
@@ -250,12 +348,10 @@ void Table::printHeaderFile(int number_of_values) {
 void Table::print(int number_of_values) {
     cout << "Printing " << name << " table" << endl;
     int counter = 0;
-    while (counter != number_of_values) {
-        // cout << "headerSize= "<< header->size()<< endl;
-        if (counter == header->size()) {
-            break;
-        }
-        vector<string> row = getRow(header->at(counter).second);
+    // Reads the first rows in a few small blocks, not a file open per row
+    Scanner * scanner = scan();
+    while (counter != number_of_values && scanner->next()) {
+        vector<string> row = scanner->getRow();
     
         for (vector<string>::iterator it = row.begin(); it != row.end(); it++) {
             cout << (*it) << " | ";
@@ -264,146 +360,38 @@ void Table::print(int number_of_values) {
         counter ++;
         cout << endl;
     }
+    delete scanner;
     cout << endl;
 }
 
 Cursor Table::query(string q) {
+    return executeQuery(q, &Catalog::getDefault(), this);
+}
 
-    std::transform(q.begin(), q.end(), q.begin(), ::tolower);
-
-    vector<string> select;
-    
-    vector<string> where_args;
-    vector<string> where_comparators;
-    vector<string> where_vals;
-    
-    bool parsing_select = false;
-    bool parsing_where = false;
-    
-    bool parsing_word = false;
-    
-    bool parsing_where_arg = false;
-    bool parsing_where_comparator = false;
-    bool parsing_where_val = false;
-    
-    string string_buffer;
-    
-    bool ignore_space = false;
-    
-    for (string::iterator it = q.begin(); it != q.end(); it++) {
-        char character = (*it);
-        
-        if (character == '\'') {
-            ignore_space = !ignore_space;
-            continue;
-            
-        } else if (character != ' ' || character != ',') {
-            parsing_word = true;
-            
-        } else {
-            if (character == ' ' && ignore_space) {
-                parsing_word = true;
-            } else {
-                parsing_word = false;
-            }
-        }
-        
-        if (!parsing_select && !parsing_where) {
-            if (character != ' ') {
-                string_buffer += character;
-            }
-            // cout << string_buffer << endl;
-            if (string_buffer == "select") {
-                parsing_select = true;
-                string_buffer.clear();
-            } else if (string_buffer == "where") {
-                cout << "Changing to WHERE" << endl;
-                parsing_where = true;
-                parsing_where_arg = true;
-                parsing_select = false;                
-                string_buffer.clear();
-            }
-        } else if (character != ' ' || ignore_space) {
-            if (parsing_select) {
-                if (character == ',') {
-                    
-                    where_args.push_back(string_buffer);
-                    cout << string_buffer << endl;
-                    string_buffer.clear();
-                } else {
-                    if (parsing_word) {
-                        string_buffer += character;
-                    } else {
-                        parsing_select = false;
-                        where_args.push_back(string_buffer);
-                        cout << string_buffer << endl;
-                        string_buffer.clear();
-                    }
-                }
-                
-            } else if (parsing_where) {
-                if (character == ',') {
-                    if (parsing_where_val) {
-                        where_vals.push_back(string_buffer);
-                        cout << "Where value = " << string_buffer << endl;
-                        string_buffer.clear();
-                    }
-                    parsing_where_arg = true;
-                    parsing_where_comparator = false;
-                    parsing_where_val = false;
-                } else if (parsing_word) {
-                    if (parsing_where_arg) {
-                        if (character == '=' || character == '<' || character == '>' || character == '!') {
-                            
-                            parsing_where_arg = false;
-                            parsing_where_comparator = true;
-                            where_args.push_back(string_buffer);
-                            cout << "Where arg = " << string_buffer << endl;
-                            string_buffer.clear();
-                        }
-                    } else if (parsing_where_comparator) {
-                        if (character != '=' || character != '<' || character != '>' || character != '!') {
-                      
-                            parsing_where_comparator = false;
-                            parsing_where_val = true;
-                            where_comparators.push_back(string_buffer);
-                            cout << "Where comparator = " << string_buffer << endl;
-                            string_buffer.clear();
-                        }
-                    }
-                    
-                    string_buffer += character;
-                }
-            }
-        } else if (character == ' ') {
-            if (!string_buffer.empty()) {
-                if (parsing_select) {
-                    select.push_back(string_buffer);
-                    cout << "F Select = " << string_buffer << endl;
-                    string_buffer.clear();
-                    parsing_select = false;
-                }
-            }
-        }
-    }
-    if (parsing_select) {
-        select.push_back(string_buffer);
-        cout << "Final select = " << string_buffer << endl;
-        
-    } else if (parsing_where && parsing_where_val) {
-        where_vals.push_back(string_buffer);
-        cout << "Final where value = " << string_buffer << endl;
-    }
-    
-    return query(select, where_args, where_comparators, where_vals);
+PreparedStatement Table::prepare(string q) {
+    return PlanCache::getDefault().prepare(q, this);
 }
 
 Cursor Table::query(vector<string> & select, vector<string> & where_args, vector<string> & where_comparators, vector<string> & where_values) {
-    vector<vector <string> > result;
+    SelectStatement statement;
+    for (size_t i = 0; i < select.size(); i++) {
+        if (select[i] == "*") continue;
+        SelectItem item;
+        item.column.column = select[i];
+        statement.columns.push_back(item);
+    }
     
+    for (size_t i = 0; i < where_args.size(); i++) {
+        Condition condition;
+        condition.column.column = where_args[i];
+        if (i >= where_comparators.size() || i >= where_values.size() || !parseComparator(where_comparators[i], condition.comparator)) {
+            return Cursor("invalid condition on " + where_args[i]);
+        }
+        condition.value = parseLiteral(where_values[i]);
+        statement.conditions.push_back(condition);
+    }
     
-    Cursor cursor(schema, result);
-    return cursor;
+    return executeQuery(statement, &Catalog::getDefault(), this);
 }
 
 void Table::convertFromCSV(const string & path) {
@@ -503,6 +491,8 @@ void Table::drop() {
     remove(this->path.c_str());
     remove(this->header_file_path.c_str());
     this->header->clear();
+    clearIndexes();
+    version++;
 }
 
 Join Table::join(string this_column_name, Table* other_table, string other_column_name, JoinType join_type) {
@@ -540,4 +530,117 @@ string Table::getValue(long long _id, int column_position) {
     }
     return value;
 }
+
+Scanner * Table::scan() {
+    return new Scanner(path, schema, header, HEADER_SIZE);
+}
+
+bool Table::isSortedOn(int column_position) {
+    if (column_position == 0) {
+        return true;
+    }
+    return find(sorted_columns.begin(), sorted_columns.end(), column_position) != sorted_columns.end();
+}
+
+void Table::setSortedOn(string column_name) {
+    int column_position = schema.getColPosition(column_name);
+    if (column_position >= 0 && !isSortedOn(column_position)) {
+        sorted_columns.push_back(column_position);
+        version++;
+    }
+}
+
+bool Table::checkSortedOn(string column_name) {
+    int column_position = schema.getColPosition(column_name);
+    if (column_position < 0) return false;
+    
+    bool sorted = false;
+    switch (getKeyKind(schema.getCols()->at(column_position).type)) {
+        case INTEGER_KEY : sorted = isScanSorted<long long>(column_position); break;
+        case REAL_KEY    : sorted = isScanSorted<double>(column_position); break;
+        case STRING_KEY  : sorted = isScanSorted<string>(column_position); break;
+    }
+    if (sorted) {
+        setSortedOn(column_name);
+    }
+    return sorted;
+}
+
+ColumnStatistics Table::getStatistics(int column_position) {
+    map<int, ColumnStatistics>::iterator it = statistics.find(column_position);
+    if (it == statistics.end()) {
+        it = statistics.insert(make_pair(column_position, computeStatistics(this, column_position))).first;
+    }
+    return it->second;
+}
+
+bool Table::createIndex(string column_name) {
+    int column_position = schema.getColPosition(column_name);
+    if (column_position < 0) return false;
+    if (find(indexed_columns.begin(), indexed_columns.end(), column_position) == indexed_columns.end()) {
+        indexed_columns.push_back(column_position);
+        version++;
+    }
+    return true;
+}
+
+void Table::dropIndex(string column_name) {
+    int column_position = schema.getColPosition(column_name);
+    if (find(indexed_columns.begin(), indexed_columns.end(), column_position) != indexed_columns.end()) {
+        version++;
+    }
+    indexed_columns.erase(remove(indexed_columns.begin(), indexed_columns.end(), column_position), indexed_columns.end());
+    map<int, SecondaryIndex*>::iterator it = indexes.find(column_position);
+    if (it != indexes.end()) {
+        delete it->second;
+        indexes.erase(it);
+    }
+}
+
+SecondaryIndex * Table::getIndex(int column_position) {
+    if (!hasIndex(column_position)) {
+        return NULL;
+    }
+    map<int, SecondaryIndex*>::iterator it = indexes.find(column_position);
+    if (it == indexes.end()) {
+        it = indexes.insert(make_pair(column_position, new SecondaryIndex(this, column_position))).first;
+    }
+    return it->second;
+}
+
+bool Table::hasIndex(int column_position) {
+    return find(indexed_columns.begin(), indexed_columns.end(), column_position) != indexed_columns.end();
+}
+
+long long Table::getVersion() {
+    return version;
+}
+
+void Table::clearIndexes() {
+    for (map<int, SecondaryIndex*>::iterator it = indexes.begin(); it != indexes.end(); it++) {
+        delete it->second;
+    }
+    indexes.clear();
+}
+
+template <typename T>
+bool Table::isScanSorted(int column_position) {
+    Scanner * scanner = scan();
+    bool sorted = true;
+    T last;
+    
+    if (scanner->next()) {
+        last = scanner->getKey<T>(column_position);
+        while (scanner->next()) {
+            T key = scanner->getKey<T>(column_position);
+            if (key < last) {
+                sorted = false;
+                break;
+            }
+            last = key;
+        }
+    }
+    delete scanner;
+    return sorted;
+}
 #endif //TABLE_H
\ No newline at end of file
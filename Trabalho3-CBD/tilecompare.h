@@ -0,0 +1,197 @@
+#ifndef TILECOMPARE_H
+#define TILECOMPARE_H
+
+#include <functional>
+
+#if defined(__AVX2__) || defined(__SSE4_2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "util.h"
+
+/**
+ * Keys compared at once by the nested loop: one bit of a match mask each.
+ */
+const size_t TILE_SIZE = 64;
+
+enum TileOp { TILE_EQUAL, TILE_NOT_EQUAL, TILE_LESS, TILE_LESS_EQUAL, TILE_GREATER, TILE_GREATER_EQUAL };
+
+/**
+ * The TileOp of a comparison functor, so the kernels below can be chosen
+ * from the Compare of a NestedLoopStream.
+ */
+template <typename Compare> struct TileOpOf;
+template <typename T> struct TileOpOf<equal_to<T> >      { static const TileOp op = TILE_EQUAL; };
+template <typename T> struct TileOpOf<not_equal_to<T> >  { static const TileOp op = TILE_NOT_EQUAL; };
+template <typename T> struct TileOpOf<less<T> >          { static const TileOp op = TILE_LESS; };
+template <typename T> struct TileOpOf<less_equal<T> >    { static const TileOp op = TILE_LESS_EQUAL; };
+template <typename T> struct TileOpOf<greater<T> >       { static const TileOp op = TILE_GREATER; };
+template <typename T> struct TileOpOf<greater_equal<T> > { static const TileOp op = TILE_GREATER_EQUAL; };
+
+/**
+ * Compares keys[0..n) against key, n <= TILE_SIZE.
+ * @return bit i set when compare(keys[i], key)
+ */
+template <typename T, typename Compare>
+struct TileCompare {
+    static unsigned long long match(const T * keys, size_t n, const T & key) {
+        Compare compare;
+        unsigned long long mask = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (compare(keys[i], key)) {
+                mask |= 1ULL << i;
+            }
+        }
+        return mask;
+    }
+};
+
+/**
+ * Integer keys: 4 per instruction with AVX2, 2 with SSE 4.2, and otherwise
+ * a branchless loop. Only == and > exist in SIMD, the other comparisons are
+ * built from them.
+ */
+template <TileOp op>
+unsigned long long matchIntegerTile(const long long * keys, size_t n, long long key) {
+    unsigned long long mask = 0;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    __m256i broadcast = _mm256_set1_epi64x(key);
+    for (; i + 4 <= n; i += 4) {
+        __m256i values = _mm256_loadu_si256((const __m256i *) (keys + i));
+        __m256i result;
+        switch (op) {
+            case TILE_EQUAL         :
+            case TILE_NOT_EQUAL     : result = _mm256_cmpeq_epi64(values, broadcast); break;
+            case TILE_LESS          :
+            case TILE_GREATER_EQUAL : result = _mm256_cmpgt_epi64(broadcast, values); break;
+            default                 : result = _mm256_cmpgt_epi64(values, broadcast); break;
+        }
+        unsigned long long bits = _mm256_movemask_pd(_mm256_castsi256_pd(result));
+        mask |= bits << i;
+    }
+#elif defined(__SSE4_2__)
+    __m128i broadcast = _mm_set1_epi64x(key);
+    for (; i + 2 <= n; i += 2) {
+        __m128i values = _mm_loadu_si128((const __m128i *) (keys + i));
+        __m128i result;
+        switch (op) {
+            case TILE_EQUAL         :
+            case TILE_NOT_EQUAL     : result = _mm_cmpeq_epi64(values, broadcast); break;
+            case TILE_LESS          :
+            case TILE_GREATER_EQUAL : result = _mm_cmpgt_epi64(broadcast, values); break;
+            default                 : result = _mm_cmpgt_epi64(values, broadcast); break;
+        }
+        unsigned long long bits = _mm_movemask_pd(_mm_castsi128_pd(result));
+        mask |= bits << i;
+    }
+#endif
+
+    for (; i < n; i++) {
+        bool bit;
+        switch (op) {
+            case TILE_EQUAL         :
+            case TILE_NOT_EQUAL     : bit = keys[i] == key; break;
+            case TILE_LESS          :
+            case TILE_GREATER_EQUAL : bit = keys[i] < key; break;
+            default                 : bit = keys[i] > key; break;
+        }
+        mask |= (unsigned long long) bit << i;
+    }
+
+    // The complements: != is not ==, >= is not <, <= is not >
+    if (op == TILE_NOT_EQUAL || op == TILE_GREATER_EQUAL || op == TILE_LESS_EQUAL) {
+        mask = ~mask & (n == 64 ? ~0ULL : (1ULL << n) - 1);
+    }
+    return mask;
+}
+
+/**
+ * Real keys: 4 per instruction with AVX2, 2 with SSE2. Comparisons are
+ * ordered, so NaN matches nothing but !=, as with the scalar operators.
+ */
+template <TileOp op>
+unsigned long long matchRealTile(const double * keys, size_t n, double key) {
+    unsigned long long mask = 0;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    __m256d broadcast = _mm256_set1_pd(key);
+    for (; i + 4 <= n; i += 4) {
+        __m256d values = _mm256_loadu_pd(keys + i);
+        __m256d result;
+        switch (op) {
+            case TILE_EQUAL         : result = _mm256_cmp_pd(values, broadcast, _CMP_EQ_OQ); break;
+            case TILE_NOT_EQUAL     : result = _mm256_cmp_pd(values, broadcast, _CMP_NEQ_UQ); break;
+            case TILE_LESS          : result = _mm256_cmp_pd(values, broadcast, _CMP_LT_OQ); break;
+            case TILE_LESS_EQUAL    : result = _mm256_cmp_pd(values, broadcast, _CMP_LE_OQ); break;
+            case TILE_GREATER       : result = _mm256_cmp_pd(values, broadcast, _CMP_GT_OQ); break;
+            default                 : result = _mm256_cmp_pd(values, broadcast, _CMP_GE_OQ); break;
+        }
+        unsigned long long bits = _mm256_movemask_pd(result);
+        mask |= bits << i;
+    }
+#elif defined(__SSE2__)
+    __m128d broadcast = _mm_set1_pd(key);
+    for (; i + 2 <= n; i += 2) {
+        __m128d values = _mm_loadu_pd(keys + i);
+        __m128d result;
+        switch (op) {
+            case TILE_EQUAL         : result = _mm_cmpeq_pd(values, broadcast); break;
+            case TILE_NOT_EQUAL     : result = _mm_cmpneq_pd(values, broadcast); break;
+            case TILE_LESS          : result = _mm_cmplt_pd(values, broadcast); break;
+            case TILE_LESS_EQUAL    : result = _mm_cmple_pd(values, broadcast); break;
+            case TILE_GREATER       : result = _mm_cmpgt_pd(values, broadcast); break;
+            default                 : result = _mm_cmpge_pd(values, broadcast); break;
+        }
+        unsigned long long bits = _mm_movemask_pd(result);
+        mask |= bits << i;
+    }
+#endif
+
+    for (; i < n; i++) {
+        bool bit;
+        switch (op) {
+            case TILE_EQUAL         : bit = keys[i] == key; break;
+            case TILE_NOT_EQUAL     : bit = keys[i] != key; break;
+            case TILE_LESS          : bit = keys[i] < key; break;
+            case TILE_LESS_EQUAL    : bit = keys[i] <= key; break;
+            case TILE_GREATER       : bit = keys[i] > key; break;
+            default                 : bit = keys[i] >= key; break;
+        }
+        mask |= (unsigned long long) bit << i;
+    }
+    return mask;
+}
+
+template <typename Compare>
+struct TileCompare<long long, Compare> {
+    static unsigned long long match(const long long * keys, size_t n, long long key) {
+        return matchIntegerTile<TileOpOf<Compare>::op>(keys, n, key);
+    }
+};
+
+template <typename Compare>
+struct TileCompare<double, Compare> {
+    static unsigned long long match(const double * keys, size_t n, double key) {
+        return matchRealTile<TileOpOf<Compare>::op>(keys, n, key);
+    }
+};
+
+/**
+ * @return the name of the kernel compiled in, for benchmarks
+ */
+string getTileCompareInstructionSet() {
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE4_2__)
+    return "SSE4.2";
+#elif defined(__SSE2__)
+    return "SSE2 (reals only)";
+#else
+    return "scalar";
+#endif
+}
+
+#endif //TILECOMPARE_H
@@ -1,9 +1,9 @@
 #ifndef TIMER_H
 #define TIMER_H
-#include <ctime>
+#include <chrono>
 
 class Timer {
-    std::clock_t start_time;
+    std::chrono::steady_clock::time_point start_time;
 
 public:
     /**
@@ -18,11 +18,11 @@ public:
 };
 
 void Timer::start() {
-    start_time = std::clock();
+    start_time = std::chrono::steady_clock::now();
 }
 
 double Timer::getElapsedTime() {
-    return ( std::clock() - start_time ) / (double) CLOCKS_PER_SEC;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
 }
 
-#endif //TIMER_H
\ No newline at end of file
+#endif //TIMER_H
@@ -0,0 +1,144 @@
+#ifndef TYPEDKEY_H
+#define TYPEDKEY_H
+
+#include "schema.h"
+#include "scanner.h"
+#include "bloomfilter.h"
+
+/**
+ * A column value held as the kind it is compared as, for operators whose
+ * key kind is only known at run time.
+ */
+struct TypedKey {
+    KeyKind kind;
+    long long integer_value;
+    double real_value;
+    string string_value;
+
+    TypedKey() : kind(INTEGER_KEY), integer_value(0), real_value(0) {}
+
+    bool operator==(const TypedKey & other) const;
+    bool operator<(const TypedKey & other) const;
+};
+
+struct TypedKeyHash {
+    size_t operator()(const TypedKey & key) const;
+};
+
+/**
+ * Reads the column of the scanner's current registry as key_kind.
+ */
+TypedKey readTypedKey(Scanner * scan, int column_position, KeyKind key_kind);
+
+/**
+ * @return the key as key_kind, converted the way Scanner converts columns
+ */
+TypedKey convertKey(const TypedKey & key, KeyKind key_kind);
+
+/**
+ * @return the value as getRow prints it
+ */
+string toString(const TypedKey & key);
+
+void writeTypedKey(ostream & out, const TypedKey & key);
+bool readTypedKey(istream & in, TypedKey & key);
+
+bool TypedKey::operator==(const TypedKey & other) const {
+    switch (kind) {
+        case INTEGER_KEY : return integer_value == other.integer_value;
+        case REAL_KEY    : return real_value == other.real_value;
+        default          : return string_value == other.string_value;
+    }
+}
+
+bool TypedKey::operator<(const TypedKey & other) const {
+    switch (kind) {
+        case INTEGER_KEY : return integer_value < other.integer_value;
+        case REAL_KEY    : return real_value < other.real_value;
+        default          : return string_value < other.string_value;
+    }
+}
+
+size_t TypedKeyHash::operator()(const TypedKey & key) const {
+    switch (key.kind) {
+        case INTEGER_KEY : return hashKey(key.integer_value);
+        case REAL_KEY    : return hashKey(key.real_value);
+        default          : return hashKey(key.string_value);
+    }
+}
+
+TypedKey readTypedKey(Scanner * scan, int column_position, KeyKind key_kind) {
+    TypedKey key;
+    key.kind = key_kind;
+    switch (key_kind) {
+        case INTEGER_KEY : key.integer_value = scan->getInt(column_position); break;
+        case REAL_KEY    : key.real_value = scan->getDouble(column_position); break;
+        case STRING_KEY  : key.string_value = scan->getString(column_position); break;
+    }
+    return key;
+}
+
+TypedKey convertKey(const TypedKey & key, KeyKind key_kind) {
+    if (key.kind == key_kind) {
+        return key;
+    }
+    TypedKey converted;
+    converted.kind = key_kind;
+    switch (key_kind) {
+        case INTEGER_KEY :
+            converted.integer_value = key.kind == REAL_KEY ? (long long) key.real_value : atoll(key.string_value.c_str());
+            break;
+        case REAL_KEY :
+            converted.real_value = key.kind == INTEGER_KEY ? (double) key.integer_value : atof(key.string_value.c_str());
+            break;
+        case STRING_KEY :
+            converted.string_value = toString(key);
+            break;
+    }
+    return converted;
+}
+
+string toString(const TypedKey & key) {
+    ostringstream stream;
+    switch (key.kind) {
+        case INTEGER_KEY : stream << key.integer_value; break;
+        case REAL_KEY    : stream << key.real_value; break;
+        case STRING_KEY  : stream << key.string_value; break;
+    }
+    return stream.str();
+}
+
+void writeTypedKey(ostream & out, const TypedKey & key) {
+    char kind = key.kind;
+    out.write(&kind, sizeof(kind));
+    if (key.kind == INTEGER_KEY) {
+        out.write(reinterpret_cast<const char *> (&key.integer_value), sizeof(key.integer_value));
+    } else if (key.kind == REAL_KEY) {
+        out.write(reinterpret_cast<const char *> (&key.real_value), sizeof(key.real_value));
+    } else {
+        unsigned size = key.string_value.size();
+        out.write(reinterpret_cast<const char *> (&size), sizeof(size));
+        out.write(key.string_value.data(), size);
+    }
+}
+
+bool readTypedKey(istream & in, TypedKey & key) {
+    char kind;
+    if (!in.read(&kind, sizeof(kind))) {
+        return false;
+    }
+    key.kind = (KeyKind) kind;
+    if (key.kind == INTEGER_KEY) {
+        return (bool) in.read(reinterpret_cast<char *> (&key.integer_value), sizeof(key.integer_value));
+    } else if (key.kind == REAL_KEY) {
+        return (bool) in.read(reinterpret_cast<char *> (&key.real_value), sizeof(key.real_value));
+    }
+    unsigned size;
+    if (!in.read(reinterpret_cast<char *> (&size), sizeof(size))) {
+        return false;
+    }
+    key.string_value.resize(size);
+    return size == 0 || (bool) in.read(&key.string_value[0], size);
+}
+
+#endif //TYPEDKEY_H
@@ -2,6 +2,7 @@
 #define UTIL_H
 
 #include <iostream>
+#include <iomanip>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -38,4 +39,19 @@ void print(vector<T> *row) {
      }
  }
 
+/**
+ * @return bytes as B, KB or MB
+ */
+string describeBytes(long long bytes) {
+    ostringstream description;
+    if (bytes < 1024) {
+        description << bytes << " B";
+    } else if (bytes < 1024 * 1024) {
+        description << fixed << setprecision(1) << bytes / 1024.0 << " KB";
+    } else {
+        description << fixed << setprecision(1) << bytes / (1024.0 * 1024.0) << " MB";
+    }
+    return description.str();
+}
+
 #endif //UTIL_H
\ No newline at end of file